@@ -1,3 +1,5 @@
 setenv kboot_addr_r 0x85000000
+# uncomment to run the kernel microbenchmarks instead of booting
+# setenv bootargs bench
 tftp ${kboot_addr_r} kleinix.itb
 bootm ${kboot_addr_r}
@@ -0,0 +1,114 @@
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "cpu.h"
+#include "spinlock.h"
+#include "async.h"
+
+void
+completion_init(struct completion *c)
+{
+	c->lock = __SPIN_LOCK_UNLOCKED;
+	c->done = 0;
+	c->waiter = NULL;
+}
+
+// From task_await(): consume a pending complete() and return 1, or
+// make t the waiter and return 0, after which the task must return
+// to the executor.
+int
+completion_try_wait(struct completion *c, struct task *t)
+{
+	int done;
+
+	spin_lock(&c->lock);
+	done = c->done > 0;
+	if (done)
+		c->done--;
+	else
+		c->waiter = t;
+	spin_unlock(&c->lock);
+	return done;
+}
+
+// Signal c, from an interrupt handler or anywhere else: wake its
+// waiter, or remember it for the next task_await().
+void
+complete(struct completion *c)
+{
+	struct task *t;
+
+	spin_lock(&c->lock);
+	t = c->waiter;
+	c->waiter = NULL;
+	if (!t)
+		c->done++;
+	spin_unlock(&c->lock);
+	if (t)
+		task_wake(t);
+}
+
+// Start t on CPU cpu's executor. t stays owned by the caller; it
+// must not be reused until it has finished (t->line == -1).
+void
+task_spawn(struct task *t, void (*fn)(struct task *), const char *name,
+	   int cpu)
+{
+	t->fn = fn;
+	t->name = name;
+	t->line = 0;
+	t->cpu = cpu;
+	t->runs = 0;
+	task_wake(t);
+}
+
+// Queue t on its executor. Like thread_unpark(), an idle remote CPU
+// gets an IPI to notice.
+void
+task_wake(struct task *t)
+{
+	struct cpu *c = &cpus[t->cpu];
+	int kick;
+
+	spin_lock(&c->exec.lock);
+	t->next = NULL;
+	if (c->exec.tail)
+		c->exec.tail->next = t;
+	else
+		c->exec.head = t;
+	c->exec.tail = t;
+	kick = c->thread == c->idle_thread;
+	spin_unlock(&c->exec.lock);
+	if (kick && c != mycpu())
+		sbi_send_ipi(1, c->hartid);
+}
+
+int
+task_runnable(void)
+{
+	return __atomic_load_n(&mycpu()->exec.head, __ATOMIC_RELAXED) !=
+	       NULL;
+}
+
+// Run every woken task on this CPU until each awaits or finishes.
+// Called from the idle loop.
+void
+executor_run(void)
+{
+	struct executor *e = &mycpu()->exec;
+	struct task *t;
+
+	for (;;) {
+		spin_lock(&e->lock);
+		t = e->head;
+		if (t) {
+			e->head = t->next;
+			if (!e->head)
+				e->tail = NULL;
+		}
+		spin_unlock(&e->lock);
+		if (!t)
+			return;
+		t->runs++;
+		t->fn(t);
+	}
+}
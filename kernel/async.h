@@ -0,0 +1,99 @@
+#ifndef __ASYNC_H__
+#define __ASYNC_H__
+
+#include "types.h"
+#include "spinlock.h"
+
+// Stackless tasks for driver code that waits on interrupts. A task
+// is a function that the executor of its CPU (run from the idle
+// loop) calls again each time the task is woken; task_begin() jumps
+// back to the task_await() it last returned from:
+//
+//	struct rx_task {
+//		struct task task; // first
+//		int n;            // state that lives across awaits
+//	};
+//
+//	static void
+//	rx_fn(struct task *t)
+//	{
+//		struct rx_task *rx = (struct rx_task *)t;
+//
+//		task_begin(t);
+//		for (rx->n = 0; rx->n < 10; rx->n++) {
+//			start_request();
+//			task_await(t, &request_done);
+//		}
+//		task_end(t);
+//	}
+//
+// Locals do not survive a task_await(): keep such state in the
+// structure embedding the task. A waiting task costs no stack and no
+// thread, only its structure.
+
+// One-shot events an interrupt handler signals with complete(). A
+// complete() with nobody waiting is remembered, so that a request
+// finishing before its task awaits it is not lost.
+struct completion {
+	spinlock_t lock;
+	int done;           // complete()s not yet awaited
+	struct task *waiter;
+};
+
+#define COMPLETION_INITIALIZER { SPIN_LOCK_INITIALIZER, 0, 0 }
+
+struct task {
+	void (*fn)(struct task *t);
+	const char *name;
+	int line;           // resume point, 0: start, -1: finished
+	int cpu;            // executor it runs on
+	struct task *next;  // executor queue link
+	uint64 runs;        // times run
+};
+
+#define task_begin(t)                                                  \
+	switch ((t)->line) {                                           \
+	case 0:
+
+#define task_await(t, c)                                               \
+	do {                                                           \
+		(t)->line = __LINE__;                                  \
+		if (!completion_try_wait((c), (t)))                    \
+			return;                                        \
+	case __LINE__:;                                                \
+	} while (0)
+
+#define task_end(t)                                                    \
+	}                                                              \
+	(t)->line = -1
+
+// Per-CPU queue of woken tasks, kept in struct cpu.
+struct executor {
+	spinlock_t lock;
+	struct task *head;
+	struct task *tail;
+};
+
+void
+completion_init(struct completion *c);
+
+int
+completion_try_wait(struct completion *c, struct task *t);
+
+void
+complete(struct completion *c);
+
+void
+task_spawn(struct task *t, void (*fn)(struct task *), const char *name,
+	   int cpu);
+
+void
+task_wake(struct task *t);
+
+int
+task_runnable(void);
+
+void
+executor_run(void);
+
+#endif /* __ASYNC_H__ */
@@ -0,0 +1,161 @@
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "cpu.h"
+#include "fdt.h"
+#include "kalloc.h"
+#include "klibc.h"
+#include "spinlock.h"
+#include "time.h"
+#include "bench.h"
+
+extern struct bench __benches_start[], __benches_end[];
+
+static uint64 ticks[BENCH_SAMPLES];
+static uint64 cycles[BENCH_SAMPLES];
+static uint64 instret[BENCH_SAMPLES];
+
+int
+bench_enabled(void)
+{
+#ifdef BENCH_MODE
+	return 1;
+#else
+	return fdt_bootargs_has("bench");
+#endif
+}
+
+static void
+sort(uint64 *v, int n)
+{
+	uint64 x;
+	int i, j;
+
+	for (i = 1; i < n; i++) {
+		x = v[i];
+		for (j = i; j > 0 && v[j - 1] > x; j--)
+			v[j] = v[j - 1];
+		v[j] = x;
+	}
+}
+
+// Run every registered benchmark and print one line each:
+//
+//	bench: name=ecall iters=64 samples=201 median_ticks=... p99_ticks=...
+//	       median_cycles=... p99_cycles=... median_instret=...
+//	       p99_instret=... timebase=... ops_per_sec=...
+//
+// (on one line), where ticks, cycles and instructions retired are
+// per sample, i.e. for iters operations, and ops_per_sec follows
+// from the median. tools/benchcmp.py compares
+// two runs; under QEMU -icount (make bench ICOUNT=0) the instret
+// figures repeat exactly from run to run.
+void
+bench_run_all(void)
+{
+	struct bench *b;
+	uint64 t0, c0, i0;
+	int i, skip;
+
+	sbi_printf("bench: %d cpus,%s%s\n", ncpu,
+		   pmu_available(PMU_CYCLES) ? " cycles" : "",
+		   pmu_available(PMU_INSTRET) ? " instret" : "");
+	for (b = __benches_start; b < __benches_end; b++) {
+		push_off();
+		skip = b->fn(b->iters) < 0; // also warms up caches
+		for (i = 0; !skip && i < BENCH_SAMPLES; i++) {
+			i0 = pmu_read(PMU_INSTRET);
+			c0 = pmu_read(PMU_CYCLES);
+			t0 = rdtime();
+			b->fn(b->iters);
+			ticks[i] = rdtime() - t0;
+			cycles[i] = pmu_read(PMU_CYCLES) - c0;
+			instret[i] = pmu_read(PMU_INSTRET) - i0;
+		}
+		pop_off();
+		if (skip) {
+			sbi_printf("bench: name=%s skipped\n", b->name);
+			continue;
+		}
+
+		sort(ticks, BENCH_SAMPLES);
+		sort(cycles, BENCH_SAMPLES);
+		sort(instret, BENCH_SAMPLES);
+		sbi_printf("bench: name=%s iters=%lu samples=%d "
+			   "median_ticks=%lu p99_ticks=%lu "
+			   "median_cycles=%lu p99_cycles=%lu "
+			   "median_instret=%lu p99_instret=%lu timebase=%lu "
+			   "ops_per_sec=%lu\n",
+			   b->name, b->iters, BENCH_SAMPLES,
+			   ticks[BENCH_SAMPLES / 2],
+			   ticks[BENCH_SAMPLES * 99 / 100],
+			   cycles[BENCH_SAMPLES / 2],
+			   cycles[BENCH_SAMPLES * 99 / 100],
+			   instret[BENCH_SAMPLES / 2],
+			   instret[BENCH_SAMPLES * 99 / 100], timebase_freq(),
+			   b->iters * timebase_freq() /
+			   (ticks[BENCH_SAMPLES / 2] ? ticks[BENCH_SAMPLES / 2] : 1));
+	}
+	sbi_puts("bench: done\n");
+}
+
+// SBI round trip with the cheapest call there is.
+BENCH(ecall, 64)
+{
+	while (iters--)
+		sbi_get_spec_version();
+	return 0;
+}
+
+// Uncontended acquire and release.
+BENCH(lock, 1024)
+{
+	static spinlock_t lock = SPIN_LOCK_INITIALIZER;
+
+	while (iters--) {
+		spin_lock(&lock);
+		spin_unlock(&lock);
+	}
+	return 0;
+}
+
+// IPI to an idle CPU until its handler has run, idle wakeup
+// included.
+BENCH(ipi, 1)
+{
+	struct cpu *c = &cpus[1];
+	uint64 n;
+
+	if (ncpu < 2 || !__atomic_load_n(&c->online, __ATOMIC_ACQUIRE))
+		return -1;
+	while (iters--) {
+		n = __atomic_load_n(&c->stat[CPU_STAT_IPI], __ATOMIC_RELAXED);
+		sbi_send_ipi(1, c->hartid);
+		while (__atomic_load_n(&c->stat[CPU_STAT_IPI],
+				       __ATOMIC_RELAXED) == n)
+			;
+	}
+	return 0;
+}
+
+BENCH(memcpy_4k, 16)
+{
+	static char src[PGSIZE], dst[PGSIZE];
+
+	while (iters--)
+		memcpy(dst, src, sizeof(dst));
+	return 0;
+}
+
+// One page from the free list and back, junk fill included.
+BENCH(kalloc, 64)
+{
+	void *p;
+
+	while (iters--) {
+		p = kalloc();
+		if (!p)
+			return -1;
+		kfree(p);
+	}
+	return 0;
+}
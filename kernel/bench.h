@@ -0,0 +1,43 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include "types.h"
+
+// In-kernel microbenchmarks, run in place of the normal boot when
+// the kernel is built with BENCH=1 (make bench) or booted with
+// "bench" on the command line (bootargs, see boot/uboot.cmd).
+//
+//	BENCH(ecall, 64)
+//	{
+//		while (iters--)
+//			sbi_get_spec_version();
+//		return 0;
+//	}
+//
+// registers a benchmark whose body performs the operation iters
+// times, or returns -1 if it cannot run on this machine. Each
+// benchmark is timed over BENCH_SAMPLES calls of its body, on the
+// boot hart with interrupts off.
+#define BENCH_SAMPLES 201
+
+struct bench {
+	const char *name;
+	int (*fn)(uint64 iters);
+	uint64 iters;   // operations per sample
+} __attribute__((aligned(8)));
+
+// Benchmarks live in their own section, see kernel.ld.
+#define BENCH(name, n)                                                \
+	static int bench_##name(uint64 iters);                        \
+	static struct bench bench_desc_##name                         \
+	__attribute__((section("benches"), used, aligned(8))) =       \
+		{ #name, bench_##name, n };                           \
+	static int bench_##name(uint64 iters)
+
+int
+bench_enabled(void);
+
+void
+bench_run_all(void);
+
+#endif /* __BENCH_H__ */
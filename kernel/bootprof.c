@@ -0,0 +1,173 @@
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "cpu.h"
+#include "fdt.h"
+#include "klibc.h"
+#include "time.h"
+#include "bootprof.h"
+
+// How long boot_report() waits for harts still coming up.
+#define BOOT_REPORT_WAIT_MS 100
+
+// One line of the table: a phase, over every hart that went
+// through it.
+struct phase_sum {
+	const char *phase;
+	int cpus;
+	int max_cpu;
+	uint64 total;
+	uint64 max;
+};
+
+#define PHASES_MAX 32
+
+static struct phase_sum sums[PHASES_MAX];
+static int nsums;
+
+// Record that c finished phase at time. Only c itself stamps once
+// it runs; the boot hart stamps the others before starting them.
+void
+boot_stamp_cpu(struct cpu *c, const char *phase, uint64 time)
+{
+	struct boot_prof *b = &c->boot;
+
+	if (b->n == BOOT_STAMPS_MAX)
+		return;
+	b->stamp[b->n].phase = phase;
+	b->stamp[b->n].time = time;
+	b->n++;
+}
+
+void
+boot_stamp(const char *phase)
+{
+	boot_stamp_cpu(mycpu(), phase, rdtime());
+}
+
+// Last stamp of a hart's bring-up.
+void
+boot_done(void)
+{
+	boot_stamp("ready");
+	__atomic_store_n(&mycpu()->boot.done, 1, __ATOMIC_RELEASE);
+}
+
+static void
+phase_add(const char *phase, int cpu, uint64 ticks)
+{
+	struct phase_sum *s;
+	int i;
+
+	for (i = 0; i < nsums; i++)
+		if (strcmp(sums[i].phase, phase) == 0)
+			break;
+	if (i == nsums) {
+		if (nsums == PHASES_MAX)
+			return;
+		nsums++;
+		sums[i].phase = phase;
+	}
+	s = &sums[i];
+	s->cpus++;
+	s->total += ticks;
+	if (ticks >= s->max) {
+		s->max = ticks;
+		s->max_cpu = cpu;
+	}
+}
+
+// Slowest first.
+static void
+phase_sort(void)
+{
+	struct phase_sum x;
+	int i, j;
+
+	for (i = 1; i < nsums; i++) {
+		x = sums[i];
+		for (j = i; j > 0 && sums[j - 1].max < x.max; j--)
+			sums[j] = sums[j - 1];
+		sums[j] = x;
+	}
+}
+
+// U-Boot leaves its own bootstage records in /bootstage when built
+// with CONFIG_BOOTSTAGE_FDT, in microseconds of the same timer.
+static void
+boot_report_firmware(void)
+{
+	const char *name;
+	uint32 us;
+	int node;
+
+	node = fdt_path_offset("/bootstage");
+	for (node = fdt_first_subnode(node); node >= 0;
+	     node = fdt_next_subnode(node)) {
+		name = fdt_getprop(node, "name", NULL);
+		if (!name)
+			continue;
+		if (fdt_getprop_u32(node, "mark", &us) == 0)
+			sbi_printf("bootstage: name=%s mark_us=%u\n", name, us);
+		else if (fdt_getprop_u32(node, "accum", &us) == 0)
+			sbi_printf("bootstage: name=%s accum_us=%u\n", name, us);
+	}
+}
+
+// Print every stamp, one machine-readable line each:
+//
+//	bootphase: cpu=<id> phase=<name> end_ns=<since reset> ns=<duration>
+//
+// then a table of the phases, slowest first.
+void
+boot_report(void)
+{
+	struct boot_prof *b;
+	struct boot_stamp *st;
+	struct phase_sum *s;
+	uint64 deadline, prev, d;
+	int cpu, i;
+
+	deadline = rdtime() + ns_to_ticks(BOOT_REPORT_WAIT_MS * NSEC_PER_MSEC);
+	for (cpu = 0; cpu < ncpu; cpu++)
+		while (__atomic_load_n(&cpus[cpu].online, __ATOMIC_ACQUIRE) &&
+		       !__atomic_load_n(&cpus[cpu].boot.done, __ATOMIC_ACQUIRE) &&
+		       rdtime() < deadline)
+			;
+
+	nsums = 0;
+	for (cpu = 0; cpu < ncpu; cpu++) {
+		b = &cpus[cpu].boot;
+		for (i = 0; i < b->n; i++) {
+			st = &b->stamp[i];
+			// the boot hart counts from reset, the others from
+			// their start request, which is their first stamp.
+			if (i == 0 && cpu != 0)
+				continue;
+			prev = i ? b->stamp[i - 1].time : 0;
+			d = st->time - prev;
+			phase_add(st->phase, cpu, d);
+			sbi_printf("bootphase: cpu=%d phase=%s end_ns=%lu ns=%lu\n",
+				   cpu, st->phase, ticks_to_ns(st->time),
+				   ticks_to_ns(d));
+		}
+	}
+	boot_report_firmware();
+
+	phase_sort();
+	sbi_printf("boot: %-12s %5s %10s %10s %s\n",
+		   "phase", "cpus", "max us", "avg us", "slowest");
+	for (i = 0; i < nsums; i++) {
+		s = &sums[i];
+		sbi_printf("boot: %-12s %5d %10lu %10lu cpu%d\n", s->phase,
+			   s->cpus, ticks_to_ns(s->max) / NSEC_PER_USEC,
+			   ticks_to_ns(s->total / s->cpus) / NSEC_PER_USEC,
+			   s->max_cpu);
+	}
+
+	b = &cpus[0].boot;
+	if (b->n > 0)
+		sbi_printf("boot: ready %lu us after reset, %lu us after _entry\n",
+			   ticks_to_ns(b->stamp[b->n - 1].time) / NSEC_PER_USEC,
+			   ticks_to_ns(b->stamp[b->n - 1].time -
+					b->stamp[0].time) / NSEC_PER_USEC);
+}
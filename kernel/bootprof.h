@@ -0,0 +1,40 @@
+#ifndef __BOOTPROF_H__
+#define __BOOTPROF_H__
+
+#include "types.h"
+
+// Boot phase timestamps. Each hart stamps rdtime() as it finishes a
+// step of its bring-up, boot_stamp("kinit") after kinit() and so
+// on, so a phase lasts from the previous stamp to its own. The boot
+// hart's first phase, "firmware", runs from timer reset to _entry;
+// the other harts start counting when the boot hart asks the SBI
+// to start them.
+#define BOOT_STAMPS_MAX 24
+
+struct boot_stamp {
+	const char *phase; // a single word, for the machine-readable lines
+	uint64 time;       // rdtime() at the end of the phase
+};
+
+// Per-CPU, kept in struct cpu.
+struct boot_prof {
+	struct boot_stamp stamp[BOOT_STAMPS_MAX];
+	int n;
+	int done;          // bring-up finished, see boot_done()
+};
+
+struct cpu;
+
+void
+boot_stamp_cpu(struct cpu *c, const char *phase, uint64 time);
+
+void
+boot_stamp(const char *phase);
+
+void
+boot_done(void);
+
+void
+boot_report(void);
+
+#endif /* __BOOTPROF_H__ */
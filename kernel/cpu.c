@@ -1,22 +1,136 @@
 #include "sbi/sbi.h"
 #include "riscv.h"
 #include "param.h"
+#include "cpu.h"
+#include "fdt.h"
+#include "klibc.h"
+#include "kstack.h"
+#include "time.h"
+
+struct cpu cpus[NCPU];
+int ncpu = 1;
+
+// Must run before anything else on a hart. entry.S has already
+// pointed tp at this hart's struct cpu (cpus[0] for the boot hart,
+// the sbi_hart_start() opaque for the others); record the hart id
+// and keep a copy of the pointer in sscratch.
+void
+cpu_init(int hart_id)
+{
+	struct cpu *c = mycpu();
+
+	c->hartid = hart_id;
+	c->id = c - cpus;
+	w_sscratch((uint64)c);
+	c->timer_deadline = TIMER_NONE;
+	c->online_time = rdtime();
+	__atomic_store_n(&c->online, 1, __ATOMIC_RELEASE);
+}
+
+static void
+cpu_add(int hart_id)
+{
+	struct cpu *c;
+
+	if (cpu_by_hartid(hart_id))
+		return; // boot hart, or listed twice
+	if (ncpu == NCPU) {
+		sbi_printf("cpu: ignoring hart %d, NCPU is %d\n", hart_id, NCPU);
+		return;
+	}
+
+	c = &cpus[ncpu];
+	c->hartid = hart_id;
+	c->id = ncpu++;
+	kstack_alloc(c);
+}
+
+// Assign logical CPU ids to the harts listed under /cpus in the
+// devicetree. Without a devicetree, ask the SBI which of the first
+// NCPU hart ids exist. Allocates each CPU's kernel stack; must run
+// before kinit().
+void
+cpu_enumerate(void)
+{
+	const void *reg;
+	const char *type;
+	int cpus_node, node, ac, len;
+	unsigned long h;
+	struct sbiret ret;
+
+	kstack_alloc(&cpus[0]);
+
+	cpus_node = fdt_path_offset("/cpus");
+	if (cpus_node < 0) {
+		for (h = 0; h < NCPU; h++) {
+			ret = sbi_hart_get_status(h);
+			if (!ret.error)
+				cpu_add(h);
+		}
+		return;
+	}
+
+	ac = fdt_address_cells(cpus_node);
+	for (node = fdt_first_subnode(cpus_node); node >= 0;
+	     node = fdt_next_subnode(node)) {
+		type = fdt_getprop(node, "device_type", NULL);
+		if (!type || strcmp(type, "cpu") != 0)
+			continue; // e.g. cpu-map
+		if (!fdt_node_is_okay(node))
+			continue;
+		reg = fdt_getprop(node, "reg", &len);
+		if (!reg || len < ac * 4)
+			continue;
+		cpu_add(fdt_read_cells(reg, ac));
+	}
+}
+
+struct cpu *
+cpu_by_hartid(int hart_id)
+{
+	int i;
+
+	for (i = 0; i < ncpu; i++)
+		if (cpus[i].hartid == hart_id)
+			return &cpus[i];
+	return NULL;
+}
+
+// Wait up to timeout_ns for the started CPUs to come online;
+// returns how many are.
+int
+smp_wait_online(uint64 timeout_ns)
+{
+	uint64 deadline = rdtime() + ns_to_ticks(timeout_ns);
+	int i, n;
+
+	do {
+		for (i = n = 0; i < ncpu; i++)
+			n += __atomic_load_n(&cpus[i].online, __ATOMIC_ACQUIRE);
+	} while (n < ncpu && rdtime() < deadline);
+
+	return n;
+}
 
 int hartid()
 {
-	return r_tp();
+	return mycpu()->hartid;
 }
 
 int cpuid()
 {
-	return r_tp();
+	return mycpu()->id;
 }
 
-void
-delay(int n)
+uint64
+cpu_stat_sum(enum cpu_stat_item item)
 {
-	int c = 1000000000 * n;
-	do { asm(""); } while (c--);
+	uint64 sum = 0;
+	int i;
+
+	for (i = 0; i < ncpu; i++)
+		sum += __atomic_load_n(&cpus[i].stat[item], __ATOMIC_RELAXED);
+	return sum;
 }
 
 void
@@ -39,31 +153,33 @@ cpu_identify(int hart_id)
 	sbi_printf(cpu_id_fmt, hart_id, mvendorid, marchid, mimpid);
 }
 
-static void
-dummy_kernelvec(void)
+// Does the boot hart's cpu node list ISA extension ext, either in
+// the newer riscv,isa-extensions string list or as a "_ext" suffix
+// of the riscv,isa string? The same set is assumed on every hart.
+int
+cpu_has_isa_ext(const char *ext)
 {
-	int _cpuid = cpuid();
-	sbi_printf("cpu%d: interrupts are enabled\n", _cpuid);
-	sbi_printf("cpu%d: hanging in interrupt handler\n", _cpuid);
-	sbi_hart_hang();
-}
+	const char *p, *end;
+	int node, len, n = strlen(ext);
 
-void
-intrsinit(void)
-{
-	// 4.1.2 supervisor trap vector
-	w_stvec((uint64)dummy_kernelvec);
+	node = fdt_first_subnode(fdt_path_offset("/cpus"));
+	if (node < 0)
+		return 0;
 
-	// 4.1.1 enable all interrupts in S-mode.
-	w_sstatus(r_sstatus() | SSTATUS_SIE);
+	p = fdt_getprop(node, "riscv,isa-extensions", &len);
+	if (p) {
+		for (end = p + len; p < end; p += strlen(p) + 1)
+			if (strcmp(p, ext) == 0)
+				return 1;
+		return 0;
+	}
 
-	// 4.1.3 enabled S-mode interrupts, i.e. (external, timer, software)
-	w_sie(r_sie() | SIE_SEIE | SIE_STIE | SIE_SSIE);
-}
-
-void
-timerinit()
-{
-	// XXX: address magic number 1000000 (also check sbi_set_timer return)
-	sbi_set_timer(rdtime() + 1000000);
+	p = fdt_getprop(node, "riscv,isa", &len);
+	if (!p)
+		return 0;
+	for (; *p; p++)
+		if (*p == '_' && strncmp(p + 1, ext, n) == 0 &&
+		    (p[n + 1] == '_' || p[n + 1] == '\0'))
+			return 1;
+	return 0;
 }
@@ -1,6 +1,117 @@
 #ifndef __CPU_H__
 #define __CPU_H__
 
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "cpuidle.h"
+#include "pmu.h"
+#include "prof.h"
+#include "trace.h"
+#include "bootprof.h"
+#include "klog.h"
+#include "thread.h"
+#include "async.h"
+#include "rcu.h"
+#include "workq.h"
+#include "syscall.h"
+
+#define CACHE_LINE_SIZE 64
+
+// Per-CPU event counters. Each hart only ever updates its own
+// slots, so incrementing one never touches a shared cache line.
+enum cpu_stat_item {
+	CPU_STAT_ECALL,        // SBI calls issued
+	CPU_STAT_LOCK_ACQUIRE, // spinlocks acquired
+	CPU_STAT_LOCK_SPIN,    // failed lock attempts while spinning
+	CPU_STAT_INTR,         // interrupts taken
+	CPU_STAT_IPI,          // IPIs received
+	NR_CPU_STATS
+};
+
+struct kstack;
+struct ktimer;
+
+// Per-CPU state, one cache-line aligned slot per hart so that
+// harts never false-share. tp always points at the running
+// hart's slot (and sscratch holds a copy for trap entry).
+//
+// CPUs are numbered densely: the boot hart is CPU 0 and the other
+// harts listed in the devicetree follow, whatever their (possibly
+// sparse) hart ids are.
+struct cpu {
+	uint64 kstack_top;          // must stay first: entry.S loads sp from it
+	uint64 utrap;               // running thread's user trapframe, and
+	uint64 uscratch;            // a spare register, both for uservec.S
+	struct kstack *kstack;      // guard page + stack, see kstack.h
+	int hartid;                 // hart id as reported by the firmware
+	int id;                     // logical CPU id, index of this slot in cpus[]
+	int online;                 // set once the hart runs kernel C code
+	uint64 online_time;         // rdtime() when it came online
+	int noff;                   // depth of push_off() nesting
+	int intena;                 // were interrupts enabled before push_off()?
+	uint64 timer_deadline;      // programmed timer event, see timer_set()
+	uint64 tick_period;         // periodic tick, in timebase ticks, or 0
+	uint64 tick_next;           // next periodic tick deadline
+	struct ktimer *timers;      // armed ktimers, soonest first
+	uint64 stat[NR_CPU_STATS];  // per-CPU event counters
+	struct suspend_context suspend_ctx; // non-retentive idle, see cpuidle.c
+	struct cpuidle_stats idle[CPUIDLE_STATES_MAX];
+	struct pmu_cpu pmu;         // counters bound on this hart
+	struct prof_cpu prof;       // sampling profiler buffer
+	struct trace_buf trace;     // trace point ring buffer
+	struct boot_prof boot;      // boot phase timestamps
+	struct klog_ring klog;      // deferred log messages
+	struct thread *thread;      // running thread
+	struct thread *idle_thread; // runs when nothing else can
+	struct thread *zombie;      // exited, to be freed off its stack
+	struct thread *fpu_owner;   // whose state the FPU registers hold
+	struct runq runq;           // runnable threads, see thread.c
+	struct executor exec;       // woken async tasks, see async.c
+	struct rcu_cpu rcu;         // quiescent states, see rcu.c
+	struct workq workq;         // deferred work, see workq.c
+	struct syscall_stat sysstat[NSYSCALL]; // see syscall.c
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+extern struct cpu cpus[NCPU];
+extern int ncpu;                // number of CPUs found, <= NCPU
+
+// One instruction: the per-CPU pointer lives in tp.
+static inline struct cpu *
+mycpu(void)
+{
+	return (struct cpu *)r_tp();
+}
+
+static inline void
+cpu_stat_add(enum cpu_stat_item item, uint64 n)
+{
+	// amoadd on our own line: safe against a trap handler on the
+	// same hart, and no cross-hart cache traffic.
+	__atomic_fetch_add(&mycpu()->stat[item], n, __ATOMIC_RELAXED);
+}
+
+static inline void
+cpu_stat_inc(enum cpu_stat_item item)
+{
+	cpu_stat_add(item, 1);
+}
+
+uint64
+cpu_stat_sum(enum cpu_stat_item item);
+
+void
+cpu_init(int hart_id);
+
+void
+cpu_enumerate(void);
+
+struct cpu *
+cpu_by_hartid(int hart_id);
+
+int
+smp_wait_online(uint64 timeout_ns);
+
 int
 hartid();
 
@@ -10,16 +121,10 @@ cpuid();
 void
 start_non_boot_harts(unsigned long entry_point);
 
-void
-delay(int n);
-
 void
 cpu_identify(int hart_id);
 
-void
-intrsinit(void);
-
-void
-timerinit(void);
+int
+cpu_has_isa_ext(const char *ext);
 
 #endif /* __CPU_H__ */
@@ -0,0 +1,280 @@
+// CPU idle states: pick between wfi and SBI HSM hart suspend
+// depending on how long the hart is expected to stay idle.
+//
+// The prediction is simply the time left until the hart's next
+// programmed timer event (struct cpu timer_deadline): the deepest
+// enabled state whose target residency fits in that window, and
+// whose exit latency is acceptable, wins.
+
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "cpu.h"
+#include "fdt.h"
+#include "klibc.h"
+#include "time.h"
+#include "cpuidle.h"
+#include "trace.h"
+#include "klog.h"
+#include "thread.h"
+#include "async.h"
+#include "rcu.h"
+#include "workq.h"
+
+static struct cpuidle_state states[CPUIDLE_STATES_MAX] = {
+	{ "wfi", 0, 0, 0, 0 },
+};
+static int nstates = 1; // wfi only, until cpuidle_init()
+
+// Upper bound on acceptable wakeup latency.
+static uint64 latency_limit_ns = ~0UL;
+
+TRACE_EVENT(idle_enter, TRACE_IDLE, 'B', "state", "predicted_ns", NULL);
+TRACE_EVENT(idle_exit, TRACE_IDLE, 'E', "state", "residency_ns", NULL);
+
+static void
+cpuidle_add_state(const char *name, uint32 type,
+		  uint64 exit_latency_ns, uint64 target_residency_ns)
+{
+	struct cpuidle_state *s;
+
+	if (nstates == CPUIDLE_STATES_MAX)
+		return;
+	s = &states[nstates++];
+	s->name = name;
+	s->suspend_type = type;
+	s->exit_latency_ns = exit_latency_ns;
+	s->target_residency_ns = target_residency_ns;
+}
+
+// Linux binding: Documentation/devicetree/bindings/cpu/idle-states.yaml
+static int
+cpuidle_dt_states(void)
+{
+	int node, n = 0;
+	uint32 param, entry_us, exit_us, residency_us;
+
+	node = fdt_path_offset("/cpus/idle-states");
+	for (node = fdt_first_subnode(node); node >= 0;
+	     node = fdt_next_subnode(node)) {
+		if (!fdt_node_is_compatible(node, "riscv,idle-state") ||
+		    !fdt_node_is_okay(node))
+			continue;
+		if (fdt_getprop_u32(node, "riscv,sbi-suspend-param", &param) < 0)
+			continue;
+		entry_us = exit_us = residency_us = 0;
+		fdt_getprop_u32(node, "entry-latency-us", &entry_us);
+		fdt_getprop_u32(node, "exit-latency-us", &exit_us);
+		fdt_getprop_u32(node, "min-residency-us", &residency_us);
+		cpuidle_add_state(fdt_get_name(node), param,
+				  (entry_us + exit_us) * NSEC_PER_USEC,
+				  residency_us * NSEC_PER_USEC);
+		n++;
+	}
+	return n;
+}
+
+void
+cpuidle_init(void)
+{
+	struct sbiret ret;
+	int i;
+
+	ret = sbi_probe_extension(SBI_EXT_HSM);
+	if (!ret.value)
+		return;
+
+	// Without platform data, fall back to the SBI default types
+	// with conservative guesses; cpuidle_report() shows the
+	// measured latencies to tune them against.
+	if (cpuidle_dt_states() == 0) {
+		cpuidle_add_state("retentive", SBI_HSM_SUSPEND_RET_DEFAULT,
+				  10 * NSEC_PER_USEC, 100 * NSEC_PER_USEC);
+		cpuidle_add_state("non-retentive",
+				  SBI_HSM_SUSPEND_NON_RET_DEFAULT,
+				  100 * NSEC_PER_USEC, NSEC_PER_MSEC);
+	}
+
+	for (i = 0; i < nstates; i++)
+		sbi_printf("cpuidle: state %d: %s, exit latency %lu us, "
+			   "target residency %lu us\n", i, states[i].name,
+			   states[i].exit_latency_ns / NSEC_PER_USEC,
+			   states[i].target_residency_ns / NSEC_PER_USEC);
+}
+
+static int
+cpuidle_select(uint64 predicted_ns)
+{
+	int i, best = 0;
+
+	for (i = 1; i < nstates; i++) {
+		if (states[i].disabled)
+			continue;
+		if (states[i].target_residency_ns > predicted_ns)
+			break;
+		if (states[i].exit_latency_ns > latency_limit_ns)
+			break;
+		best = i;
+	}
+	return best;
+}
+
+// Before a non-retentive suspend: put the running thread's FPU
+// registers in its struct thread if they are live, like a switch
+// away from it would. No thread owns the registers afterwards.
+static void
+fpu_suspend(struct cpu *c)
+{
+	struct thread *t = c->thread;
+	uint64 s = r_sstatus();
+
+	if ((s & SSTATUS_FS) == SSTATUS_FS_DIRTY) {
+		fpu_save(&t->fp);
+		t->fp_saved = 1;
+		w_sstatus((s & ~SSTATUS_FS) | SSTATUS_FS_CLEAN);
+	}
+	c->fpu_owner = NULL;
+}
+
+// Back from a non-retentive suspend: the running thread goes on
+// without a switch, so load its registers now.
+static void
+fpu_resume(struct cpu *c)
+{
+	struct thread *t = c->thread;
+
+	if (t->fp_saved) {
+		fpu_restore(&t->fp);
+		c->fpu_owner = t;
+		w_sstatus((r_sstatus() & ~SSTATUS_FS) | SSTATUS_FS_CLEAN);
+	}
+}
+
+// Returns 0 once the hart is back, -1 if the SBI refused the state.
+static int
+cpuidle_suspend(struct cpuidle_state *s)
+{
+	struct cpu *c = mycpu();
+	struct suspend_context *ctx = &c->suspend_ctx;
+	struct sbiret ret;
+
+	if (!(s->suspend_type & SBI_HSM_SUSP_NON_RET_BIT)) {
+		ret = sbi_hart_suspend(s->suspend_type, 0, 0);
+	} else {
+		// The FPU registers do not survive either: save the
+		// running thread's if it wrote them, and forget whose
+		// the registers hold.
+		fpu_suspend(c);
+		// The hart comes back at cpu_resume with only a0/a1
+		// set; CSRs the kernel relies on must be put back.
+		ctx->sstatus = r_sstatus();
+		ctx->sie = r_sie();
+		ctx->stvec = r_stvec();
+		ctx->sscratch = r_sscratch();
+		ctx->satp = r_satp();
+		if (cpu_suspend_save(ctx)) {
+			w_satp(ctx->satp);
+			sfence_vma();
+			w_stvec(ctx->stvec);
+			w_sscratch(ctx->sscratch);
+			w_sie(ctx->sie);
+			w_sstatus(ctx->sstatus);
+			fpu_resume(c);
+			return 0;
+		}
+		ret = sbi_hart_suspend(s->suspend_type,
+				       (unsigned long)cpu_resume,
+				       (unsigned long)ctx);
+	}
+
+	if (!ret.error)
+		return 0;
+	if ((long)ret.error == SBI_ERR_NOT_SUPPORTED ||
+	    (long)ret.error == SBI_ERR_INVALID_PARAM)
+		s->disabled = 1;
+	return -1;
+}
+
+// Idle until the next interrupt (enabled in sie) is pending.
+// Called with sstatus.SIE clear, or the wakeup interrupt is taken
+// as soon as the hart resumes.
+void
+cpuidle_enter(void)
+{
+	struct cpu *c = mycpu();
+	struct cpuidle_stats *st;
+	uint64 t0, t1, deadline, predicted;
+	int i;
+
+	t0 = rdtime();
+	deadline = c->timer_deadline;
+	if (deadline == TIMER_NONE)
+		predicted = ~0UL;
+	else if (deadline > t0)
+		predicted = ticks_to_ns(deadline - t0);
+	else
+		predicted = 0;
+
+	i = cpuidle_select(predicted);
+	trace(idle_enter, i, predicted, 0);
+	if (i == 0 || cpuidle_suspend(&states[i]) < 0) {
+		i = 0;
+		asm volatile("wfi");
+	}
+	t1 = rdtime();
+	trace(idle_exit, i, ticks_to_ns(t1 - t0), 0);
+
+	st = &c->idle[i];
+	st->usage++;
+	st->residency_ns += ticks_to_ns(t1 - t0);
+	if (deadline != TIMER_NONE && t1 >= deadline) {
+		st->timer_wakeups++;
+		st->exit_latency_ns += ticks_to_ns(t1 - deadline);
+	}
+}
+
+// Idle loop for harts with nothing to do. Idles with interrupts
+// off, then briefly turns them on to take whatever woke the hart
+// (an IPI, a timer tick) in kerneltrap(). The logging hart then
+// drains the klog rings, deferred work and woken async tasks run,
+// and runnable threads run until none is left; thread_unpark(),
+// task_wake() and work_queue() IPI an idle CPU, so checking the
+// queues with interrupts off loses no wakeup. RCU grace periods do
+// not wait for a sleeping CPU.
+void __attribute__((noreturn))
+cpu_idle(void)
+{
+	for (;;) {
+		intr_off();
+		if (!thread_runnable() && !task_runnable() &&
+		    !work_pending()) {
+			rcu_idle_enter();
+			cpuidle_enter();
+			rcu_idle_exit();
+		}
+		intr_on();
+		klog_idle();
+		work_run();
+		executor_run();
+		yield();
+	}
+}
+
+void
+cpuidle_report(void)
+{
+	struct cpuidle_stats *st;
+	int cpu, i;
+
+	for (cpu = 0; cpu < ncpu; cpu++) {
+		for (i = 0; i < nstates; i++) {
+			st = &cpus[cpu].idle[i];
+			if (!st->usage)
+				continue;
+			sbi_printf("cpu%d: idle %s: %lu entries, %lu us resident, "
+				   "%lu ns avg exit latency\n", cpu, states[i].name,
+				   st->usage, st->residency_ns / NSEC_PER_USEC,
+				   st->timer_wakeups ?
+				   st->exit_latency_ns / st->timer_wakeups : 0);
+		}
+	}
+}
@@ -0,0 +1,61 @@
+#ifndef __CPUIDLE_H__
+#define __CPUIDLE_H__
+
+#include "types.h"
+
+// Idle states, shallowest first. State 0 is always a plain wfi; the
+// others are SBI HSM hart suspend types, from /cpus/idle-states in
+// the devicetree or the SBI default retentive and non-retentive
+// types when the devicetree has none.
+#define CPUIDLE_STATES_MAX 4
+
+struct cpuidle_state {
+	const char *name;
+	uint32 suspend_type;     // SBI HSM suspend type (unused for wfi)
+	uint64 exit_latency_ns;  // worst-case wakeup cost
+	uint64 target_residency_ns; // shortest idle period worth entering for
+	int disabled;            // SBI refused it
+};
+
+// Per-CPU, per-state statistics, kept in struct cpu.
+struct cpuidle_stats {
+	uint64 usage;            // times entered
+	uint64 residency_ns;     // total time spent in the state
+	uint64 exit_latency_ns;  // total lateness after timer wakeups
+	uint64 timer_wakeups;    // wakeups by the programmed timer
+};
+
+// Registers the non-retentive suspend path must restore; all
+// other state is lost across such a suspend.
+struct suspend_context {
+	uint64 ra;
+	uint64 sp;
+	uint64 gp;
+	uint64 tp;
+	uint64 s[12];
+	uint64 sstatus;
+	uint64 sie;
+	uint64 stvec;
+	uint64 sscratch;
+	uint64 satp;
+};
+
+int __attribute__((returns_twice))
+cpu_suspend_save(struct suspend_context *ctx);
+
+void
+cpu_resume(void);
+
+void
+cpuidle_init(void);
+
+void
+cpuidle_enter(void);
+
+void __attribute__((noreturn))
+cpu_idle(void);
+
+void
+cpuidle_report(void);
+
+#endif /* __CPUIDLE_H__ */
@@ -0,0 +1,47 @@
+#ifndef __CPUMASK_H__
+#define __CPUMASK_H__
+
+#include "types.h"
+#include "param.h"
+
+// Bitmap of logical CPU ids (indices into cpus[]), not hart ids.
+
+#define BITS_PER_LONG 64
+#define CPUMASK_LONGS ((NCPU + BITS_PER_LONG - 1) / BITS_PER_LONG)
+
+typedef struct cpumask {
+	unsigned long bits[CPUMASK_LONGS];
+} cpumask_t;
+
+static inline void
+cpumask_clear(cpumask_t *m)
+{
+	int i;
+
+	for (i = 0; i < CPUMASK_LONGS; i++)
+		m->bits[i] = 0;
+}
+
+static inline void
+cpumask_set_cpu(int cpu, cpumask_t *m)
+{
+	m->bits[cpu / BITS_PER_LONG] |= 1UL << (cpu % BITS_PER_LONG);
+}
+
+static inline void
+cpumask_clear_cpu(int cpu, cpumask_t *m)
+{
+	m->bits[cpu / BITS_PER_LONG] &= ~(1UL << (cpu % BITS_PER_LONG));
+}
+
+static inline int
+cpumask_test_cpu(int cpu, const cpumask_t *m)
+{
+	return (m->bits[cpu / BITS_PER_LONG] >> (cpu % BITS_PER_LONG)) & 1;
+}
+
+#define for_each_cpu(cpu, mask)                   \
+	for ((cpu) = 0; (cpu) < NCPU; (cpu)++)    \
+		if (cpumask_test_cpu((cpu), (mask)))
+
+#endif /* __CPUMASK_H__ */
@@ -0,0 +1,189 @@
+// ELF loader. exec records each PT_LOAD segment as a mapping of the
+// file and maps nothing; vm_fault() brings pages in as the program
+// touches them, so starting a program costs the same whatever its
+// size. The eager mode copies every page up front instead, like
+// xv6's exec(), to compare against.
+
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "memlayout.h"
+#include "klibc.h"
+#include "time.h"
+#include "bench.h"
+#include "elf.h"
+#include "file.h"
+#include "vm.h"
+#include "proc.h"
+
+static int
+load_segments(struct proc *p, struct file *f, struct elfhdr *elf,
+	      int flags)
+{
+	struct proghdr ph;
+	uint64 off, start, end;
+	int i, prot;
+
+	for (i = 0, off = elf->phoff; i < elf->phnum;
+	     i++, off += sizeof(ph)) {
+		if (file_read(f, &ph, off, sizeof(ph)) < 0)
+			return -1;
+		if (ph.type != ELF_PROG_LOAD)
+			continue;
+		if (ph.memsz < ph.filesz || ph.vaddr + ph.memsz < ph.vaddr ||
+		    ph.vaddr < USER_BASE ||
+		    ph.vaddr + ph.memsz > USTACK_TOP - USTACK_SIZE ||
+		    (ph.vaddr - ph.off) % PGSIZE != 0 ||
+		    ph.off + ph.filesz > f->size)
+			return -1;
+		prot = 0;
+		if (ph.flags & ELF_PROG_FLAG_READ)
+			prot |= PTE_R;
+		if (ph.flags & ELF_PROG_FLAG_WRITE)
+			prot |= PTE_W | PTE_R;
+		if (ph.flags & ELF_PROG_FLAG_EXEC)
+			prot |= PTE_X;
+		start = PGROUNDDOWN(ph.vaddr);
+		end = PGROUNDUP(ph.vaddr + ph.memsz);
+		if (vma_add(p, start, end, prot, flags, f,
+			    ph.off - (ph.vaddr - start),
+			    ph.vaddr + ph.filesz) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+// Push argv onto the user stack, xv6 style: the strings, then the
+// NULL-terminated array of pointers to them, where sp ends up.
+static int
+push_args(struct proc *p, char **argv)
+{
+	uint64 sp = USTACK_TOP, ustack[MAXARG + 1];
+	int argc;
+
+	for (argc = 0; argv[argc]; argc++) {
+		if (argc >= MAXARG)
+			return -1;
+		sp -= strlen(argv[argc]) + 1;
+		sp -= sp % 16; // riscv sp must be 16-byte aligned
+		if (copyout(p, sp, argv[argc], strlen(argv[argc]) + 1) < 0)
+			return -1;
+		ustack[argc] = sp;
+	}
+	ustack[argc] = 0;
+	sp -= (argc + 1) * sizeof(uint64);
+	sp -= sp % 16;
+	if (copyout(p, sp, ustack, (argc + 1) * sizeof(uint64)) < 0)
+		return -1;
+	p->argc = argc;
+	p->sp = sp;
+	return 0;
+}
+
+// A new process with the program path loaded, ready for proc_run().
+// eager: read and copy in every page now.
+struct proc *
+proc_exec(const char *path, char **argv, int eager)
+{
+	struct file *f = romfs_lookup(path);
+	struct elfhdr elf;
+	struct proc *p;
+	uint64 va, heap = USER_BASE;
+	int i;
+
+	if (!f || file_read(f, &elf, 0, sizeof(elf)) < 0)
+		return NULL;
+	if (elf.magic != ELF_MAGIC || elf.elf[0] != ELF_CLASS_64 ||
+	    elf.type != ELF_ET_EXEC || elf.machine != ELF_EM_RISCV)
+		return NULL;
+	p = proc_alloc();
+	if (!p)
+		return NULL;
+	if (load_segments(p, f, &elf, eager ? VMA_COPY : 0) < 0)
+		goto bad;
+	if (eager) {
+		for (i = 0; i < p->nvma; i++)
+			for (va = p->vma[i].start; va < p->vma[i].end;
+			     va += PGSIZE)
+				if (vm_fault(p, va, 0) < 0)
+					goto bad;
+	}
+	// the heap starts out empty, after the program.
+	for (i = 0; i < p->nvma; i++)
+		if (p->vma[i].end > heap)
+			heap = p->vma[i].end;
+	p->brk = heap;
+	p->mmap_base = USTACK_TOP - USTACK_SIZE;
+	if (vma_add(p, heap, heap, PTE_R | PTE_W, VMA_HEAP, NULL, 0, 0) < 0 ||
+	    vma_add(p, USTACK_TOP - USTACK_SIZE, USTACK_TOP, PTE_R | PTE_W,
+		    0, NULL, 0, 0) < 0 || push_args(p, argv) < 0)
+		goto bad;
+	p->entry = elf.entry;
+	return p;
+
+bad:
+	proc_free(p);
+	return NULL;
+}
+
+// Start user/big.c, a program with 1 MiB of read-only data it
+// barely touches, lazily and eagerly.
+static char *big_argv[] = { "big", NULL };
+
+void
+exec_report(void)
+{
+	struct proc *p;
+	uint64 t0, t1, t2, rss;
+	long status;
+	int eager;
+
+	for (eager = 0; eager < 2; eager++) {
+		t0 = rdtime();
+		p = proc_exec("big", big_argv, eager);
+		t1 = rdtime();
+		if (!p) {
+			sbi_printf("exec: cannot exec big\n");
+			return;
+		}
+		status = proc_run(p);
+		t2 = rdtime();
+		rss = p->rss;
+		proc_free(p);
+		sbi_printf("exec: big %s: exec %lu us, run %lu us, "
+			   "rss %lu KiB, status %ld\n", eager ? "eager" : "lazy",
+			   ticks_to_ns(t1 - t0) / 1000,
+			   ticks_to_ns(t2 - t1) / 1000, rss * PGSIZE / 1024,
+			   status);
+	}
+	sbi_printf("exec: page cache holds %lu KiB\n",
+		   pcache_pages() * PGSIZE / 1024);
+}
+
+// exec, run to exit and free user/big.c.
+static int
+exec_bench(int eager, uint64 iters)
+{
+	struct proc *p;
+	long status;
+
+	while (iters--) {
+		p = proc_exec("big", big_argv, eager);
+		if (!p)
+			return -1;
+		status = proc_run(p);
+		proc_free(p);
+		if (status != 0)
+			return -1;
+	}
+	return 0;
+}
+
+BENCH(exec_lazy, 1)
+{
+	return exec_bench(0, iters);
+}
+
+BENCH(exec_eager, 1)
+{
+	return exec_bench(1, iters);
+}
@@ -0,0 +1,10 @@
+#ifndef __FCNTL_H__
+#define __FCNTL_H__
+
+// open() flags, as in xv6. Shared with user programs. The built-in
+// files are read-only, so only O_RDONLY opens anything yet.
+#define O_RDONLY 0x000
+#define O_WRONLY 0x001
+#define O_RDWR   0x002
+
+#endif /* __FCNTL_H__ */
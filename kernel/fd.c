@@ -0,0 +1,201 @@
+// File descriptors: open(), read() and close() on the built-in
+// files, and pipes (kernel/pipe.c). read() copies straight out of
+// the page cache into user memory; mmap() of the same file maps
+// those cached pages instead (kernel/mmap.c). A forked child gets a
+// copy of the table, with offsets of its own. fds 0 to 2 are the
+// console's, see sys_write().
+
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "param.h"
+#include "fcntl.h"
+#include "file.h"
+#include "pipe.h"
+#include "vm.h"
+#include "proc.h"
+
+#define FD_FIRST 3 // lowest fd open() and pipe() hand out
+
+// The lowest free fd of p from from on, or -1.
+static int
+fd_alloc(struct proc *p, int from)
+{
+	int fd;
+
+	for (fd = from; fd < NOFILE; fd++)
+		if (!p->ofile[fd].file && !p->ofile[fd].pipe)
+			return fd;
+	return -1;
+}
+
+// The pipe end open as fd in the calling process, if it is the
+// write end when write is set and the read end otherwise, or NULL.
+static struct pipe *
+proc_pipe_end(int fd, int write)
+{
+	struct ofile *of;
+
+	if (fd < 0 || fd >= NOFILE)
+		return NULL;
+	of = &myproc()->ofile[fd];
+	return of->pipe && of->write == write ? of->pipe : NULL;
+}
+
+// The file open as fd in the calling process, or NULL.
+struct file *
+proc_file(int fd)
+{
+	if (fd < 0 || fd >= NOFILE)
+		return NULL;
+	return myproc()->ofile[fd].file;
+}
+
+// open(path, flags): the lowest free fd, or -1.
+int
+proc_open(uint64 path, int flags)
+{
+	struct proc *p = myproc();
+	char name[MAXPATH];
+	struct file *f;
+	int fd;
+
+	if (flags != O_RDONLY || copyinstr(p, name, path, sizeof(name)) < 0)
+		return -1;
+	f = romfs_lookup(name);
+	if (!f || (fd = fd_alloc(p, FD_FIRST)) < 0)
+		return -1;
+	p->ofile[fd].file = f;
+	p->ofile[fd].off = 0;
+	return fd;
+}
+
+// pipe(fds): fds[0] the read end, fds[1] the write end.
+int
+proc_pipe(uint64 fds)
+{
+	struct proc *p = myproc();
+	struct pipe *pi;
+	int fd[2];
+
+	if ((fd[0] = fd_alloc(p, FD_FIRST)) < 0 ||
+	    (fd[1] = fd_alloc(p, fd[0] + 1)) < 0 || !(pi = pipe_alloc()))
+		return -1;
+	if (copyout(p, fds, fd, sizeof(fd)) < 0) {
+		pipe_close(pi, 0);
+		pipe_close(pi, 1);
+		return -1;
+	}
+	p->ofile[fd[0]].pipe = pi;
+	p->ofile[fd[0]].write = 0;
+	p->ofile[fd[1]].pipe = pi;
+	p->ofile[fd[1]].write = 1;
+	return 0;
+}
+
+// read(fd, buf, n): bytes read, 0 at the end of the file.
+long
+proc_read(int fd, uint64 buf, uint64 n)
+{
+	struct proc *p = myproc();
+	struct file *f = proc_file(fd);
+	struct ofile *of;
+	uint64 done, m, off;
+	struct pipe *pi;
+	char *page;
+
+	if ((pi = proc_pipe_end(fd, 0)))
+		return pipe_read(pi, buf, n);
+	if (!f)
+		return -1;
+	of = &p->ofile[fd];
+	if (of->off >= f->size)
+		return 0;
+	if (n > f->size - of->off)
+		n = f->size - of->off;
+	for (done = 0; done < n; done += m) {
+		off = of->off + done;
+		page = pcache_get(f, off / PGSIZE);
+		m = PGSIZE - off % PGSIZE;
+		if (m > n - done)
+			m = n - done;
+		if (!page || copyout(p, buf + done, page + off % PGSIZE,
+				     m) < 0)
+			break;
+	}
+	of->off += done;
+	return done ? done : -1;
+}
+
+// write(fd, buf, n) to an fd that is not the console's: only pipe
+// write ends can be written.
+long
+proc_write(int fd, uint64 buf, uint64 n)
+{
+	struct pipe *pi = proc_pipe_end(fd, 1);
+
+	return pi ? pipe_write(pi, buf, n) : -1;
+}
+
+// splice(fd_in, fd_out, n): move up to n bytes from a file or pipe
+// into the pipe fd_out without copying them. Returns how many, 0 at
+// the end of fd_in.
+long
+proc_splice(int fd_in, int fd_out, uint64 n)
+{
+	struct pipe *in = proc_pipe_end(fd_in, 0);
+	struct pipe *out = proc_pipe_end(fd_out, 1);
+	struct file *f = proc_file(fd_in);
+
+	if (!out)
+		return -1;
+	if (in)
+		return pipe_splice(in, out, n);
+	if (f)
+		return pipe_splice_file(f, &myproc()->ofile[fd_in].off, out,
+					n);
+	return -1;
+}
+
+int
+proc_close(int fd)
+{
+	struct ofile *of;
+
+	if (fd < 0 || fd >= NOFILE)
+		return -1;
+	of = &myproc()->ofile[fd];
+	if (of->pipe)
+		pipe_close(of->pipe, of->write);
+	else if (!of->file)
+		return -1;
+	of->file = NULL;
+	of->pipe = NULL;
+	return 0;
+}
+
+// Give fork() child np a copy of p's table.
+void
+proc_dup_files(struct proc *np, struct proc *p)
+{
+	int fd;
+
+	for (fd = 0; fd < NOFILE; fd++) {
+		np->ofile[fd] = p->ofile[fd];
+		if (p->ofile[fd].pipe)
+			pipe_dup(p->ofile[fd].pipe, p->ofile[fd].write);
+	}
+}
+
+// Close all of p's fds, as it exits.
+void
+proc_close_files(struct proc *p)
+{
+	int fd;
+
+	for (fd = 0; fd < NOFILE; fd++) {
+		if (p->ofile[fd].pipe)
+			pipe_close(p->ofile[fd].pipe, p->ofile[fd].write);
+		p->ofile[fd].file = NULL;
+		p->ofile[fd].pipe = NULL;
+	}
+}
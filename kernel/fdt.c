@@ -0,0 +1,363 @@
+#include "fdt.h"
+#include "klibc.h"
+
+// Devicetree Specification v0.4, chapter 5 (Flattened Devicetree
+// (DTB) Format).
+
+#define FDT_BEGIN_NODE 0x1
+#define FDT_END_NODE   0x2
+#define FDT_PROP       0x3
+#define FDT_NOP        0x4
+#define FDT_END        0x9
+
+struct fdt_header {
+	uint32 magic;
+	uint32 totalsize;
+	uint32 off_dt_struct;
+	uint32 off_dt_strings;
+	uint32 off_mem_rsvmap;
+	uint32 version;
+	uint32 last_comp_version;
+	uint32 boot_cpuid_phys;
+	uint32 size_dt_strings;
+	uint32 size_dt_struct;
+};
+
+static const char *fdt;       // blob handed over by the boot loader
+static const char *dt_struct;
+static const char *dt_strings;
+static uint32 dt_struct_size;
+
+#define FDT_ALIGN(x) (((x) + 3) & ~3)
+
+int
+fdt_init(uint64 blob)
+{
+	const struct fdt_header *h = (const struct fdt_header *)blob;
+
+	fdt = NULL;
+	if (!blob || (blob & 3) || fdt32_ld(&h->magic) != FDT_MAGIC)
+		return -1;
+
+	fdt = (const char *)blob;
+	dt_struct = fdt + fdt32_ld(&h->off_dt_struct);
+	dt_strings = fdt + fdt32_ld(&h->off_dt_strings);
+	dt_struct_size = fdt32_ld(&h->size_dt_struct);
+	return 0;
+}
+
+int
+fdt_valid(void)
+{
+	return fdt != NULL;
+}
+
+uint64
+fdt_base(void)
+{
+	return (uint64)fdt;
+}
+
+uint32
+fdt_totalsize(void)
+{
+	if (!fdt)
+		return 0;
+	return fdt32_ld(&((const struct fdt_header *)fdt)->totalsize);
+}
+
+static uint32
+tag_at(int off)
+{
+	if (off < 0 || (uint32)off + 4 > dt_struct_size)
+		return FDT_END;
+	return fdt32_ld(dt_struct + off);
+}
+
+// Offset of the token following the one at off.
+static int
+next_tag(int off)
+{
+	uint32 len;
+
+	switch (tag_at(off)) {
+	case FDT_BEGIN_NODE:
+		off += 4;
+		off += FDT_ALIGN(strlen(dt_struct + off) + 1);
+		return off;
+	case FDT_PROP:
+		len = fdt32_ld(dt_struct + off + 4);
+		return off + 12 + FDT_ALIGN(len);
+	case FDT_END_NODE:
+	case FDT_NOP:
+		return off + 4;
+	default:
+		return -1;
+	}
+}
+
+// Offset just past the FDT_END_NODE of the node at off.
+static int
+skip_node(int off)
+{
+	int depth = 0;
+
+	do {
+		switch (tag_at(off)) {
+		case FDT_BEGIN_NODE:
+			depth++;
+			break;
+		case FDT_END_NODE:
+			depth--;
+			break;
+		case FDT_END:
+			return -1;
+		}
+		off = next_tag(off);
+	} while (off >= 0 && depth > 0);
+
+	return off;
+}
+
+int
+fdt_first_subnode(int node)
+{
+	int off;
+
+	if (!fdt || tag_at(node) != FDT_BEGIN_NODE)
+		return -1;
+
+	for (off = next_tag(node); off >= 0; off = next_tag(off)) {
+		switch (tag_at(off)) {
+		case FDT_BEGIN_NODE:
+			return off;
+		case FDT_PROP:
+		case FDT_NOP:
+			continue;
+		default:
+			return -1;
+		}
+	}
+	return -1;
+}
+
+int
+fdt_next_subnode(int node)
+{
+	int off;
+
+	if (!fdt || tag_at(node) != FDT_BEGIN_NODE)
+		return -1;
+
+	for (off = skip_node(node); off >= 0; off = next_tag(off)) {
+		switch (tag_at(off)) {
+		case FDT_BEGIN_NODE:
+			return off;
+		case FDT_NOP:
+			continue;
+		default:
+			return -1;
+		}
+	}
+	return -1;
+}
+
+const char *
+fdt_get_name(int node)
+{
+	if (!fdt || tag_at(node) != FDT_BEGIN_NODE)
+		return NULL;
+	return dt_struct + node + 4;
+}
+
+// Compare a node name against a path component; "cpus" matches
+// "cpus" and a bare "memory" matches "memory@80000000".
+static int
+name_matches(const char *name, const char *comp, int complen)
+{
+	int i;
+
+	if (strncmp(name, comp, complen) != 0)
+		return 0;
+	if (name[complen] == '\0')
+		return 1;
+	if (name[complen] != '@')
+		return 0;
+	for (i = 0; i < complen; i++)
+		if (comp[i] == '@')
+			return 0; // unit address given, must match exactly
+	return 1;
+}
+
+int
+fdt_path_offset(const char *path)
+{
+	int node = 0, len;
+	const char *end;
+
+	if (!fdt || *path != '/')
+		return -1;
+
+	while (node >= 0) {
+		while (*path == '/')
+			path++;
+		if (*path == '\0')
+			return node;
+
+		for (end = path; *end && *end != '/'; end++)
+			;
+		len = end - path;
+
+		for (node = fdt_first_subnode(node); node >= 0;
+		     node = fdt_next_subnode(node))
+			if (name_matches(fdt_get_name(node), path, len))
+				break;
+		path = end;
+	}
+	return -1;
+}
+
+const void *
+fdt_getprop(int node, const char *name, int *lenp)
+{
+	int off;
+	uint32 len;
+
+	if (!fdt || tag_at(node) != FDT_BEGIN_NODE)
+		return NULL;
+
+	for (off = next_tag(node); off >= 0; off = next_tag(off)) {
+		switch (tag_at(off)) {
+		case FDT_PROP:
+			len = fdt32_ld(dt_struct + off + 4);
+			if (strcmp(dt_strings + fdt32_ld(dt_struct + off + 8),
+				   name) == 0) {
+				if (lenp)
+					*lenp = len;
+				return dt_struct + off + 12;
+			}
+			continue;
+		case FDT_NOP:
+			continue;
+		default:
+			return NULL; // properties precede subnodes
+		}
+	}
+	return NULL;
+}
+
+int
+fdt_getprop_u32(int node, const char *name, uint32 *val)
+{
+	const void *p;
+	int len;
+
+	p = fdt_getprop(node, name, &len);
+	if (!p || len < 4)
+		return -1;
+	*val = fdt32_ld(p);
+	return 0;
+}
+
+int
+fdt_address_cells(int node)
+{
+	uint32 v;
+
+	if (fdt_getprop_u32(node, "#address-cells", &v) < 0)
+		return 2;
+	return v;
+}
+
+int
+fdt_size_cells(int node)
+{
+	uint32 v;
+
+	if (fdt_getprop_u32(node, "#size-cells", &v) < 0)
+		return 1;
+	return v;
+}
+
+// A node is usable unless its status says otherwise.
+int
+fdt_node_is_okay(int node)
+{
+	const char *status;
+
+	status = fdt_getprop(node, "status", NULL);
+	if (!status)
+		return 1;
+	return strcmp(status, "okay") == 0 || strcmp(status, "ok") == 0;
+}
+
+// Is compat one of the strings in the node's compatible list?
+int
+fdt_node_is_compatible(int node, const char *compat)
+{
+	const char *p, *end;
+	int len;
+
+	p = fdt_getprop(node, "compatible", &len);
+	if (!p)
+		return 0;
+	for (end = p + len; p < end; p += strlen(p) + 1)
+		if (strcmp(p, compat) == 0)
+			return 1;
+	return 0;
+}
+
+// Is opt one of the space separated words of /chosen/bootargs (the
+// kernel command line the boot loader passed)?
+int
+fdt_bootargs_has(const char *opt)
+{
+	const char *p;
+	int len, n = strlen(opt);
+
+	p = fdt_getprop(fdt_path_offset("/chosen"), "bootargs", &len);
+	if (!p)
+		return 0;
+	while (*p) {
+		while (*p == ' ')
+			p++;
+		if (strncmp(p, opt, n) == 0 && (p[n] == ' ' || p[n] == '\0'))
+			return 1;
+		while (*p && *p != ' ')
+			p++;
+	}
+	return 0;
+}
+
+// The next child of parent after prev (the first one if prev < 0)
+// that is compatible with compat and not disabled.
+int
+fdt_next_compatible(int parent, int prev, const char *compat)
+{
+	int node;
+
+	node = prev < 0 ? fdt_first_subnode(parent) : fdt_next_subnode(prev);
+	for (; node >= 0; node = fdt_next_subnode(node))
+		if (fdt_node_is_compatible(node, compat) &&
+		    fdt_node_is_okay(node))
+			return node;
+	return -1;
+}
+
+// First address and size of a child of parent, from its reg.
+int
+fdt_reg(int parent, int node, uint64 *base, uint64 *size)
+{
+	const char *reg;
+	int ac, sc, len;
+
+	ac = fdt_address_cells(parent);
+	sc = fdt_size_cells(parent);
+	reg = fdt_getprop(node, "reg", &len);
+	if (!reg || len < (ac + sc) * 4)
+		return -1;
+	*base = fdt_read_cells(reg, ac);
+	if (size)
+		*size = fdt_read_cells(reg + ac * 4, sc);
+	return 0;
+}
@@ -0,0 +1,87 @@
+#ifndef __FDT_H__
+#define __FDT_H__
+
+#include "types.h"
+
+// Minimal read-only flattened device tree (DTB) walker, enough to
+// find nodes by path, iterate children and read properties.
+// Node handles are byte offsets into the structure block; negative
+// values mean "not found".
+
+#define FDT_MAGIC 0xd00dfeed
+
+int
+fdt_init(uint64 blob);
+
+int
+fdt_valid(void);
+
+uint64
+fdt_base(void);
+
+uint32
+fdt_totalsize(void);
+
+int
+fdt_path_offset(const char *path);
+
+int
+fdt_first_subnode(int node);
+
+int
+fdt_next_subnode(int node);
+
+const char *
+fdt_get_name(int node);
+
+const void *
+fdt_getprop(int node, const char *name, int *lenp);
+
+int
+fdt_getprop_u32(int node, const char *name, uint32 *val);
+
+int
+fdt_address_cells(int node);
+
+int
+fdt_size_cells(int node);
+
+int
+fdt_node_is_okay(int node);
+
+int
+fdt_node_is_compatible(int node, const char *compat);
+
+int
+fdt_bootargs_has(const char *opt);
+
+int
+fdt_next_compatible(int parent, int prev, const char *compat);
+
+int
+fdt_reg(int parent, int node, uint64 *base, uint64 *size);
+
+static inline uint32
+fdt32_ld(const void *p)
+{
+	const unsigned char *b = p;
+
+	return ((uint32)b[0] << 24) | ((uint32)b[1] << 16) |
+	       ((uint32)b[2] << 8) | b[3];
+}
+
+// Read a value spanning cells big-endian 32-bit cells (1 or 2).
+static inline uint64
+fdt_read_cells(const void *p, int cells)
+{
+	const unsigned char *b = p;
+	uint64 v = 0;
+
+	while (cells-- > 0) {
+		v = (v << 32) | fdt32_ld(b);
+		b += 4;
+	}
+	return v;
+}
+
+#endif /* __FDT_H__ */
@@ -0,0 +1,42 @@
+#ifndef __FILE_H__
+#define __FILE_H__
+
+#include "types.h"
+#include "spinlock.h"
+
+// A file whose contents are read through the page cache. Each page
+// is filled from the backing store once, on first use, and then
+// shared by everyone: read() copies out of it, and mappings of the
+// file map the cached page itself until they write to it, see
+// vm_fault().
+struct file {
+	const char *name;
+	uint64 size;
+	// Backing store: read n bytes at off into dst, 0 or -1.
+	int (*fill)(struct file *f, void *dst, uint64 off, uint64 n);
+	void *priv;            // for fill
+	spinlock_t lock;       // protects pages
+	void ***pages;         // two-level index of cached pages
+};
+
+// Pages one file can cache: one index page of index pages.
+#define PCACHE_PER_PAGE  (PGSIZE / sizeof(void *))
+#define PCACHE_MAX_PAGES (PCACHE_PER_PAGE * PCACHE_PER_PAGE)
+
+void *
+pcache_get(struct file *f, uint64 pgoff);
+
+uint64
+pcache_pages(void);
+
+int
+file_read(struct file *f, void *dst, uint64 off, uint64 n);
+
+// Built-in read-only files (the user programs), see romfs.c.
+void
+romfs_init(void);
+
+struct file *
+romfs_lookup(const char *name);
+
+#endif /* __FILE_H__ */
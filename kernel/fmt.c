@@ -0,0 +1,143 @@
+#include "sbi/sbi.h"
+#include "klibc.h"
+#include "bench.h"
+#include "fmt.h"
+
+static const char digit_pairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+static const char hex_digits[] = "0123456789abcdef";
+
+// Write v in decimal backwards from end; returns the start.
+static char *
+put_udec(char *end, uint64 v)
+{
+	char *p = end;
+	uint64 q;
+	uint32 r;
+
+	while (v >= 100) {
+		q = v / 100;
+		r = (v - q * 100) * 2;
+		p -= 2;
+		p[0] = digit_pairs[r];
+		p[1] = digit_pairs[r + 1];
+		v = q;
+	}
+	if (v >= 10) {
+		p -= 2;
+		p[0] = digit_pairs[v * 2];
+		p[1] = digit_pairs[v * 2 + 1];
+	} else {
+		*--p = '0' + v;
+	}
+	return p;
+}
+
+static char *
+put_hex(char *end, uint64 v)
+{
+	char *p = end;
+
+	do {
+		*--p = hex_digits[v & 0xf];
+		v >>= 4;
+	} while (v);
+	return p;
+}
+
+u32
+fmt_render(char *buf, u32 size, const struct fmt_seg *seg, int nseg,
+	   const uint64 *arg)
+{
+	char tmp[24], *end = tmp + sizeof(tmp), *p;
+	const char *s;
+	u32 n = 0, len;
+	int i;
+
+	if (size == 0)
+		return 0;
+
+	for (i = 0; i < nseg; i++) {
+		switch (seg[i].kind) {
+		case FMT_KIND_LIT:
+			s = seg[i].lit;
+			len = seg[i].len;
+			break;
+		case FMT_KIND_DEC:
+			p = put_udec(end, (long)arg[i] < 0 ? -arg[i] : arg[i]);
+			if ((long)arg[i] < 0)
+				*--p = '-';
+			s = p;
+			len = end - s;
+			break;
+		case FMT_KIND_UDEC:
+			s = put_udec(end, arg[i]);
+			len = end - s;
+			break;
+		case FMT_KIND_HEX:
+			s = put_hex(end, arg[i]);
+			len = end - s;
+			break;
+		case FMT_KIND_STR:
+			s = arg[i] ? (const char *)arg[i] : "(null)";
+			len = strlen(s);
+			break;
+		case FMT_KIND_CHAR:
+		default:
+			tmp[0] = arg[i];
+			s = tmp;
+			len = 1;
+			break;
+		}
+		if (len > size - 1 - n)
+			len = size - 1 - n;
+		memcpy(buf + n, s, len);
+		n += len;
+	}
+	buf[n] = '\0';
+	return n;
+}
+
+void
+fmt_puts(const char *s, u32 len)
+{
+	u32 n = 0;
+
+	while (n < len)
+		n += sbi_nputs(s + n, len - n);
+}
+
+// The same line both ways; the console is left out, it would
+// dominate either.
+static char bench_line[FMT_LINE_MAX];
+
+BENCH(snprintf_sbi, 64)
+{
+	while (iters--)
+		sbi_snprintf(bench_line, sizeof(bench_line),
+			     "cpu%d: idle %s: %lu entries, %lu us, pc %lx\n",
+			     3, "retentive", iters, 123456789UL, 0x80201234UL);
+	return 0;
+}
+
+BENCH(snprintf_fmt, 64)
+{
+	while (iters--)
+		fmt_snprintf(bench_line, sizeof(bench_line),
+			     FMT_L("cpu"), FMT_D(3), FMT_L(": idle "),
+			     FMT_S("retentive"), FMT_L(": "), FMT_U(iters),
+			     FMT_L(" entries, "), FMT_U(123456789UL),
+			     FMT_L(" us, pc "), FMT_X(0x80201234UL),
+			     FMT_L("\n"));
+	return 0;
+}
@@ -0,0 +1,133 @@
+#ifndef __FMT_H__
+#define __FMT_H__
+
+#include "types.h"
+
+// Formatting with the format split up at compile time, for output
+// on hot paths. Instead of a format string, a call lists literal
+// segments and typed arguments:
+//
+//	fmt_snprintf(buf, sizeof(buf), FMT_L("cpu"), FMT_D(cpuid()),
+//		     FMT_L(": idle "), FMT_S(name), FMT_L("\n"));
+//
+// The segments become a static const table (literal pointers and
+// lengths, argument kinds) and the arguments an array of uint64, so
+// fmt_render() never parses anything: literals are copied whole and
+// integers converted two digits at a time. Argument types are
+// checked when compiling: FMT_D takes signed integers, FMT_U and
+// FMT_X unsigned ones, FMT_S strings, FMT_L string literals only.
+// Up to FMT_MAX_ITEMS items per call.
+
+enum fmt_kind {
+	FMT_KIND_LIT,
+	FMT_KIND_DEC,
+	FMT_KIND_UDEC,
+	FMT_KIND_HEX,
+	FMT_KIND_STR,
+	FMT_KIND_CHAR,
+};
+
+struct fmt_seg {
+	uint32 kind;
+	uint32 len;       // of lit
+	const char *lit;  // FMT_KIND_LIT only
+};
+
+#define FMT_L(s) (LIT, s)
+#define FMT_D(x) (DEC, x)
+#define FMT_U(x) (UDEC, x)
+#define FMT_X(x) (HEX, x)
+#define FMT_S(x) (STR, x)
+#define FMT_C(x) (CHAR, x)
+
+// Picking any other association is a compile error: a struct does
+// not convert to uint64.
+struct fmt_bad_argument_type { int unused; };
+extern const struct fmt_bad_argument_type fmt_bad_arg;
+
+#define FMT_SIGNED(x) _Generic((x),                                \
+	signed char: (x), short: (x), int: (x), long: (x),          \
+	long long: (x), default: fmt_bad_arg)
+#define FMT_UNSIGNED(x) _Generic((x),                              \
+	unsigned char: (x), unsigned short: (x), unsigned int: (x), \
+	unsigned long: (x), unsigned long long: (x),                \
+	default: fmt_bad_arg)
+#define FMT_STRING(x) _Generic((x),                                \
+	char *: (x), const char *: (x), default: fmt_bad_arg)
+#define FMT_CHARACTER(x) _Generic((x),                             \
+	char: (x), int: (x), default: fmt_bad_arg)
+
+#define FMT_SEG_LIT(s)  { FMT_KIND_LIT, sizeof("" s) - 1, s }
+#define FMT_SEG_DEC(x)  { FMT_KIND_DEC, 0, 0 }
+#define FMT_SEG_UDEC(x) { FMT_KIND_UDEC, 0, 0 }
+#define FMT_SEG_HEX(x)  { FMT_KIND_HEX, 0, 0 }
+#define FMT_SEG_STR(x)  { FMT_KIND_STR, 0, 0 }
+#define FMT_SEG_CHAR(x) { FMT_KIND_CHAR, 0, 0 }
+
+#define FMT_VAL_LIT(s)  0
+#define FMT_VAL_DEC(x)  (uint64)FMT_SIGNED(x)
+#define FMT_VAL_UDEC(x) (uint64)FMT_UNSIGNED(x)
+#define FMT_VAL_HEX(x)  (uint64)FMT_UNSIGNED(x)
+#define FMT_VAL_STR(x)  (uint64)FMT_STRING(x)
+#define FMT_VAL_CHAR(x) (uint64)FMT_CHARACTER(x)
+
+#define FMT_SEG(item) FMT_SEG_ item
+#define FMT_SEG_(kind, x) FMT_SEG_##kind(x)
+#define FMT_VAL(item) FMT_VAL_ item
+#define FMT_VAL_(kind, x) FMT_VAL_##kind(x)
+
+// FMT_MAP(m, a, b, c) is m(a), m(b), m(c).
+#define FMT_MAX_ITEMS 16
+#define FMT_NARG(...) FMT_NARG_(__VA_ARGS__, 16, 15, 14, 13, 12, 11, 10, \
+				9, 8, 7, 6, 5, 4, 3, 2, 1)
+#define FMT_NARG_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, \
+		  _13, _14, _15, _16, n, ...) n
+#define FMT_CAT(a, b) FMT_CAT_(a, b)
+#define FMT_CAT_(a, b) a##b
+#define FMT_MAP(m, ...) FMT_CAT(FMT_MAP_, FMT_NARG(__VA_ARGS__))(m, __VA_ARGS__)
+#define FMT_MAP_1(m, x) m(x)
+#define FMT_MAP_2(m, x, ...) m(x), FMT_MAP_1(m, __VA_ARGS__)
+#define FMT_MAP_3(m, x, ...) m(x), FMT_MAP_2(m, __VA_ARGS__)
+#define FMT_MAP_4(m, x, ...) m(x), FMT_MAP_3(m, __VA_ARGS__)
+#define FMT_MAP_5(m, x, ...) m(x), FMT_MAP_4(m, __VA_ARGS__)
+#define FMT_MAP_6(m, x, ...) m(x), FMT_MAP_5(m, __VA_ARGS__)
+#define FMT_MAP_7(m, x, ...) m(x), FMT_MAP_6(m, __VA_ARGS__)
+#define FMT_MAP_8(m, x, ...) m(x), FMT_MAP_7(m, __VA_ARGS__)
+#define FMT_MAP_9(m, x, ...) m(x), FMT_MAP_8(m, __VA_ARGS__)
+#define FMT_MAP_10(m, x, ...) m(x), FMT_MAP_9(m, __VA_ARGS__)
+#define FMT_MAP_11(m, x, ...) m(x), FMT_MAP_10(m, __VA_ARGS__)
+#define FMT_MAP_12(m, x, ...) m(x), FMT_MAP_11(m, __VA_ARGS__)
+#define FMT_MAP_13(m, x, ...) m(x), FMT_MAP_12(m, __VA_ARGS__)
+#define FMT_MAP_14(m, x, ...) m(x), FMT_MAP_13(m, __VA_ARGS__)
+#define FMT_MAP_15(m, x, ...) m(x), FMT_MAP_14(m, __VA_ARGS__)
+#define FMT_MAP_16(m, x, ...) m(x), FMT_MAP_15(m, __VA_ARGS__)
+
+// Render into buf, always NUL terminated; returns the length.
+#define fmt_snprintf(buf, size, ...)                                   \
+	({                                                             \
+		static const struct fmt_seg _fmt_segs[] = {            \
+			FMT_MAP(FMT_SEG, __VA_ARGS__)                  \
+		};                                                     \
+		fmt_render(buf, size, _fmt_segs,                       \
+			   sizeof(_fmt_segs) / sizeof(_fmt_segs[0]),   \
+			   (const uint64[]){ FMT_MAP(FMT_VAL, __VA_ARGS__) }); \
+	})
+
+// Render a line of at most FMT_LINE_MAX bytes and write it to the
+// console in one piece.
+#define FMT_LINE_MAX 256
+#define fmt_printf(...)                                                \
+	({                                                             \
+		char _fmt_line[FMT_LINE_MAX];                          \
+		fmt_puts(_fmt_line, fmt_snprintf(_fmt_line,            \
+				sizeof(_fmt_line), __VA_ARGS__));      \
+	})
+
+u32
+fmt_render(char *buf, u32 size, const struct fmt_seg *seg, int nseg,
+	   const uint64 *arg);
+
+void
+fmt_puts(const char *s, u32 len);
+
+#endif /* __FMT_H__ */
@@ -0,0 +1,244 @@
+// Futexes, so that user locks only enter the kernel when contended.
+// Waiters queue in a hash table of buckets, each with its own lock,
+// keyed by the physical address of the futex word: processes that
+// share the page (MAP_SHARED) find each other whatever their virtual
+// addresses. A waiter lives on its thread's kernel stack.
+//
+// FUTEX_WAIT timeouts are ktimers on the waiter's CPU, which only
+// unpark it; the waiter sees for itself whether it was woken or
+// timed out.
+
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "cpu.h"
+#include "spinlock.h"
+#include "thread.h"
+#include "time.h"
+#include "vm.h"
+#include "proc.h"
+#include "futex.h"
+
+#define FUTEX_HASH 64 // buckets, a power of two
+
+struct futex_bucket;
+
+struct futex_waiter {
+	struct ktimer timer;         // must stay first, see futex_timeout()
+	uint64 key;                  // physical address of the word
+	struct futex_bucket *bucket; // its queue, which FUTEX_REQUEUE moves
+	struct thread *thread;
+	int woken;
+	struct futex_waiter *next;
+};
+
+struct futex_bucket {
+	spinlock_t lock;
+	struct futex_waiter *head;   // oldest first
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+static struct futex_bucket buckets[FUTEX_HASH];
+
+static struct futex_bucket *
+bucket_of(uint64 key)
+{
+	return &buckets[((key >> 2) * 0x9e3779b97f4a7c15UL) >> 58];
+}
+
+// The futex word at uaddr as its physical address, or 0. The page is
+// made private first if it is copy on write, so that the key is
+// where the word stays rather than a page about to be copied.
+static uint64
+futex_key(uint64 uaddr)
+{
+	if (uaddr % sizeof(uint32) != 0)
+		return 0;
+	return uvm_pa(myproc(), uaddr, PTE_W);
+}
+
+static void
+enqueue(struct futex_bucket *b, struct futex_waiter *w)
+{
+	struct futex_waiter **pp;
+
+	for (pp = &b->head; *pp; pp = &(*pp)->next)
+		;
+	w->next = NULL;
+	__atomic_store_n(&w->bucket, b, __ATOMIC_RELEASE);
+	*pp = w;
+}
+
+static void
+dequeue(struct futex_bucket *b, struct futex_waiter *w)
+{
+	struct futex_waiter **pp;
+
+	for (pp = &b->head; *pp; pp = &(*pp)->next) {
+		if (*pp == w) {
+			*pp = w->next;
+			return;
+		}
+	}
+}
+
+// Lock the bucket w is queued on, which may change under us until
+// it is locked.
+static struct futex_bucket *
+lock_waiter(struct futex_waiter *w)
+{
+	struct futex_bucket *b;
+
+	for (;;) {
+		b = __atomic_load_n(&w->bucket, __ATOMIC_ACQUIRE);
+		spin_lock(&b->lock);
+		if (b == w->bucket)
+			return b;
+		spin_unlock(&b->lock);
+	}
+}
+
+static void
+futex_timeout(struct ktimer *t)
+{
+	thread_unpark(((struct futex_waiter *)t)->thread);
+}
+
+static long
+futex_wait(uint64 uaddr, uint32 val, uint64 timeout_ns)
+{
+	struct futex_waiter w;
+	struct futex_bucket *b;
+	uint64 deadline = 0;
+	long ret;
+
+	w.key = futex_key(uaddr);
+	if (!w.key)
+		return -1;
+	b = bucket_of(w.key);
+	spin_lock(&b->lock);
+	if (__atomic_load_n((uint32 *)w.key, __ATOMIC_ACQUIRE) != val) {
+		spin_unlock(&b->lock);
+		return FUTEX_EAGAIN;
+	}
+	w.thread = mythread();
+	w.woken = 0;
+	enqueue(b, &w);
+	spin_unlock(&b->lock);
+
+	if (timeout_ns) {
+		deadline = rdtime() + ns_to_ticks(timeout_ns);
+		ktimer_add(&w.timer, deadline, futex_timeout);
+	}
+	for (;;) {
+		thread_park();
+		b = lock_waiter(&w);
+		if (w.woken) {
+			ret = 0;
+			break;
+		}
+		if (timeout_ns && rdtime() >= deadline) {
+			dequeue(b, &w);
+			ret = FUTEX_ETIMEDOUT;
+			break;
+		}
+		spin_unlock(&b->lock); // a stale unpark
+	}
+	spin_unlock(&b->lock);
+	if (timeout_ns)
+		ktimer_cancel(&w.timer);
+	return ret;
+}
+
+// Wake up to n waiters on key, oldest first. Called with b locked.
+static long
+wake_locked(struct futex_bucket *b, uint64 key, uint64 n)
+{
+	struct futex_waiter **pp = &b->head, *w;
+	struct thread *t;
+	long woken = 0;
+
+	while ((w = *pp) && woken < n) {
+		if (w->key != key) {
+			pp = &w->next;
+			continue;
+		}
+		*pp = w->next;
+		t = w->thread;
+		// w may be gone once the waiter sees this, but not
+		// before we drop the bucket lock.
+		w->woken = 1;
+		thread_unpark(t);
+		woken++;
+	}
+	return woken;
+}
+
+static long
+futex_wake(uint64 uaddr, uint64 n)
+{
+	uint64 key = futex_key(uaddr);
+	struct futex_bucket *b;
+	long woken;
+
+	if (!key)
+		return -1;
+	b = bucket_of(key);
+	spin_lock(&b->lock);
+	woken = wake_locked(b, key, n);
+	spin_unlock(&b->lock);
+	return woken;
+}
+
+// Wake up to nwake waiters on uaddr and move up to nmove of the rest
+// to uaddr2, say from a condition variable to its mutex, so that they
+// do not all wake to fight over it. Returns how many were woken or
+// moved.
+static long
+futex_requeue(uint64 uaddr, uint64 nwake, uint64 nmove, uint64 uaddr2)
+{
+	uint64 key = futex_key(uaddr), key2 = futex_key(uaddr2);
+	struct futex_bucket *b, *b2;
+	struct futex_waiter **pp, *w;
+	long n, moved = 0;
+
+	if (!key || !key2)
+		return -1;
+	b = bucket_of(key);
+	b2 = bucket_of(key2);
+	// Lock in address order against a requeue the other way.
+	spin_lock(b < b2 ? &b->lock : &b2->lock);
+	if (b != b2)
+		spin_lock(b < b2 ? &b2->lock : &b->lock);
+	n = wake_locked(b, key, nwake);
+	if (key != key2) {
+		pp = &b->head;
+		while ((w = *pp) && moved < nmove) {
+			if (w->key != key) {
+				pp = &w->next;
+				continue;
+			}
+			*pp = w->next;
+			w->key = key2;
+			enqueue(b2, w);
+			moved++;
+		}
+	}
+	if (b != b2)
+		spin_unlock(&b2->lock);
+	spin_unlock(&b->lock);
+	return n + moved;
+}
+
+// futex(uaddr, op, val, val2, uaddr2), see futex.h.
+long
+futex_op(uint64 uaddr, int op, uint32 val, uint64 val2, uint64 uaddr2)
+{
+	switch (op) {
+	case FUTEX_WAIT:
+		return futex_wait(uaddr, val, val2);
+	case FUTEX_WAKE:
+		return futex_wake(uaddr, val);
+	case FUTEX_REQUEUE:
+		return futex_requeue(uaddr, val, val2, uaddr2);
+	}
+	return -1;
+}
@@ -0,0 +1,21 @@
+#ifndef __FUTEX_H__
+#define __FUTEX_H__
+
+// futex(uaddr, op, val, val2, uaddr2) operations, with Linux's
+// numbers. Shared with user programs.
+#define FUTEX_WAIT    0 // sleep while *uaddr == val, at most val2 ns (0: no limit)
+#define FUTEX_WAKE    1 // wake up to val waiters
+#define FUTEX_REQUEUE 3 // wake up to val, move up to val2 more to uaddr2
+
+// Results other than 0 or a count; -1 is a bad argument.
+#define FUTEX_EAGAIN    (-11)  // FUTEX_WAIT: *uaddr != val
+#define FUTEX_ETIMEDOUT (-110) // FUTEX_WAIT: val2 ns went by
+
+#ifndef __ASSEMBLER__
+#include "types.h"
+
+long
+futex_op(uint64 uaddr, int op, uint32 val, uint64 val2, uint64 uaddr2);
+#endif
+
+#endif /* __FUTEX_H__ */
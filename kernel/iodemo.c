@@ -0,0 +1,281 @@
+// Async driver demo: a UART echo task and a disk read task run on
+// the executor of the I/O CPU (CPU 1), which otherwise idles. Both
+// spend nearly all their time awaiting interrupts; the report shows
+// how little of the I/O CPU that costs, where spinning on the device
+// would keep it 100% busy.
+//
+// iodemo_storm() then floods the I/O CPU with disk interrupts, every
+// completion submitting the next read, once with requests finished
+// in the interrupt handler and once in its bottom half, and compares
+// the time spent with interrupts off.
+
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "cpu.h"
+#include "kalloc.h"
+#include "spinlock.h"
+#include "thread.h"
+#include "time.h"
+#include "uart.h"
+#include "virtio_blk.h"
+#include "workq.h"
+#include "iodemo.h"
+
+#define IODEMO_SECTORS 64
+#define STORM_READS    4096
+#define STORM_DEPTH    16   // reads in flight
+#define STORM_SECTORS  2048 // read round and round the first 1 MiB
+
+struct disk_task {
+	struct task task;
+	struct blk_req req;
+	uint8 *buf;
+	uint64 sector;
+	uint64 t0, idle0;
+	uint64 ns, idle_ns;
+	uint16 signature;    // of sector 0, 0xaa55 for an MBR
+	int errors;
+};
+
+struct echo_task {
+	struct task task;
+	uint64 chars;
+};
+
+static struct {
+	spinlock_t lock;
+	struct blk_req reqs[STORM_DEPTH];
+	uint8 *buf;          // all reads go here
+	uint64 issued;
+	uint64 done;
+	int errors;
+	struct thread *waiter;
+	int finished;
+} storm = { .lock = SPIN_LOCK_INITIALIZER };
+
+static struct disk_task disk_task;
+static struct echo_task echo_task;
+static int io_cpu = -1;
+static uint64 start_time, start_idle;
+
+// Time CPU cpu has spent idle, as of its last wakeup.
+static uint64
+idle_ns(int cpu)
+{
+	uint64 ns = 0;
+	int i;
+
+	for (i = 0; i < CPUIDLE_STATES_MAX; i++)
+		ns += __atomic_load_n(&cpus[cpu].idle[i].residency_ns,
+				      __ATOMIC_RELAXED);
+	return ns;
+}
+
+static void
+disk_fn(struct task *t)
+{
+	struct disk_task *d = (struct disk_task *)t;
+
+	task_begin(t);
+	d->t0 = rdtime();
+	d->idle0 = idle_ns(t->cpu);
+	for (d->sector = 0; d->sector < IODEMO_SECTORS; d->sector++) {
+		d->req.sector = d->sector;
+		d->req.buf = d->buf;
+		d->req.len = BLK_SECTOR_SIZE;
+		d->req.write = 0;
+		if (virtio_blk_submit(&d->req) < 0) {
+			d->errors++;
+			break;
+		}
+		task_await(t, &d->req.done);
+		if (d->req.status != 0)
+			d->errors++;
+		if (d->sector == 0)
+			d->signature = d->buf[510] | d->buf[511] << 8;
+	}
+	d->ns = ticks_to_ns(rdtime() - d->t0);
+	d->idle_ns = idle_ns(t->cpu) - d->idle0;
+	task_end(t);
+}
+
+static void
+echo_fn(struct task *t)
+{
+	struct echo_task *e = (struct echo_task *)t;
+	int c;
+
+	task_begin(t);
+	for (;;) {
+		while ((c = uart_rx_pop()) >= 0) {
+			e->chars++;
+			uart_putc_sync(c);
+		}
+		task_await(t, &uart_rx_ready);
+	}
+	task_end(t);
+}
+
+// One more read is over, failed if err.
+static void
+storm_done(int err)
+{
+	int last;
+
+	spin_lock(&storm.lock);
+	storm.done++;
+	storm.errors += err;
+	last = storm.done == STORM_READS;
+	spin_unlock(&storm.lock);
+	if (last) {
+		__atomic_store_n(&storm.finished, 1, __ATOMIC_RELEASE);
+		thread_unpark(storm.waiter);
+	}
+}
+
+// Submit r for the next read, while any are left.
+static void
+storm_issue(struct blk_req *r)
+{
+	for (;;) {
+		spin_lock(&storm.lock);
+		if (storm.issued == STORM_READS) {
+			spin_unlock(&storm.lock);
+			return;
+		}
+		r->sector = storm.issued++ % STORM_SECTORS;
+		spin_unlock(&storm.lock);
+		r->buf = storm.buf;
+		r->len = BLK_SECTOR_SIZE;
+		r->write = 0;
+		if (virtio_blk_submit(r) == 0)
+			return;
+		storm_done(1);
+	}
+}
+
+// A read finished, in the interrupt handler or its bottom half:
+// reuse its request for the next one.
+static void
+storm_end_io(struct blk_req *r)
+{
+	storm_done(r->status != 0);
+	storm_issue(r);
+}
+
+static void
+storm_run(int defer)
+{
+	struct cpu *c = &cpus[io_cpu];
+	uint64 t0, ns, intr, irq;
+	int i;
+
+	virtio_blk_defer(defer);
+	storm.issued = storm.done = 0;
+	storm.errors = 0;
+	storm.finished = 0;
+	storm.waiter = mythread();
+	intr = __atomic_load_n(&c->stat[CPU_STAT_INTR], __ATOMIC_RELAXED);
+	irq = __atomic_load_n(&c->workq.irq_ticks, __ATOMIC_RELAXED);
+	__atomic_store_n(&c->workq.irq_max, 0, __ATOMIC_RELAXED);
+	t0 = rdtime();
+	for (i = 0; i < STORM_DEPTH; i++) {
+		storm.reqs[i].end_io = storm_end_io;
+		storm_issue(&storm.reqs[i]);
+	}
+	while (!__atomic_load_n(&storm.finished, __ATOMIC_ACQUIRE))
+		thread_park();
+	ns = ticks_to_ns(rdtime() - t0);
+	intr = __atomic_load_n(&c->stat[CPU_STAT_INTR],
+			       __ATOMIC_RELAXED) - intr;
+	irq = __atomic_load_n(&c->workq.irq_ticks, __ATOMIC_RELAXED) - irq;
+	sbi_printf("iodemo: storm, finished in the %s: %d reads in %lu us "
+		   "(%lu/s), %d errors; cpu%d %lu interrupts, %lu us with "
+		   "interrupts off, longest %lu ns\n",
+		   defer ? "bottom half" : "handler", STORM_READS,
+		   ns / NSEC_PER_USEC, ns ? STORM_READS * NSEC_PER_SEC / ns : 0,
+		   storm.errors, io_cpu, intr,
+		   ticks_to_ns(irq) / NSEC_PER_USEC,
+		   ticks_to_ns(__atomic_load_n(&c->workq.irq_max,
+					       __ATOMIC_RELAXED)));
+}
+
+// Disk interrupt storm, from a thread: see the top of the file.
+void
+iodemo_storm(void)
+{
+	if (!disk_task.task.fn)
+		return;
+	storm.buf = kalloc();
+	if (!storm.buf)
+		return;
+	storm_run(0);
+	storm_run(1);
+	kfree(storm.buf);
+}
+
+static uint64
+permille(uint64 part, uint64 whole)
+{
+	return whole ? part * 1000 / whole : 0;
+}
+
+void
+iodemo_start(void)
+{
+	if (ncpu < 2 || !__atomic_load_n(&cpus[1].online, __ATOMIC_ACQUIRE)) {
+		sbi_printf("iodemo: needs a second cpu\n");
+		return;
+	}
+	io_cpu = 1;
+	start_time = rdtime();
+	start_idle = idle_ns(io_cpu);
+
+	if (uart_rx_async_init(io_cpu) == 0)
+		task_spawn(&echo_task.task, echo_fn, "uart echo", io_cpu);
+	else
+		sbi_printf("iodemo: no uart interrupt\n");
+
+	disk_task.buf = kalloc();
+	if (disk_task.buf && virtio_blk_init(io_cpu) == 0)
+		task_spawn(&disk_task.task, disk_fn, "disk read", io_cpu);
+	else
+		sbi_printf("iodemo: no disk\n");
+}
+
+void
+iodemo_report(void)
+{
+	struct cpu *c;
+	struct disk_task *d = &disk_task;
+	uint64 n, ns, busy;
+
+	if (io_cpu < 0)
+		return;
+
+	// Wake the I/O CPU once, so that its idle time is current.
+	c = &cpus[io_cpu];
+	n = __atomic_load_n(&c->stat[CPU_STAT_IPI], __ATOMIC_RELAXED);
+	sbi_send_ipi(1, c->hartid);
+	while (__atomic_load_n(&c->stat[CPU_STAT_IPI], __ATOMIC_RELAXED) == n)
+		;
+
+	if (d->task.fn && d->task.line == -1) {
+		busy = permille(d->ns - d->idle_ns, d->ns);
+		sbi_printf("iodemo: disk read %lu sectors in %lu us, "
+			   "%d errors, signature 0x%x, cpu%d busy %lu.%lu%% "
+			   "while waiting\n", d->sector, d->ns / 1000,
+			   d->errors, d->signature, io_cpu, busy / 10,
+			   busy % 10);
+	} else if (d->task.fn) {
+		sbi_printf("iodemo: disk read still waiting, %lu sectors "
+			   "done\n", d->sector);
+	}
+
+	ns = ticks_to_ns(rdtime() - start_time);
+	busy = permille(ns - (idle_ns(io_cpu) - start_idle), ns);
+	sbi_printf("iodemo: uart echoed %lu chars; cpu%d busy %lu.%lu%% "
+		   "over %lu ms, %lu task runs\n",
+		   echo_task.chars, io_cpu, busy / 10, busy % 10,
+		   ns / 1000000, echo_task.task.runs + disk_task.task.runs);
+}
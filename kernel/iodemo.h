@@ -0,0 +1,13 @@
+#ifndef __IODEMO_H__
+#define __IODEMO_H__
+
+void
+iodemo_start(void);
+
+void
+iodemo_storm(void);
+
+void
+iodemo_report(void);
+
+#endif /* __IODEMO_H__ */
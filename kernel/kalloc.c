@@ -0,0 +1,338 @@
+// Physical memory allocator, for kernel stacks, page-table pages
+// and other per-CPU and kernel data. Allocates whole 4096-byte pages,
+// and 2 MiB huge pages for user megapage mappings.
+//
+// Until kinit() runs, memory is handed out by bootmem_alloc(), a
+// bump allocator for contiguous boot-time structures sized from the
+// devicetree (e.g. per-CPU stacks). kinit() then puts everything
+// left on the free list.
+//
+// Pages also carry a reference count, for user pages that several
+// address spaces share after a copy-on-write fork: kalloc() sets it
+// to 1, page_get() and page_put() move it, and the last page_put()
+// frees the page.
+//
+// RAM is managed in 2 MiB chunks. Whole free chunks sit on the huge
+// list; kalloc() splits one into the page list when that runs dry.
+// A split chunk is not put back together when its pages come back,
+// only when kalloc_huge() finds the huge list empty: it then takes
+// the first chunk whose 512 pages are all free off the page list.
+
+#include "sbi/sbi.h"
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "klibc.h"
+#include "fdt.h"
+#include "kalloc.h"
+
+extern char end[]; // first address after kernel, defined by kernel.ld.
+
+#define CHUNK_PAGES (HPGSIZE / PGSIZE)
+
+struct run {
+	struct run *next;
+	struct run *prev;   // page list only, to unlink a chunk's pages
+};
+
+static struct {
+	spinlock_t lock;
+	struct run *freelist;
+	uint64 nfree;
+	struct run *hugelist;
+	uint64 nhuge;
+} kmem = { SPIN_LOCK_INITIALIZER, NULL, 0, NULL, 0 };
+
+static uint32 *refcnt;      // per page of RAM, from KERNBASE
+static uint16 *chunk_free;  // per chunk of RAM: its pages on the page list
+static uint64 mem_end;      // end of RAM
+static uint64 bootmem_next; // bump pointer, until kinit()
+static uint64 rsv_start;    // devicetree blob, must survive
+static uint64 rsv_end;
+
+// Find the end of RAM, and the range the devicetree occupies.
+void
+kmem_detect(void)
+{
+	const void *reg;
+	int node, len, ac, sc;
+	uint64 base, size;
+
+	mem_end = PHYSTOP_DEFAULT;
+	node = fdt_path_offset("/memory");
+	reg = fdt_getprop(node, "reg", &len);
+	if (reg) {
+		ac = fdt_address_cells(0);
+		sc = fdt_size_cells(0);
+		if (len >= (ac + sc) * 4) {
+			base = fdt_read_cells(reg, ac);
+			size = fdt_read_cells((const char *)reg + ac * 4, sc);
+			mem_end = base + size;
+		}
+	}
+
+	if (fdt_valid()) {
+		rsv_start = PGROUNDDOWN(fdt_base());
+		rsv_end = PGROUNDUP(fdt_base() + fdt_totalsize());
+	}
+
+	bootmem_next = PGROUNDUP((uint64)end);
+}
+
+// Skip the bump pointer past the devicetree if [p, p+size) overlaps it.
+static uint64
+skip_reserved(uint64 p, uint64 size)
+{
+	if (p < rsv_end && p + size > rsv_start)
+		return rsv_end;
+	return p;
+}
+
+// Contiguous, page-aligned, zeroed boot-time allocation. Never freed.
+void *
+bootmem_alloc(uint64 size)
+{
+	uint64 p;
+
+	if (!bootmem_next)
+		sbi_panic("bootmem_alloc: kmem_detect() not called\n");
+
+	size = PGROUNDUP(size);
+	p = skip_reserved(bootmem_next, size);
+	if (p + size > mem_end)
+		sbi_panic("bootmem_alloc: out of memory\n");
+	bootmem_next = p + size;
+
+	memset((void *)p, 0, size);
+	return (void *)p;
+}
+
+static uint64
+chunk_of(void *pa)
+{
+	return ((uint64)pa - KERNBASE) / HPGSIZE;
+}
+
+// Page list operations, with kmem.lock held.
+static void
+page_push(struct run *r)
+{
+	r->prev = NULL;
+	r->next = kmem.freelist;
+	if (r->next)
+		r->next->prev = r;
+	kmem.freelist = r;
+	kmem.nfree++;
+	chunk_free[chunk_of(r)]++;
+}
+
+static void
+page_unlink(struct run *r)
+{
+	if (r->prev)
+		r->prev->next = r->next;
+	else
+		kmem.freelist = r->next;
+	if (r->next)
+		r->next->prev = r->prev;
+	kmem.nfree--;
+	chunk_free[chunk_of(r)]--;
+}
+
+static void
+kfree_nojunk(void *pa)
+{
+	spin_lock(&kmem.lock);
+	page_push((struct run *)pa);
+	spin_unlock(&kmem.lock);
+}
+
+static void
+huge_push(void *pa)
+{
+	struct run *r = (struct run *)pa;
+
+	spin_lock(&kmem.lock);
+	r->next = kmem.hugelist;
+	kmem.hugelist = r;
+	kmem.nhuge++;
+	spin_unlock(&kmem.lock);
+}
+
+void
+kinit(void)
+{
+	uint64 p;
+
+	refcnt = bootmem_alloc((mem_end - KERNBASE) / PGSIZE *
+			       sizeof(*refcnt));
+	chunk_free = bootmem_alloc((mem_end - KERNBASE) / HPGSIZE *
+				   sizeof(*chunk_free));
+	// Skip the junk fill here: touching every page of RAM
+	// at boot is pure time-to-ready cost.
+	for (p = bootmem_next; p + PGSIZE <= mem_end;) {
+		if (p % HPGSIZE == 0 && p + HPGSIZE <= mem_end &&
+		    (p >= rsv_end || p + HPGSIZE <= rsv_start)) {
+			huge_push((void *)p);
+			p += HPGSIZE;
+			continue;
+		}
+		if (p >= rsv_end || p + PGSIZE <= rsv_start)
+			kfree_nojunk((void *)p);
+		p += PGSIZE;
+	}
+	bootmem_next = mem_end;
+}
+
+// Free the page of physical memory pointed at by pa,
+// which normally should have been returned by a
+// call to kalloc().
+void
+kfree(void *pa)
+{
+	if (((uint64)pa % PGSIZE) != 0 || (char *)pa < end ||
+	    (uint64)pa >= mem_end)
+		sbi_panic("kfree\n");
+
+	// Fill with junk to catch dangling refs.
+	memset(pa, 1, PGSIZE);
+
+	kfree_nojunk(pa);
+}
+
+// Allocate one 4096-byte page of physical memory.
+// Returns a pointer that the kernel can use.
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc(void)
+{
+	struct run *r;
+	uint64 i;
+
+	spin_lock(&kmem.lock);
+	if (!kmem.freelist && kmem.hugelist) {
+		r = kmem.hugelist;
+		kmem.hugelist = r->next;
+		kmem.nhuge--;
+		for (i = CHUNK_PAGES; i-- > 0;)
+			page_push((struct run *)((char *)r + i * PGSIZE));
+	}
+	r = kmem.freelist;
+	if (r)
+		page_unlink(r);
+	spin_unlock(&kmem.lock);
+
+	if (r) {
+		memset((char *)r, 5, PGSIZE); // fill with junk
+		refcnt[((uint64)r - KERNBASE) / PGSIZE] = 1;
+	}
+	return (void *)r;
+}
+
+// Take a chunk whose pages are all on the page list back off it.
+// Called with kmem.lock held. Returns NULL if there is none.
+static struct run *
+chunk_reclaim(void)
+{
+	uint64 c, i, nchunk = (mem_end - KERNBASE) / HPGSIZE;
+	char *p;
+
+	for (c = 0; c < nchunk; c++) {
+		if (chunk_free[c] != CHUNK_PAGES)
+			continue;
+		p = (char *)(KERNBASE + c * HPGSIZE);
+		for (i = 0; i < CHUNK_PAGES; i++)
+			page_unlink((struct run *)(p + i * PGSIZE));
+		return (struct run *)p;
+	}
+	return NULL;
+}
+
+// Allocate a 2 MiB, 2 MiB-aligned huge page, not junk filled: the
+// caller clears or copies all of it. Returns 0 if no chunk of RAM is
+// wholly free.
+void *
+kalloc_huge(void)
+{
+	struct run *r;
+
+	spin_lock(&kmem.lock);
+	r = kmem.hugelist;
+	if (r) {
+		kmem.hugelist = r->next;
+		kmem.nhuge--;
+	} else {
+		r = chunk_reclaim();
+	}
+	spin_unlock(&kmem.lock);
+
+	if (r)
+		refcnt[((uint64)r - KERNBASE) / PGSIZE] = 1;
+	return (void *)r;
+}
+
+void
+kfree_huge(void *pa)
+{
+	if (((uint64)pa % HPGSIZE) != 0 || (char *)pa < end ||
+	    (uint64)pa + HPGSIZE > mem_end)
+		sbi_panic("kfree_huge\n");
+	huge_push(pa);
+}
+
+// Turn the huge page pa, which the caller holds the only reference
+// to, into 512 pages of one reference each, to be freed one by one.
+void
+kalloc_split_huge(void *pa)
+{
+	uint64 i, first = ((uint64)pa - KERNBASE) / PGSIZE;
+
+	for (i = 0; i < CHUNK_PAGES; i++)
+		refcnt[first + i] = 1;
+}
+
+static uint32 *
+page_ref(void *pa)
+{
+	if (((uint64)pa % PGSIZE) != 0 || (char *)pa < end ||
+	    (uint64)pa >= mem_end)
+		sbi_panic("page_ref: 0x%lx\n", (uint64)pa);
+	return &refcnt[((uint64)pa - KERNBASE) / PGSIZE];
+}
+
+void
+page_get(void *pa)
+{
+	__atomic_fetch_add(page_ref(pa), 1, __ATOMIC_RELAXED);
+}
+
+// Drop a reference to pa, freeing it with the last one.
+void
+page_put(void *pa)
+{
+	if (__atomic_sub_fetch(page_ref(pa), 1, __ATOMIC_ACQ_REL) == 0)
+		kfree(pa);
+}
+
+// page_put() of a huge page, by its first page's count.
+void
+page_put_huge(void *pa)
+{
+	if (__atomic_sub_fetch(page_ref(pa), 1, __ATOMIC_ACQ_REL) == 0)
+		kfree_huge(pa);
+}
+
+uint32
+page_refs(void *pa)
+{
+	return __atomic_load_n(page_ref(pa), __ATOMIC_RELAXED);
+}
+
+// Free memory in pages, whole chunks included.
+uint64
+kmem_free_pages(void)
+{
+	return kmem.nfree + kmem.nhuge * CHUNK_PAGES;
+}
@@ -0,0 +1,45 @@
+#ifndef __KALLOC_H__
+#define __KALLOC_H__
+
+#include "types.h"
+
+void
+kmem_detect(void);
+
+void *
+bootmem_alloc(uint64 size);
+
+void
+kinit(void);
+
+void *
+kalloc(void);
+
+void
+kfree(void *pa);
+
+void *
+kalloc_huge(void);
+
+void
+kfree_huge(void *pa);
+
+void
+kalloc_split_huge(void *pa);
+
+void
+page_get(void *pa);
+
+void
+page_put(void *pa);
+
+void
+page_put_huge(void *pa);
+
+uint32
+page_refs(void *pa);
+
+uint64
+kmem_free_pages(void);
+
+#endif /* __KALLOC_H__ */
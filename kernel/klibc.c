@@ -11,3 +11,136 @@ size_t strlen(const char *str)
 
 	return ret;
 }
+
+int strcmp(const char *a, const char *b)
+{
+	while (*a && *a == *b) {
+		a++;
+		b++;
+	}
+
+	return (unsigned char)*a - (unsigned char)*b;
+}
+
+int strncmp(const char *a, const char *b, size_t n)
+{
+	while (n > 0 && *a && *a == *b) {
+		n--;
+		a++;
+		b++;
+	}
+	if (n == 0)
+		return 0;
+
+	return (unsigned char)*a - (unsigned char)*b;
+}
+
+// memset(), memcpy() and memmove() go a word at a time wherever
+// both ends share their alignment mod 8: 2 MiB megapages are zeroed
+// and copied with them. Misaligned word accesses may trap to
+// firmware, so other data still goes a byte at a time.
+#define WORD    sizeof(unsigned long)
+#define ALIGNED(p, q) ((((unsigned long)(p) ^ (unsigned long)(q)) & \
+			(WORD - 1)) == 0)
+
+void *memset(void *dst, int c, size_t n)
+{
+	char *d = dst;
+	unsigned long w, *wd;
+
+	while (n > 0 && (unsigned long)d % WORD != 0) {
+		*d++ = c;
+		n--;
+	}
+	w = (unsigned char)c * 0x0101010101010101UL;
+	for (wd = (unsigned long *)d; n >= WORD; n -= WORD)
+		*wd++ = w;
+	d = (char *)wd;
+	while (n-- > 0)
+		*d++ = c;
+
+	return dst;
+}
+
+// Forward copy, for memcpy() and memmove().
+static void copy_up(char *d, const char *s, size_t n)
+{
+	unsigned long *wd;
+	const unsigned long *ws;
+
+	if (ALIGNED(d, s)) {
+		while (n > 0 && (unsigned long)d % WORD != 0) {
+			*d++ = *s++;
+			n--;
+		}
+		wd = (unsigned long *)d;
+		ws = (const unsigned long *)s;
+		for (; n >= 4 * WORD; n -= 4 * WORD, wd += 4, ws += 4) {
+			wd[0] = ws[0];
+			wd[1] = ws[1];
+			wd[2] = ws[2];
+			wd[3] = ws[3];
+		}
+		for (; n >= WORD; n -= WORD)
+			*wd++ = *ws++;
+		d = (char *)wd;
+		s = (const char *)ws;
+	}
+	while (n-- > 0)
+		*d++ = *s++;
+}
+
+// Backward copy from the ends d + n and s + n, for memmove().
+static void copy_down(char *d, const char *s, size_t n)
+{
+	unsigned long *wd;
+	const unsigned long *ws;
+
+	d += n;
+	s += n;
+	if (ALIGNED(d, s)) {
+		while (n > 0 && (unsigned long)d % WORD != 0) {
+			*--d = *--s;
+			n--;
+		}
+		wd = (unsigned long *)d;
+		ws = (const unsigned long *)s;
+		for (; n >= WORD; n -= WORD)
+			*--wd = *--ws;
+		d = (char *)wd;
+		s = (const char *)ws;
+	}
+	while (n-- > 0)
+		*--d = *--s;
+}
+
+void *memcpy(void *dst, const void *src, size_t n)
+{
+	copy_up(dst, src, n);
+
+	return dst;
+}
+
+void *memmove(void *dst, const void *src, size_t n)
+{
+	const char *s = src;
+	char *d = dst;
+
+	if (s < d && s + n > d)
+		copy_down(d, s, n);
+	else
+		copy_up(d, s, n);
+
+	return dst;
+}
+
+int memcmp(const void *a, const void *b, size_t n)
+{
+	const unsigned char *p = a, *q = b;
+
+	for (; n > 0; n--, p++, q++)
+		if (*p != *q)
+			return *p - *q;
+
+	return 0;
+}
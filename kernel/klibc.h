@@ -5,5 +5,16 @@
 
 size_t strlen(const char *str);
 
+int strcmp(const char *a, const char *b);
+
+int strncmp(const char *a, const char *b, size_t n);
+
+void *memset(void *dst, int c, size_t n);
+
+void *memcpy(void *dst, const void *src, size_t n);
+
+void *memmove(void *dst, const void *src, size_t n);
+
+int memcmp(const void *a, const void *b, size_t n);
 
 #endif /* __KLIBC_H__ */
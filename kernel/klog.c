@@ -0,0 +1,199 @@
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "cpu.h"
+#include "kalloc.h"
+#include "spinlock.h"
+#include "time.h"
+#include "bench.h"
+#include "klog.h"
+
+// How often the logging hart wakes to drain the rings, unless its
+// timer already ticks faster (PROF=timer).
+#define KLOG_FLUSH_NS (10 * 1000 * 1000)
+
+#define KLOG_LINE_MAX 256
+
+static spinlock_t flush_lock = SPIN_LOCK_INITIALIZER;
+static int klog_cpu = -1; // logging hart, -1 if none
+
+static struct klog_entry *
+entry(struct klog_ring *r, uint64 i)
+{
+	i %= KLOG_ENTRIES;
+	return &r->page[i / KLOG_PER_PAGE][i % KLOG_PER_PAGE];
+}
+
+static void
+ring_write(struct klog_ring *r, const char *fmt, unsigned long a0,
+	   unsigned long a1, unsigned long a2, unsigned long a3,
+	   unsigned long a4)
+{
+	struct klog_entry *e;
+	uint64 h;
+
+	if (!r->page[0])
+		return; // klog_cpu_init() has not run on this hart yet
+
+	// Claim a slot with a cas rather than an amoadd, so that a full
+	// ring is noticed before the slot is taken. An interrupt handler
+	// logging in the middle of this just makes the cas retry.
+	h = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	do {
+		if (h - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >=
+		    KLOG_ENTRIES) {
+			__atomic_fetch_add(&r->dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	} while (!__atomic_compare_exchange_n(&r->head, &h, h + 1, 1,
+					      __ATOMIC_RELAXED,
+					      __ATOMIC_RELAXED));
+
+	e = entry(r, h);
+	e->fmt = fmt;
+	e->time = rdtime();
+	e->arg[0] = a0;
+	e->arg[1] = a1;
+	e->arg[2] = a2;
+	e->arg[3] = a3;
+	e->arg[4] = a4;
+	__atomic_store_n(&e->seq, h + 1, __ATOMIC_RELEASE);
+}
+
+void
+klog_write(const char *fmt, unsigned long a0, unsigned long a1,
+	   unsigned long a2, unsigned long a3, unsigned long a4)
+{
+	ring_write(&mycpu()->klog, fmt, a0, a1, a2, a3, a4);
+}
+
+static int
+ring_alloc(struct klog_ring *r)
+{
+	int i;
+
+	for (i = 0; i < KLOG_BUF_PAGES; i++) {
+		r->page[i] = kalloc();
+		if (!r->page[i]) {
+			while (i > 0)
+				kfree(r->page[--i]);
+			r->page[0] = NULL;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+// On each hart, once kalloc() works and the CPUs are enumerated.
+// Messages logged before are lost. The last CPU, when there is more
+// than one, becomes the logging hart.
+void
+klog_cpu_init(void)
+{
+	struct cpu *c = mycpu();
+
+	if (ring_alloc(&c->klog) < 0)
+		sbi_printf("cpu%d: no memory for the klog ring\n", c->id);
+	if (ncpu > 1 && c->id == ncpu - 1) {
+		klog_cpu = c->id;
+		if (!c->tick_period ||
+		    c->tick_period > ns_to_ticks(KLOG_FLUSH_NS))
+			timer_tick_start(KLOG_FLUSH_NS);
+	}
+}
+
+// Called from the idle loop, with interrupts on: the logging hart
+// drains the rings whenever it wakes.
+void
+klog_idle(void)
+{
+	if (cpuid() == klog_cpu)
+		klog_flush();
+}
+
+// The oldest complete entry of any ring, or NULL.
+static struct klog_entry *
+oldest(struct klog_ring **rp)
+{
+	struct klog_entry *e, *best = NULL;
+	struct klog_ring *r;
+	uint64 t;
+	int i;
+
+	for (i = 0; i < ncpu; i++) {
+		r = &cpus[i].klog;
+		t = r->tail;
+		if (t == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE))
+			continue;
+		e = entry(r, t);
+		// Claimed but still being written: wait for it, or a
+		// later entry of this ring would go out first.
+		if (__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) != t + 1)
+			continue;
+		if (!best || e->time < best->time) {
+			best = e;
+			*rp = r;
+		}
+	}
+	return best;
+}
+
+// Format and print everything logged so far, oldest first across
+// all harts, each line prefixed with the time of the klog() call.
+void
+klog_flush(void)
+{
+	static char line[KLOG_LINE_MAX];
+	struct klog_entry *e;
+	struct klog_ring *r = NULL;
+	uint64 ns, dropped;
+	int i, n;
+
+	spin_lock(&flush_lock);
+	while ((e = oldest(&r)) != NULL) {
+		ns = ticks_to_ns(e->time);
+		n = sbi_snprintf(line, sizeof(line), "[%5lu.%06lu] ",
+				 ns / 1000000000, ns / 1000 % 1000000);
+		sbi_snprintf_argv(line + n, sizeof(line) - n, e->fmt, e->arg);
+		sbi_puts(line);
+		__atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELEASE);
+	}
+	for (i = 0; i < ncpu; i++) {
+		r = &cpus[i].klog;
+		dropped = __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+		if (dropped != r->reported) {
+			sbi_printf("klog: cpu%d dropped %lu messages\n", i,
+				   dropped - r->reported);
+			r->reported = dropped;
+		}
+	}
+	spin_unlock(&flush_lock);
+}
+
+// klog() against sbi_printf() of the same line; fmt.c has the
+// formatting alone (snprintf_sbi). The klog bench writes a private
+// ring, emptied after each sample, so the logging hart never prints
+// it.
+static struct klog_ring bench_ring;
+
+BENCH(klog, 64)
+{
+	if (!bench_ring.page[0] && ring_alloc(&bench_ring) < 0)
+		return -1;
+	while (iters--)
+		ring_write(&bench_ring,
+			   "cpu%d: idle %s: %lu entries, %lu us, pc %lx\n",
+			   3, (unsigned long)"retentive", iters, 123456789UL,
+			   0x80201234UL);
+	bench_ring.tail = bench_ring.head;
+	return 0;
+}
+
+// To the console, so a line ending in \r that the next one
+// overwrites.
+BENCH(printf_sbi, 1)
+{
+	while (iters--)
+		sbi_printf("cpu%d: idle %s: %lu entries, %lu us, pc %lx\r",
+			   3, "retentive", iters, 123456789UL, 0x80201234UL);
+	return 0;
+}
@@ -0,0 +1,75 @@
+#ifndef __KLOG_H__
+#define __KLOG_H__
+
+#include "sbi/sbi.h"
+#include "types.h"
+#include "riscv.h"
+#include "fmt.h"
+
+// Deferred logging, for messages from paths that cannot afford to
+// format them:
+//
+//	klog("cpu%d: idle %s: %lu us\n", id, state->name, us);
+//
+// takes the same formats as sbi_printf() and is checked like it, but
+// only stores the format pointer, a timestamp and the raw arguments
+// in the running hart's ring. The line is formatted later, by the
+// same engine as sbi_printf(), either on the logging hart (the last
+// CPU, from its idle loop) or by whoever calls klog_flush().
+//
+// Hence the format, and any string passed for %s, must outlive the
+// call: string literals and static data only. At most KLOG_ARGS
+// arguments, each an integer or a pointer.
+#define KLOG_ARGS 5
+
+#define klog(fmt, ...)                                                 \
+	do {                                                           \
+		_Static_assert(FMT_NARG(fmt, ##__VA_ARGS__) <= KLOG_ARGS + 1, \
+			       "klog: too many arguments");            \
+		if (0)                                                 \
+			sbi_printf(fmt, ##__VA_ARGS__);                \
+		KLOG_WRITE(fmt, ##__VA_ARGS__, 0, 0, 0, 0, 0);          \
+	} while (0)
+
+#define KLOG_WRITE(fmt, a0, a1, a2, a3, a4, ...)                       \
+	klog_write(fmt, (unsigned long)(a0), (unsigned long)(a1),       \
+		   (unsigned long)(a2), (unsigned long)(a3),            \
+		   (unsigned long)(a4))
+
+// One message, a cache line.
+struct klog_entry {
+	const char *fmt;
+	uint64 seq;  // index + 1 once the entry is complete
+	uint64 time; // rdtime() at the call
+	unsigned long arg[KLOG_ARGS];
+};
+
+#define KLOG_BUF_PAGES 4 // per hart, a power of two
+#define KLOG_PER_PAGE  (PGSIZE / sizeof(struct klog_entry))
+#define KLOG_ENTRIES   (KLOG_BUF_PAGES * KLOG_PER_PAGE)
+
+// Per-CPU ring, kept in struct cpu. The owning hart (and its
+// interrupt handlers) append at head, the flusher consumes at tail.
+// A full ring drops new messages rather than overwrite unread ones.
+struct klog_ring {
+	struct klog_entry *page[KLOG_BUF_PAGES];
+	uint64 head;     // entries ever claimed
+	uint64 tail;     // entries ever printed
+	uint64 dropped;  // messages lost to a full ring
+	uint64 reported; // dropped count last reported
+};
+
+void
+klog_write(const char *fmt, unsigned long a0, unsigned long a1,
+	   unsigned long a2, unsigned long a3, unsigned long a4);
+
+void
+klog_cpu_init(void);
+
+void
+klog_idle(void);
+
+void
+klog_flush(void);
+
+#endif /* __KLOG_H__ */
@@ -0,0 +1,162 @@
+#include "sbi/sbi.h"
+#include "cpu.h"
+#include "spinlock.h"
+#include "kalloc.h"
+#include "vm.h"
+#include "kstack.h"
+
+// entry.S paints each hart's stack with STACK_PAINT before switching
+// to it, and sets sp to the top of its stack; kstack_alloc() paints
+// the work stack. The boot hart runs on boot_kstack; the stacks of
+// the other CPUs are sized by the number of CPUs actually found.
+struct kstack boot_kstack;
+
+// Thread stacks: one per thread slot that no CPU's boot thread
+// takes, carved out of boot memory so that kvminit() can unmap
+// their guard pages before any hart turns paging on. The pages stay
+// mapped for good; a free stack is only back on the list.
+static struct {
+	spinlock_t lock;
+	struct tstack *pool;
+	int n;
+	struct tstack *free;     // linked through the first stack word
+	uint64 used;             // high-water mark over freed stacks
+} tstacks = { SPIN_LOCK_INITIALIZER };
+
+// kernelvec switches to this stack to report an overflow; the first
+// hart to get there panics.
+static char overflow_stack[4096] __attribute__((aligned(16)));
+char *kstack_overflow_top = overflow_stack + sizeof(overflow_stack);
+
+static void
+paint(char *lo, char *hi)
+{
+	uint64 *p;
+
+	for (p = (uint64 *)lo; p < (uint64 *)hi; p++)
+		*p = STACK_PAINT;
+}
+
+// Bytes of the stack from lo to hi ever used: the deepest word that
+// no longer holds the paint pattern marks the high-water mark.
+static uint64
+stack_used(char *lo, char *hi)
+{
+	uint64 *p = (uint64 *)lo;
+
+	while (p < (uint64 *)hi && *p == STACK_PAINT)
+		p++;
+	return (uint64)hi - (uint64)p;
+}
+
+void
+kstack_alloc(struct cpu *c)
+{
+	struct kstack *ks;
+
+	if (c->id == 0)
+		ks = &boot_kstack;
+	else
+		ks = bootmem_alloc(sizeof(struct kstack));
+	c->kstack = ks;
+	c->kstack_top = (uint64)(ks->stack + KSTACK_SIZE);
+	paint(ks->work_stack, ks->work_stack + KSTACK_SIZE);
+}
+
+// After cpu_enumerate(), before kinit().
+void
+tstack_init(void)
+{
+	int i;
+
+	tstacks.n = NTHREAD - ncpu;
+	tstacks.pool = bootmem_alloc(tstacks.n * sizeof(struct tstack));
+	for (i = tstacks.n - 1; i >= 0; i--) {
+		*(struct tstack **)tstacks.pool[i].stack = tstacks.free;
+		tstacks.free = &tstacks.pool[i];
+	}
+}
+
+// A painted thread stack, or NULL if all are taken.
+struct tstack *
+tstack_alloc(void)
+{
+	struct tstack *ts;
+
+	spin_lock(&tstacks.lock);
+	ts = tstacks.free;
+	if (ts)
+		tstacks.free = *(struct tstack **)ts->stack;
+	spin_unlock(&tstacks.lock);
+	if (ts)
+		paint(ts->stack, ts->stack + TSTACK_SIZE);
+	return ts;
+}
+
+void
+tstack_free(struct tstack *ts)
+{
+	uint64 used = stack_used(ts->stack, ts->stack + TSTACK_SIZE);
+
+	spin_lock(&tstacks.lock);
+	if (used > tstacks.used)
+		tstacks.used = used;
+	*(struct tstack **)ts->stack = tstacks.free;
+	tstacks.free = ts;
+	spin_unlock(&tstacks.lock);
+}
+
+// From kvminit(): leave every guard page unmapped.
+void
+kstack_unmap_guards(void)
+{
+	int i;
+
+	for (i = 0; i < ncpu; i++) {
+		kvm_unmap((uint64)cpus[i].kstack->guard);
+		kvm_unmap((uint64)cpus[i].kstack->work_guard);
+	}
+	for (i = 0; i < tstacks.n; i++)
+		kvm_unmap((uint64)tstacks.pool[i].guard);
+}
+
+uint64
+kstack_used(int id)
+{
+	struct kstack *ks = cpus[id].kstack;
+
+	return stack_used(ks->stack, ks->stack + KSTACK_SIZE);
+}
+
+uint64
+kstack_work_used(int id)
+{
+	struct kstack *ks = cpus[id].kstack;
+
+	return stack_used(ks->work_stack, ks->work_stack + KSTACK_SIZE);
+}
+
+// kernelvec: a store fault just above sp, which only running into a
+// guard page causes. Called on overflow_stack.
+void
+kstack_overflow(uint64 sp, uint64 epc)
+{
+	sbi_panic("kstack_overflow: cpu%d sp 0x%lx sepc 0x%lx\n", cpuid(),
+		  sp, epc);
+}
+
+void
+kstack_report(void)
+{
+	int i;
+
+	for (i = 0; i < ncpu; i++) {
+		if (!cpus[i].online)
+			continue;
+		sbi_printf("cpu%d: stack high-water %lu/%d bytes, work stack "
+			   "%lu\n", i, kstack_used(i), KSTACK_SIZE,
+			   kstack_work_used(i));
+	}
+	sbi_printf("threads: stack high-water %lu/%d bytes, of exited "
+		   "threads\n", tstacks.used, TSTACK_SIZE);
+}
@@ -0,0 +1,61 @@
+#ifndef __KSTACK_H__
+#define __KSTACK_H__
+
+#include "types.h"
+#include "param.h"
+
+// One kernel stack per hart, laid out as a guard page followed by
+// the stack itself (stacks grow down, towards the guard). The page
+// alignment lets kvminit() leave each guard page unmapped, so that
+// running off the bottom of a stack faults. A second one, the same
+// way round, is where the hart runs its work queue (workq.c).
+struct kstack {
+	char guard[KSTACK_GUARD];
+	char stack[KSTACK_SIZE];
+	char work_guard[KSTACK_GUARD];
+	char work_stack[KSTACK_SIZE];
+} __attribute__((aligned(4096)));
+
+// A kernel thread's stack, the same way round, from a pool set up
+// at boot by tstack_init().
+struct tstack {
+	char guard[KSTACK_GUARD];
+	char stack[TSTACK_SIZE];
+} __attribute__((aligned(4096)));
+
+struct cpu;
+
+extern struct kstack boot_kstack;
+extern char *kstack_overflow_top;
+
+void
+kstack_alloc(struct cpu *c);
+
+void
+tstack_init(void);
+
+struct tstack *
+tstack_alloc(void);
+
+void
+tstack_free(struct tstack *ts);
+
+void
+kstack_unmap_guards(void);
+
+uint64
+kstack_used(int id);
+
+uint64
+kstack_work_used(int id);
+
+void __attribute__((noreturn))
+kstack_overflow(uint64 sp, uint64 epc);
+
+void
+call_on_stack(void (*fn)(void), uint64 sp);
+
+void
+kstack_report(void);
+
+#endif /* __KSTACK_H__ */
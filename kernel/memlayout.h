@@ -0,0 +1,32 @@
+#ifndef __MEMLAYOUT_H__
+#define __MEMLAYOUT_H__
+
+// Physical memory layout.
+//
+// The kernel is loaded at 0x84000000 (see kernel.ld) inside RAM
+// that starts at KERNBASE on the QEMU virt machine. The RAM size
+// comes from the /memory devicetree node; PHYSTOP_DEFAULT is only
+// used when the boot loader hands over no devicetree.
+
+#define KERNBASE        0x80000000L
+#define PHYSTOP_DEFAULT (KERNBASE + 128*1024*1024)
+
+// Virtual memory layout, Sv39.
+//
+// The kernel runs on an identity mapping of the low 4 GiB (devices
+// and RAM), four 1 GiB megapages shared by every page table. User
+// address spaces live above it:
+//
+// USER_BASE    program text and data, where user/user.ld links,
+//              then the heap, growing up
+// ...          (empty)
+//              mmap() regions, growing down
+// USTACK_TOP - USTACK_SIZE
+// USTACK_TOP   user stack, growing down
+// MAXVA
+#define KERNEL_MAP_END  0x100000000L
+#define USER_BASE       KERNEL_MAP_END
+#define USTACK_SIZE     (64 * 1024)
+#define USTACK_TOP      MAXVA
+
+#endif /* __MEMLAYOUT_H__ */
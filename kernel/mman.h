@@ -0,0 +1,25 @@
+#ifndef __MMAN_H__
+#define __MMAN_H__
+
+// mmap(), mprotect() and madvise() arguments, with Linux's values.
+// Shared with user programs.
+
+#define PROT_NONE  0
+#define PROT_READ  1
+#define PROT_WRITE 2
+#define PROT_EXEC  4
+
+#define MAP_SHARED    0x01
+#define MAP_PRIVATE   0x02
+#define MAP_ANONYMOUS 0x20
+
+#define MAP_FAILED ((void *)-1)
+
+#define MADV_NORMAL     0
+#define MADV_RANDOM     1  // no read-ahead
+#define MADV_SEQUENTIAL 2  // read ahead, and map the pages read ahead
+#define MADV_WILLNEED   3  // read the file into the page cache now
+#define MADV_HUGEPAGE   14 // back with megapages where possible (default)
+#define MADV_NOHUGEPAGE 15 // 4 KiB pages only
+
+#endif /* __MMAN_H__ */
@@ -0,0 +1,195 @@
+// mmap() and its relatives, for anonymous private memory and files.
+// Regions go top down from below the stack, 2 MiB aligned when they
+// are at least that big, so that vm_fault() can back anonymous ones
+// with megapages. Address space that munmap() gives back is not
+// reused.
+//
+// A file mapping maps the page cache's own pages: a MAP_SHARED one
+// always, a MAP_PRIVATE one until the page is written, when it gets
+// a copy. The files are read-only, so a shared file mapping cannot
+// be writable. Shared anonymous memory stays shared with fork()
+// children instead of becoming copy on write.
+//
+// munmap(), mprotect() and madvise() split vmas at the ends of their
+// range, so that it is made of whole vmas, and uvm_unmap() and
+// uvm_protect() split megapages the same way. The heap belongs to
+// sbrk() and is left alone.
+
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "memlayout.h"
+#include "mman.h"
+#include "file.h"
+#include "proc.h"
+#include "vm.h"
+
+// PROT_* as PTE bits. RISC-V has no write-only pages.
+static int
+vma_prot(int prot)
+{
+	int perm = 0;
+
+	if (prot & PROT_READ)
+		perm |= PTE_R;
+	if (prot & PROT_WRITE)
+		perm |= PTE_R | PTE_W;
+	if (prot & PROT_EXEC)
+		perm |= PTE_X;
+	return perm;
+}
+
+// Check [addr, addr + len) and split the vmas at its ends. Returns
+// the end of the range, or 0.
+static uint64
+vma_range(struct proc *p, uint64 addr, uint64 len)
+{
+	uint64 end = addr + PGROUNDUP(len);
+	int i;
+
+	if (addr % PGSIZE != 0 || len == 0 || end <= addr ||
+	    addr < USER_BASE || end > MAXVA)
+		return 0;
+	for (i = 0; i < p->nvma; i++)
+		if ((p->vma[i].flags & VMA_HEAP) && addr < p->vma[i].end &&
+		    p->vma[i].start < end)
+			return 0;
+	if (vma_split(p, addr) < 0 || vma_split(p, end) < 0)
+		return 0;
+	return end;
+}
+
+// mmap(addr, len, prot, flags, fd, off): MAP_PRIVATE or MAP_SHARED,
+// of fd from page-aligned off or with MAP_ANONYMOUS. addr is only a
+// hint, which is ignored.
+uint64
+proc_mmap(uint64 addr, uint64 len, int prot, int flags, int fd,
+	  uint64 off)
+{
+	struct proc *p = myproc();
+	struct file *f = NULL;
+	uint64 start, file_end;
+	int vflags = 0;
+
+	if (len == 0 || len > p->mmap_base - USER_BASE)
+		return -1;
+	if ((flags & (MAP_SHARED | MAP_PRIVATE)) == MAP_SHARED) {
+		if ((prot & PROT_WRITE) && !(flags & MAP_ANONYMOUS))
+			return -1;
+		vflags = VMA_SHARED;
+	} else if ((flags & (MAP_SHARED | MAP_PRIVATE)) != MAP_PRIVATE) {
+		return -1;
+	}
+	if (!(flags & MAP_ANONYMOUS) &&
+	    (!(f = proc_file(fd)) || off % PGSIZE != 0))
+		return -1;
+	len = PGROUNDUP(len);
+	start = p->mmap_base - len;
+	if (len >= HPGSIZE)
+		start &= ~(HPGSIZE - 1);
+	if (start < USER_BASE)
+		return -1;
+	file_end = start;
+	if (f && off < f->size)
+		file_end += f->size - off < len ? f->size - off : len;
+	if (vma_add(p, start, start + len, vma_prot(prot), vflags, f,
+		    f ? off : 0, file_end) < 0)
+		return -1;
+	p->mmap_base = start;
+	return start;
+}
+
+int
+proc_munmap(uint64 addr, uint64 len)
+{
+	struct proc *p = myproc();
+	uint64 end = vma_range(p, addr, len);
+
+	if (!end || uvm_unmap(p, addr, end) < 0)
+		return -1;
+	vma_remove(p, addr, end);
+	return 0;
+}
+
+// mprotect(addr, len, prot): every page of the range must be mapped.
+// A shared file mapping cannot be made writable. Each vma takes the
+// new prot once its pages have it.
+int
+proc_mprotect(uint64 addr, uint64 len, int prot)
+{
+	struct proc *p = myproc();
+	uint64 va, end = vma_range(p, addr, len);
+	struct vma *v;
+
+	if (!end)
+		return -1;
+	for (va = addr; va < end; va = v->end)
+		if (!(v = vma_find(p, va)) ||
+		    (v->file && (v->flags & VMA_SHARED) &&
+		     (prot & PROT_WRITE)))
+			return -1;
+	for (va = addr; va < end; va = v->end) {
+		v = vma_find(p, va);
+		if (uvm_protect(p, v->start, v->end, vma_prot(prot),
+				v->flags & VMA_SHARED) < 0)
+			return -1;
+		v->prot = vma_prot(prot);
+	}
+	return 0;
+}
+
+// MADV_WILLNEED: read the file pages of v into the page cache now,
+// so that faults on them find the pages there.
+static void
+willneed(struct vma *v)
+{
+	uint64 va;
+
+	if (!v->file)
+		return;
+	for (va = v->start; va < v->file_end; va += PGSIZE)
+		if (!pcache_get(v->file, (v->off + (va - v->start)) / PGSIZE))
+			return;
+}
+
+// madvise(addr, len, advice): how the range will be used. Megapages
+// already mapped stay after MADV_NOHUGEPAGE.
+int
+proc_madvise(uint64 addr, uint64 len, int advice)
+{
+	struct proc *p = myproc();
+	struct vma *v;
+	uint64 end;
+	int i;
+
+	if (advice != MADV_NORMAL && advice != MADV_RANDOM &&
+	    advice != MADV_SEQUENTIAL && advice != MADV_WILLNEED &&
+	    advice != MADV_HUGEPAGE && advice != MADV_NOHUGEPAGE)
+		return -1;
+	end = vma_range(p, addr, len);
+	if (!end)
+		return -1;
+	for (i = 0; i < p->nvma; i++) {
+		v = &p->vma[i];
+		if (v->start < addr || v->end > end)
+			continue;
+		switch (advice) {
+		case MADV_NORMAL:
+		case MADV_RANDOM:
+			v->flags &= ~VMA_SEQ;
+			break;
+		case MADV_SEQUENTIAL:
+			v->flags |= VMA_SEQ;
+			break;
+		case MADV_WILLNEED:
+			willneed(v);
+			break;
+		case MADV_HUGEPAGE:
+			v->flags &= ~VMA_NOHUGE;
+			break;
+		case MADV_NOHUGEPAGE:
+			v->flags |= VMA_NOHUGE;
+			break;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,96 @@
+// Page cache. Pages are filled on first use and kept for the life
+// of the kernel; nothing is written back or evicted yet.
+
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "kalloc.h"
+#include "klibc.h"
+#include "spinlock.h"
+#include "file.h"
+
+static uint64 cached_pages;
+
+// Slot for page pgoff of f, allocating index pages if need be.
+static void **
+pcache_slot(struct file *f, uint64 pgoff)
+{
+	void ***dir, **leaf;
+
+	if (!f->pages) {
+		f->pages = kalloc();
+		if (!f->pages)
+			return NULL;
+		memset(f->pages, 0, PGSIZE);
+	}
+	dir = f->pages;
+	leaf = dir[pgoff / PCACHE_PER_PAGE];
+	if (!leaf) {
+		leaf = kalloc();
+		if (!leaf)
+			return NULL;
+		memset(leaf, 0, PGSIZE);
+		dir[pgoff / PCACHE_PER_PAGE] = leaf;
+	}
+	return &leaf[pgoff % PCACHE_PER_PAGE];
+}
+
+// The cached page holding bytes pgoff * PGSIZE onwards of f, zero
+// past the end of the file; NULL beyond it or without memory. The
+// page stays owned by the cache.
+void *
+pcache_get(struct file *f, uint64 pgoff)
+{
+	void **slot, *page = NULL;
+	uint64 off = pgoff * PGSIZE, n;
+
+	if (off >= f->size || pgoff >= PCACHE_MAX_PAGES)
+		return NULL;
+	spin_lock(&f->lock);
+	slot = pcache_slot(f, pgoff);
+	if (slot && *slot) {
+		page = *slot;
+	} else if (slot && (page = kalloc())) {
+		n = f->size - off < PGSIZE ? f->size - off : PGSIZE;
+		memset(page, 0, PGSIZE);
+		if (f->fill(f, page, off, n) < 0) {
+			kfree(page);
+			page = NULL;
+		} else {
+			*slot = page;
+			__atomic_fetch_add(&cached_pages, 1, __ATOMIC_RELAXED);
+		}
+	}
+	spin_unlock(&f->lock);
+	return page;
+}
+
+// Pages held by the cache, over all files.
+uint64
+pcache_pages(void)
+{
+	return __atomic_load_n(&cached_pages, __ATOMIC_RELAXED);
+}
+
+// Copy n bytes at off out of f, through the cache.
+int
+file_read(struct file *f, void *dst, uint64 off, uint64 n)
+{
+	uint64 m;
+	char *page;
+
+	if (off > f->size || n > f->size - off)
+		return -1;
+	while (n > 0) {
+		page = pcache_get(f, off / PGSIZE);
+		if (!page)
+			return -1;
+		m = PGSIZE - off % PGSIZE;
+		if (m > n)
+			m = n;
+		memmove(dst, page + off % PGSIZE, m);
+		dst = (char *)dst + m;
+		off += m;
+		n -= m;
+	}
+	return 0;
+}
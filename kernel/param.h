@@ -1 +1,19 @@
-#define NCPU          8  // maximum number of CPUs
+#ifndef NCPU
+#define NCPU          64 // maximum number of CPUs (make NCPU=n)
+#endif
+
+#define NTHREAD       (NCPU + 64) // kernel threads, including each CPU's boot thread
+#define NPROC         64  // user processes
+#define NVMA          16  // mapped regions per process
+#define MAXARG        16  // exec arguments
+#define NOFILE        16  // open files per process
+#define NPIPE         16  // pipes, over all processes
+#define MAXPATH       64  // bytes in a file name, with the NUL
+
+#ifndef KSTACK_PAGES
+#define KSTACK_PAGES  4  // 4 KiB pages per hart kernel stack (make KSTACK_PAGES=n)
+#endif
+#define KSTACK_SIZE   (KSTACK_PAGES * 4096)
+#define KSTACK_GUARD  4096 // guard page below each stack, unmapped by kvminit()
+#define TSTACK_SIZE   4096 // bytes of stack per kernel thread
+#define STACK_PAINT   0x6b7374616b737461 // fill pattern for high-water measurement
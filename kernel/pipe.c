@@ -0,0 +1,389 @@
+// Pipes, as a ring of PIPE_BUFS page buffers instead of xv6's 512
+// byte array: each buffer is a page and the part of it that holds
+// data. Small writes are merged into the last buffer while it has
+// room. A write of a whole page-aligned page of private memory lends
+// the page itself (uvm_loan()), copy on write in the writer, and a
+// read of a whole page into a page-aligned buffer maps it
+// (uvm_remap()) instead of copying, so data written a page at a time
+// goes from writer to reader without being copied at all.
+//
+// splice() fills a pipe from a file with the page cache's own pages,
+// or from another pipe by moving its buffers. Only the pages a pipe
+// allocated itself take appended data; lent, cached and spliced ones
+// are never written to.
+//
+// Readers and writers that must wait park on the pipe's waiter list;
+// every change wakes them all to look again. The pipe's lock only
+// covers taking and adding buffers: a write copies into (or lends)
+// a page before it takes the lock to add it, and a read takes a
+// buffer off before copying or mapping it out, so user memory is
+// never touched with interrupts off.
+
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "param.h"
+#include "kalloc.h"
+#include "klibc.h"
+#include "spinlock.h"
+#include "thread.h"
+#include "file.h"
+#include "vm.h"
+#include "proc.h"
+#include "pipe.h"
+
+#define PIPE_BUFS 16 // a power of two
+
+#define PIPE_BUF_CACHE  1 // a page cache page, which is not counted
+#define PIPE_BUF_SHARED 2 // others have the page too: do not write it
+
+struct pipe_buf {
+	char *page;
+	uint32 off;             // the data in page
+	uint32 len;
+	int flags;              // PIPE_BUF_*
+};
+
+struct pipe_waiter {
+	struct thread *thread;
+	struct pipe_waiter *next;
+};
+
+struct pipe {
+	spinlock_t lock;
+	int used;
+	struct pipe_buf bufs[PIPE_BUFS];
+	uint32 nread;           // buffers taken; bufs[nread % PIPE_BUFS] next
+	uint32 nwrite;          // buffers added
+	int readers;            // open ends, over all processes
+	int writers;
+	struct pipe_waiter *waiters;
+};
+
+static struct pipe pipes[NPIPE];
+static spinlock_t pipes_lock = SPIN_LOCK_INITIALIZER;
+
+static struct {
+	uint64 copied;          // bytes copied in or out
+	uint64 loaned;          // pages lent by writers
+	uint64 remapped;        // pages mapped into readers
+	uint64 spliced;         // buffers filled or moved by splice()
+} pipe_stat;
+
+static void
+stat_add(uint64 *counter, uint64 n)
+{
+	__atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+static int
+empty(struct pipe *pi)
+{
+	return pi->nread == pi->nwrite;
+}
+
+static int
+full(struct pipe *pi)
+{
+	return pi->nwrite - pi->nread == PIPE_BUFS;
+}
+
+static void
+buf_put(struct pipe_buf *b)
+{
+	if (!(b->flags & PIPE_BUF_CACHE))
+		page_put(b->page);
+}
+
+// Wait for a change to pi, which is locked, like a condition variable.
+static void
+pipe_wait(struct pipe *pi)
+{
+	struct pipe_waiter w, **pp;
+
+	w.thread = mythread();
+	w.next = pi->waiters;
+	pi->waiters = &w;
+	spin_unlock(&pi->lock);
+	thread_park();
+	spin_lock(&pi->lock);
+	for (pp = &pi->waiters; *pp; pp = &(*pp)->next) {
+		if (*pp == &w) {
+			*pp = w.next;
+			break;
+		}
+	}
+}
+
+// Wake everyone waiting on pi, which is locked.
+static void
+wakeup(struct pipe *pi)
+{
+	struct pipe_waiter *w;
+
+	// A waiter cannot return and drop w before we unlock.
+	for (w = pi->waiters; w; w = w->next)
+		thread_unpark(w->thread);
+	pi->waiters = NULL;
+}
+
+// A new pipe, with one read and one write end open.
+struct pipe *
+pipe_alloc(void)
+{
+	struct pipe *pi;
+
+	spin_lock(&pipes_lock);
+	for (pi = pipes; pi < &pipes[NPIPE]; pi++) {
+		if (!pi->used) {
+			memset(pi, 0, sizeof(*pi));
+			pi->used = 1;
+			pi->readers = pi->writers = 1;
+			spin_unlock(&pipes_lock);
+			return pi;
+		}
+	}
+	spin_unlock(&pipes_lock);
+	return NULL;
+}
+
+// Another open read or write end, for fork().
+void
+pipe_dup(struct pipe *pi, int write)
+{
+	spin_lock(&pi->lock);
+	if (write)
+		pi->writers++;
+	else
+		pi->readers++;
+	spin_unlock(&pi->lock);
+}
+
+void
+pipe_close(struct pipe *pi, int write)
+{
+	spin_lock(&pi->lock);
+	if (write)
+		pi->writers--;
+	else
+		pi->readers--;
+	wakeup(pi);
+	if (pi->readers > 0 || pi->writers > 0) {
+		spin_unlock(&pi->lock);
+		return;
+	}
+	while (!empty(pi))
+		buf_put(&pi->bufs[pi->nread++ % PIPE_BUFS]);
+	spin_unlock(&pi->lock);
+	spin_lock(&pipes_lock);
+	pi->used = 0;
+	spin_unlock(&pipes_lock);
+}
+
+// Add buffer b to pi, waiting for room. A small one is merged into
+// the last buffer instead if that is the pipe's own page and has
+// room, and its page freed. -1 once nobody can read it.
+static int
+put(struct pipe *pi, struct pipe_buf *b)
+{
+	struct pipe_buf *last;
+	int merged = 0;
+
+	spin_lock(&pi->lock);
+	while (full(pi) && pi->readers > 0)
+		pipe_wait(pi);
+	if (pi->readers == 0) {
+		spin_unlock(&pi->lock);
+		return -1;
+	}
+	last = &pi->bufs[(pi->nwrite - 1) % PIPE_BUFS];
+	if (!empty(pi) && !last->flags && !b->flags &&
+	    last->off + last->len + b->len <= PGSIZE) {
+		memmove(last->page + last->off + last->len,
+			b->page + b->off, b->len);
+		last->len += b->len;
+		merged = 1;
+	} else {
+		pi->bufs[pi->nwrite++ % PIPE_BUFS] = *b;
+	}
+	wakeup(pi);
+	spin_unlock(&pi->lock);
+	if (merged)
+		buf_put(b);
+	return 0;
+}
+
+// Take up to n bytes off the front of pi as buffer b, waiting for
+// data unless nowait. A buffer with more than n is split, the two
+// halves sharing its page. Returns how many bytes, 0 if none.
+static uint64
+take(struct pipe *pi, uint64 n, struct pipe_buf *b, int nowait)
+{
+	struct pipe_buf *first;
+
+	spin_lock(&pi->lock);
+	while (empty(pi) && pi->writers > 0 && !nowait)
+		pipe_wait(pi);
+	if (empty(pi)) {
+		spin_unlock(&pi->lock);
+		return 0;
+	}
+	first = &pi->bufs[pi->nread % PIPE_BUFS];
+	*b = *first;
+	if (n < first->len) {
+		if (!(first->flags & PIPE_BUF_CACHE))
+			page_get(first->page);
+		b->len = n;
+		b->flags |= PIPE_BUF_SHARED;
+		first->flags |= PIPE_BUF_SHARED;
+		first->off += n;
+		first->len -= n;
+	} else {
+		pi->nread++;
+	}
+	wakeup(pi);
+	spin_unlock(&pi->lock);
+	return b->len;
+}
+
+// Put b, just taken, back at the front of pi, for a read that could
+// not store it. It is dropped if writers filled the pipe meanwhile.
+static void
+untake(struct pipe *pi, struct pipe_buf *b)
+{
+	spin_lock(&pi->lock);
+	if (full(pi)) {
+		spin_unlock(&pi->lock);
+		buf_put(b);
+		return;
+	}
+	pi->bufs[--pi->nread % PIPE_BUFS] = *b;
+	wakeup(pi);
+	spin_unlock(&pi->lock);
+}
+
+// read(): wait for data, then take up to n bytes of it. Returns 0
+// once the pipe is empty with no writers left.
+long
+pipe_read(struct pipe *pi, uint64 addr, uint64 n)
+{
+	struct proc *p = myproc();
+	struct pipe_buf b;
+	uint64 done = 0, m, va;
+
+	while (done < n && (m = take(pi, n - done, &b, done > 0))) {
+		va = addr + done;
+		if (b.off == 0 && b.len == PGSIZE &&
+		    !(b.flags & PIPE_BUF_CACHE) && va % PGSIZE == 0 &&
+		    uvm_remap(p, va, (uint64)b.page) == 0) {
+			// our reference went to the mapping
+			stat_add(&pipe_stat.remapped, 1);
+		} else if (copyout(p, va, b.page + b.off, m) < 0) {
+			untake(pi, &b);
+			return done ? done : -1;
+		} else {
+			stat_add(&pipe_stat.copied, m);
+			buf_put(&b);
+		}
+		done += m;
+	}
+	return done;
+}
+
+// write(): all n bytes, waiting for room as needed. Fails once there
+// are no readers left.
+long
+pipe_write(struct pipe *pi, uint64 addr, uint64 n)
+{
+	struct proc *p = myproc();
+	struct pipe_buf b;
+	uint64 done = 0, m, va, pa;
+
+	while (done < n) {
+		va = addr + done;
+		b.off = 0;
+		if (va % PGSIZE == 0 && n - done >= PGSIZE &&
+		    (pa = uvm_loan(p, va))) {
+			m = PGSIZE;
+			b.page = (char *)pa;
+			b.flags = PIPE_BUF_SHARED;
+		} else {
+			m = n - done < PGSIZE ? n - done : PGSIZE;
+			b.page = kalloc();
+			if (!b.page)
+				break;
+			if (copyin(p, b.page, va, m) < 0) {
+				kfree(b.page);
+				break;
+			}
+			b.flags = 0;
+		}
+		b.len = m;
+		if (put(pi, &b) < 0) {
+			buf_put(&b);
+			break;
+		}
+		if (b.flags)
+			stat_add(&pipe_stat.loaned, 1);
+		else
+			stat_add(&pipe_stat.copied, m);
+		done += m;
+	}
+	return done ? done : -1;
+}
+
+// splice() from pipe in to pipe out: move up to n bytes' worth of
+// buffers, waiting for the first like read() does.
+long
+pipe_splice(struct pipe *in, struct pipe *out, uint64 n)
+{
+	struct pipe_buf b;
+	uint64 done = 0, m;
+
+	if (in == out)
+		return -1;
+	while (done < n && (m = take(in, n - done, &b, done > 0))) {
+		if (put(out, &b) < 0) {
+			buf_put(&b);
+			return done ? done : -1;
+		}
+		stat_add(&pipe_stat.spliced, 1);
+		done += m;
+	}
+	return done;
+}
+
+// splice() from file f at *off to pipe out: up to n bytes, as the
+// cached pages themselves.
+long
+pipe_splice_file(struct file *f, uint64 *off, struct pipe *out, uint64 n)
+{
+	struct pipe_buf b;
+	uint64 done = 0;
+
+	while (done < n && *off < f->size) {
+		b.page = pcache_get(f, *off / PGSIZE);
+		if (!b.page)
+			return done ? done : -1;
+		b.off = *off % PGSIZE;
+		b.len = PGSIZE - b.off;
+		if (b.len > n - done)
+			b.len = n - done;
+		if (b.len > f->size - *off)
+			b.len = f->size - *off;
+		b.flags = PIPE_BUF_CACHE;
+		if (put(out, &b) < 0)
+			return done ? done : -1;
+		stat_add(&pipe_stat.spliced, 1);
+		*off += b.len;
+		done += b.len;
+	}
+	return done;
+}
+
+void
+pipe_report(void)
+{
+	sbi_printf("pipe: %lu bytes copied, %lu pages lent, %lu remapped, "
+		   "%lu buffers spliced\n", pipe_stat.copied,
+		   pipe_stat.loaned, pipe_stat.remapped, pipe_stat.spliced);
+}
@@ -0,0 +1,33 @@
+#ifndef __PIPE_H__
+#define __PIPE_H__
+
+#include "types.h"
+
+struct file;
+struct pipe;
+
+struct pipe *
+pipe_alloc(void);
+
+void
+pipe_dup(struct pipe *pi, int write);
+
+void
+pipe_close(struct pipe *pi, int write);
+
+long
+pipe_read(struct pipe *pi, uint64 addr, uint64 n);
+
+long
+pipe_write(struct pipe *pi, uint64 addr, uint64 n);
+
+long
+pipe_splice(struct pipe *in, struct pipe *out, uint64 n);
+
+long
+pipe_splice_file(struct file *f, uint64 *off, struct pipe *out, uint64 n);
+
+void
+pipe_report(void);
+
+#endif /* __PIPE_H__ */
@@ -0,0 +1,141 @@
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "cpu.h"
+#include "fdt.h"
+#include "klibc.h"
+#include "plic.h"
+
+// RISC-V PLIC Specification v1.0.0, chapter 3 (Memory Map). A
+// context is one hart privilege mode's external interrupt line; the
+// devicetree lists them in order in interrupts-extended.
+#define PLIC_PRIORITY(irq)  (plic_base + 4 * (irq))
+#define PLIC_ENABLE(ctx)    (plic_base + 0x2000 + (ctx) * 0x80)
+#define PLIC_THRESHOLD(ctx) (plic_base + 0x200000 + (ctx) * 0x1000)
+#define PLIC_CLAIM(ctx)     (plic_base + 0x200004 + (ctx) * 0x1000)
+
+static uint64 plic_base;
+static int plic_node = -1;
+static int contexts[NCPU]; // S-mode context of each CPU plus one, 0: unknown
+
+static struct {
+	plic_handler_t fn;
+	void *arg;
+} handlers[PLIC_NIRQ];
+
+static inline void
+plic_write(uint64 addr, uint32 v)
+{
+	*(volatile uint32 *)addr = v;
+}
+
+static inline uint32
+plic_read(uint64 addr)
+{
+	return *(volatile uint32 *)addr;
+}
+
+// Phandle of the interrupt controller of CPU cpu, or 0.
+static uint32
+cpu_intc_phandle(int cpu)
+{
+	int cpus_node, node, intc, ac, len;
+	const void *reg;
+	uint32 ph;
+
+	cpus_node = fdt_path_offset("/cpus");
+	ac = fdt_address_cells(cpus_node);
+	for (node = fdt_first_subnode(cpus_node); node >= 0;
+	     node = fdt_next_subnode(node)) {
+		reg = fdt_getprop(node, "reg", &len);
+		if (!reg || len < ac * 4 ||
+		    fdt_read_cells(reg, ac) != cpus[cpu].hartid)
+			continue;
+		intc = fdt_next_compatible(node, -1, "riscv,cpu-intc");
+		if (intc >= 0 && fdt_getprop_u32(intc, "phandle", &ph) == 0)
+			return ph;
+	}
+	return 0;
+}
+
+// The context whose (intc phandle, IRQ_S_EXT) pair belongs to cpu.
+static int
+plic_context(int cpu)
+{
+	const char *ie;
+	uint32 ph;
+	int i, len;
+
+	if (contexts[cpu])
+		return contexts[cpu] - 1;
+	ph = cpu_intc_phandle(cpu);
+	ie = fdt_getprop(plic_node, "interrupts-extended", &len);
+	if (!ph || !ie)
+		return -1;
+	for (i = 0; i < len / 8; i++) {
+		if (fdt32_ld(ie + 8 * i) == ph &&
+		    fdt32_ld(ie + 8 * i + 4) == IRQ_S_EXT) {
+			contexts[cpu] = i + 1;
+			return i;
+		}
+	}
+	return -1;
+}
+
+// Find the PLIC in the devicetree. Every source starts out disabled.
+int
+plic_init(void)
+{
+	int soc = fdt_path_offset("/soc");
+
+	plic_node = fdt_next_compatible(soc, -1, "riscv,plic0");
+	if (plic_node < 0)
+		plic_node = fdt_next_compatible(soc, -1, "sifive,plic-1.0.0");
+	if (plic_node < 0 || fdt_reg(soc, plic_node, &plic_base, NULL) < 0) {
+		plic_node = -1;
+		return -1;
+	}
+	sbi_printf("plic: at 0x%lx\n", plic_base);
+	return 0;
+}
+
+// Route irq to CPU cpu's S-mode external interrupt, calling handler
+// from kerneltrap() there.
+int
+plic_enable(int irq, int cpu, plic_handler_t handler, void *arg)
+{
+	uint64 en;
+	int ctx;
+
+	if (plic_node < 0 || irq <= 0 || irq >= PLIC_NIRQ)
+		return -1;
+	ctx = plic_context(cpu);
+	if (ctx < 0)
+		return -1;
+	handlers[irq].fn = handler;
+	handlers[irq].arg = arg;
+	plic_write(PLIC_PRIORITY(irq), 1);
+	en = PLIC_ENABLE(ctx) + irq / 32 * 4;
+	plic_write(en, plic_read(en) | 1U << (irq % 32));
+	plic_write(PLIC_THRESHOLD(ctx), 0);
+	return 0;
+}
+
+// S-mode external interrupt: claim, handle and complete every
+// pending source routed to this CPU.
+void
+plic_intr(void)
+{
+	int ctx = contexts[cpuid()] - 1;
+	uint32 irq;
+
+	if (ctx < 0)
+		return;
+	while ((irq = plic_read(PLIC_CLAIM(ctx))) != 0) {
+		if (irq < PLIC_NIRQ && handlers[irq].fn)
+			handlers[irq].fn(handlers[irq].arg);
+		else
+			sbi_printf("plic: cpu%d spurious irq %u\n", cpuid(),
+				   irq);
+		plic_write(PLIC_CLAIM(ctx), irq);
+	}
+}
@@ -0,0 +1,22 @@
+#ifndef __PLIC_H__
+#define __PLIC_H__
+
+#include "types.h"
+
+// Platform-Level Interrupt Controller: routes device interrupts to
+// the S-mode external interrupt of chosen harts.
+
+#define PLIC_NIRQ 128 // interrupt sources handled, 1..PLIC_NIRQ-1
+
+typedef void (*plic_handler_t)(void *arg);
+
+int
+plic_init(void);
+
+int
+plic_enable(int irq, int cpu, plic_handler_t handler, void *arg);
+
+void
+plic_intr(void);
+
+#endif /* __PLIC_H__ */
@@ -0,0 +1,335 @@
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "cpu.h"
+#include "kalloc.h"
+#include "klibc.h"
+#include "pmu.h"
+
+// counter_get_info value layout
+#define CTR_INFO_CSR(info)   ((info) & 0xfff)
+#define CTR_INFO_WIDTH(info) ((((info) >> 12) & 0x3f) + 1)
+#define CTR_INFO_FW(info)    ((info) >> 63)
+
+static int has_pmu;
+static int nctr;
+static unsigned long ctr_info[PMU_MAX_COUNTERS];
+
+static const struct {
+	const char *name;
+	uint32 idx;
+} events[PMU_NR_EVENTS] = {
+	[PMU_CYCLES]           = { "cycles",
+		PMU_HW_EVENT(SBI_PMU_HW_CPU_CYCLES) },
+	[PMU_INSTRET]          = { "instret",
+		PMU_HW_EVENT(SBI_PMU_HW_INSTRUCTIONS) },
+	[PMU_BRANCH_MISSES]    = { "branch-misses",
+		PMU_HW_EVENT(SBI_PMU_HW_BRANCH_MISSES) },
+	[PMU_L1D_READ_MISSES]  = { "l1d-read-misses",
+		PMU_CACHE_EVENT(SBI_PMU_HW_CACHE_L1D, SBI_PMU_HW_CACHE_OP_READ,
+				SBI_PMU_HW_CACHE_RESULT_MISS) },
+	[PMU_L1I_READ_MISSES]  = { "l1i-read-misses",
+		PMU_CACHE_EVENT(SBI_PMU_HW_CACHE_L1I, SBI_PMU_HW_CACHE_OP_READ,
+				SBI_PMU_HW_CACHE_RESULT_MISS) },
+	[PMU_DTLB_READ_MISSES] = { "dtlb-read-misses",
+		PMU_CACHE_EVENT(SBI_PMU_HW_CACHE_DTLB, SBI_PMU_HW_CACHE_OP_READ,
+				SBI_PMU_HW_CACHE_RESULT_MISS) },
+	[PMU_ITLB_READ_MISSES] = { "itlb-read-misses",
+		PMU_CACHE_EVENT(SBI_PMU_HW_CACHE_ITLB, SBI_PMU_HW_CACHE_OP_READ,
+				SBI_PMU_HW_CACHE_RESULT_MISS) },
+	[PMU_FW_SET_TIMER]     = { "fw-set-timer",
+		PMU_FW_EVENT(SBI_PMU_FW_SET_TIMER) },
+	[PMU_FW_IPI_SENT]      = { "fw-ipi-sent",
+		PMU_FW_EVENT(SBI_PMU_FW_IPI_SENT) },
+};
+
+// Counter CSRs are encoded in the instruction, so reading one
+// picked at run time takes a switch over cycle..hpmcounter31.
+#define CSR_CASE(n)						\
+	case n:							\
+		asm volatile("csrr %0, %1"			\
+			     : "=r" (x) : "i" (0xc00 + n));	\
+		break;
+
+static uint64
+read_counter_csr(int csr)
+{
+	uint64 x = 0;
+
+	switch (csr - 0xc00) {
+	CSR_CASE(0)  CSR_CASE(1)  CSR_CASE(2)  CSR_CASE(3)
+	CSR_CASE(4)  CSR_CASE(5)  CSR_CASE(6)  CSR_CASE(7)
+	CSR_CASE(8)  CSR_CASE(9)  CSR_CASE(10) CSR_CASE(11)
+	CSR_CASE(12) CSR_CASE(13) CSR_CASE(14) CSR_CASE(15)
+	CSR_CASE(16) CSR_CASE(17) CSR_CASE(18) CSR_CASE(19)
+	CSR_CASE(20) CSR_CASE(21) CSR_CASE(22) CSR_CASE(23)
+	CSR_CASE(24) CSR_CASE(25) CSR_CASE(26) CSR_CASE(27)
+	CSR_CASE(28) CSR_CASE(29) CSR_CASE(30) CSR_CASE(31)
+	}
+	return x;
+}
+
+static uint64
+all_counters(void)
+{
+	return nctr == PMU_MAX_COUNTERS ? ~0UL : (1UL << nctr) - 1;
+}
+
+// Discover the counters; the same set is assumed on every hart.
+void
+pmu_init(void)
+{
+	struct sbiret ret;
+	int i, nfw = 0;
+
+	if (!sbi_probe_extension(SBI_EXT_PMU).value) {
+		sbi_puts("pmu: SBI PMU extension not available\n");
+		return;
+	}
+
+	ret = sbi_pmu_num_counters();
+	nctr = ret.value;
+	if (nctr > PMU_MAX_COUNTERS)
+		nctr = PMU_MAX_COUNTERS;
+
+	for (i = 0; i < nctr; i++) {
+		ret = sbi_pmu_counter_get_info(i);
+		ctr_info[i] = ret.error ? 0 : ret.value;
+		nfw += CTR_INFO_FW(ctr_info[i]);
+	}
+
+	has_pmu = 1;
+	sbi_printf("pmu: %d counters (%d hardware, %d firmware)\n",
+		   nctr, nctr - nfw, nfw);
+}
+
+// Bind a counter on this hart to event_idx and start it counting
+// S-mode and U-mode (not firmware). The value is not cleared: users
+// only ever look at deltas, and cycle and instret keep counting from
+// reset, so stamps taken with rdcycle()/rdinstret() before
+// pmu_cpu_init() stay comparable.
+int
+pmu_counter_open(uint32 event_idx, uint64 event_data)
+{
+	struct pmu_cpu *p = &mycpu()->pmu;
+	struct sbiret ret;
+
+	if (!has_pmu)
+		return -1;
+
+	ret = sbi_pmu_counter_config_matching(0, all_counters() & ~p->used,
+		SBI_PMU_CFG_FLAG_AUTO_START | SBI_PMU_CFG_FLAG_SET_MINH,
+		event_idx, event_data);
+	if (ret.error || ret.value >= (unsigned long)nctr)
+		return -1;
+
+	p->used |= 1UL << ret.value;
+	if (CTR_INFO_FW(ctr_info[ret.value]))
+		p->fw_used |= 1UL << ret.value;
+	return ret.value;
+}
+
+void
+pmu_counter_close(int ctr)
+{
+	struct pmu_cpu *p = &mycpu()->pmu;
+
+	sbi_pmu_counter_stop(ctr, 1, SBI_PMU_STOP_FLAG_RESET);
+	p->used &= ~(1UL << ctr);
+	p->fw_used &= ~(1UL << ctr);
+}
+
+uint64
+pmu_counter_read(int ctr)
+{
+	unsigned long info = ctr_info[ctr];
+
+	if (CTR_INFO_FW(info))
+		return sbi_pmu_counter_fw_read(ctr).value;
+	return read_counter_csr(CTR_INFO_CSR(info));
+}
+
+// Sampling counters, for the profiler. Sscofpmf raises an overflow
+// interrupt only for the programmable hpmcounter3..31, so the fixed
+// cycle and instret counters are left out of the match.
+static uint64
+hpm_counters(void)
+{
+	uint64 mask = 0;
+	int i;
+
+	for (i = 0; i < nctr; i++)
+		if (!CTR_INFO_FW(ctr_info[i]) && CTR_INFO_CSR(ctr_info[i]) >= 0xc03)
+			mask |= 1UL << i;
+	return mask;
+}
+
+// Bind a counter on this hart to event_idx, and have it raise an
+// overflow interrupt (IRQ_PMU_OVF) every period events.
+int
+pmu_sampling_open(uint32 event_idx, uint64 period)
+{
+	struct pmu_cpu *p = &mycpu()->pmu;
+	struct sbiret ret;
+
+	if (!has_pmu)
+		return -1;
+
+	ret = sbi_pmu_counter_config_matching(0, hpm_counters() & ~p->used,
+		SBI_PMU_CFG_FLAG_CLEAR_VALUE | SBI_PMU_CFG_FLAG_SET_MINH,
+		event_idx, 0);
+	if (ret.error || ret.value >= (unsigned long)nctr)
+		return -1;
+
+	p->used |= 1UL << ret.value;
+	pmu_sampling_rearm(ret.value, period);
+	return ret.value;
+}
+
+// (Re)start a sampling counter period events short of overflowing.
+// Starting it also clears its overflow flag.
+void
+pmu_sampling_rearm(int ctr, uint64 period)
+{
+	int w = CTR_INFO_WIDTH(ctr_info[ctr]);
+	uint64 mask = w >= 64 ? ~0UL : (1UL << w) - 1;
+
+	sbi_pmu_counter_stop(ctr, 1, 0); // fails if already stopped
+	sbi_pmu_counter_start(ctr, 1, SBI_PMU_START_FLAG_SET_INIT_VALUE,
+			      -period & mask);
+}
+
+// Has a sampling counter overflowed since it was last (re)armed?
+int
+pmu_sampling_overflowed(int ctr)
+{
+	uint64 x;
+
+	asm volatile("csrr %0, 0xda0" : "=r" (x)); // scountovf
+	return (x >> (CTR_INFO_CSR(ctr_info[ctr]) - 0xc00)) & 1;
+}
+
+void
+pmu_cpu_init(void)
+{
+	struct pmu_cpu *p = &mycpu()->pmu;
+	struct sbiret ret;
+	int ev;
+
+	for (ev = 0; ev < PMU_NR_EVENTS; ev++)
+		p->ctr[ev] = -1;
+	if (!has_pmu)
+		return;
+
+	// Snapshot memory is an SBI v2.0 feature; older firmware
+	// says no and firmware counters are read one call each.
+	p->snapshot = kalloc();
+	if (p->snapshot) {
+		memset(p->snapshot, 0, sizeof(*p->snapshot));
+		ret = sbi_pmu_snapshot_set_shmem((unsigned long)p->snapshot,
+						 0, 0);
+		if (ret.error) {
+			kfree(p->snapshot);
+			p->snapshot = NULL;
+		}
+	}
+
+	for (ev = 0; ev < PMU_NR_EVENTS; ev++)
+		p->ctr[ev] = pmu_counter_open(events[ev].idx, 0);
+}
+
+int
+pmu_available(enum pmu_event ev)
+{
+	return mycpu()->pmu.ctr[ev] >= 0;
+}
+
+uint64
+pmu_read(enum pmu_event ev)
+{
+	int ctr = mycpu()->pmu.ctr[ev];
+
+	return ctr < 0 ? 0 : pmu_counter_read(ctr);
+}
+
+// Read every event. With snapshot memory, all firmware counters
+// cost one stop (which takes the snapshot) and one restart instead
+// of a call each.
+void
+pmu_read_all(struct pmu_sample *s)
+{
+	struct pmu_cpu *p = &mycpu()->pmu;
+	int ev, ctr, snap = 0;
+
+	if (p->snapshot && p->fw_used) {
+		sbi_pmu_counter_stop(0, p->fw_used,
+				     SBI_PMU_STOP_FLAG_TAKE_SNAPSHOT);
+		snap = 1;
+	}
+
+	for (ev = 0; ev < PMU_NR_EVENTS; ev++) {
+		ctr = p->ctr[ev];
+		if (ctr < 0)
+			s->v[ev] = 0;
+		else if (snap && CTR_INFO_FW(ctr_info[ctr]))
+			s->v[ev] = p->snapshot->values[ctr];
+		else
+			s->v[ev] = pmu_counter_read(ctr);
+	}
+
+	if (snap)
+		sbi_pmu_counter_start(0, p->fw_used,
+				      SBI_PMU_START_FLAG_INIT_FROM_SNAPSHOT, 0);
+}
+
+// Scoped measurement:
+//
+//	struct pmu_scope sc;
+//	struct pmu_sample d;
+//
+//	pmu_scope_begin(&sc, "kinit");
+//	kinit();
+//	pmu_scope_end(&sc, &d);
+//
+// The scope must begin and end on the same hart.
+void
+pmu_scope_begin(struct pmu_scope *sc, const char *name)
+{
+	sc->name = name;
+	pmu_read_all(&sc->start);
+}
+
+void
+pmu_scope_end(struct pmu_scope *sc, struct pmu_sample *delta)
+{
+	struct pmu_cpu *p = &mycpu()->pmu;
+	struct pmu_sample end;
+	uint64 mask;
+	int ev, w;
+
+	pmu_read_all(&end);
+	for (ev = 0; ev < PMU_NR_EVENTS; ev++) {
+		delta->v[ev] = end.v[ev] - sc->start.v[ev];
+		if (p->ctr[ev] < 0)
+			continue;
+		w = CTR_INFO_WIDTH(ctr_info[p->ctr[ev]]);
+		mask = w >= 64 ? ~0UL : (1UL << w) - 1;
+		delta->v[ev] &= mask; // counters narrower than 64 bits wrap
+	}
+}
+
+void
+pmu_sample_print(const char *name, const struct pmu_sample *s)
+{
+	char line[256];
+	u32 n;
+	int ev;
+
+	// One sbi_printf() call, so lines from other harts can't
+	// interleave with it.
+	n = sbi_snprintf(line, sizeof(line), "pmu: %s:", name);
+	for (ev = 0; ev < PMU_NR_EVENTS && n < sizeof(line); ev++)
+		if (pmu_available(ev))
+			n += sbi_snprintf(line + n, sizeof(line) - n, " %s %lu",
+					  events[ev].name, s->v[ev]);
+	sbi_printf("%s\n", line);
+}
@@ -0,0 +1,106 @@
+#ifndef __PMU_H__
+#define __PMU_H__
+
+#include "types.h"
+#include "sbi/sbi_ecall_interface.h"
+
+// Performance counters through the SBI PMU extension.
+//
+// pmu_cpu_init() binds each of the events below to a counter on
+// the calling hart (counters are per hart); events the platform
+// cannot count read as 0. Hardware counters are read straight from
+// their CSR, firmware counters with an SBI call or, where the SBI
+// supports it, from the snapshot shared memory.
+
+#define PMU_MAX_COUNTERS 64
+
+enum pmu_event {
+	PMU_CYCLES,
+	PMU_INSTRET,
+	PMU_BRANCH_MISSES,
+	PMU_L1D_READ_MISSES,
+	PMU_L1I_READ_MISSES,
+	PMU_DTLB_READ_MISSES,
+	PMU_ITLB_READ_MISSES,
+	PMU_FW_SET_TIMER,
+	PMU_FW_IPI_SENT,
+	PMU_NR_EVENTS
+};
+
+// SBI PMU event_idx encodings.
+#define PMU_HW_EVENT(code) \
+	((SBI_PMU_EVENT_TYPE_HW << SBI_PMU_EVENT_IDX_TYPE_OFFSET) | (code))
+#define PMU_CACHE_EVENT(cache, op, result)                                \
+	((SBI_PMU_EVENT_TYPE_HW_CACHE << SBI_PMU_EVENT_IDX_TYPE_OFFSET) | \
+	 ((cache) << SBI_PMU_EVENT_HW_CACHE_ID_OFFSET) |                  \
+	 ((op) << SBI_PMU_EVENT_HW_CACHE_OPS_ID_OFFSET) | (result))
+#define PMU_FW_EVENT(code) \
+	((SBI_PMU_EVENT_TYPE_FW << SBI_PMU_EVENT_IDX_TYPE_OFFSET) | (code))
+
+// SBI v2.0 counter snapshot shared memory, one page per hart.
+struct pmu_snapshot {
+	uint64 overflow_bitmap;
+	uint64 values[PMU_MAX_COUNTERS];
+	uint64 reserved[447];
+};
+
+// Per-CPU PMU state, kept in struct cpu.
+struct pmu_cpu {
+	int ctr[PMU_NR_EVENTS];       // counter bound to each event, or -1
+	uint64 used;                  // mask of counters in use
+	uint64 fw_used;               // the firmware ones among them
+	struct pmu_snapshot *snapshot; // or NULL
+};
+
+struct pmu_sample {
+	uint64 v[PMU_NR_EVENTS];
+};
+
+struct pmu_scope {
+	const char *name;
+	struct pmu_sample start;
+};
+
+void
+pmu_init(void);
+
+void
+pmu_cpu_init(void);
+
+int
+pmu_counter_open(uint32 event_idx, uint64 event_data);
+
+uint64
+pmu_counter_read(int ctr);
+
+void
+pmu_counter_close(int ctr);
+
+int
+pmu_sampling_open(uint32 event_idx, uint64 period);
+
+void
+pmu_sampling_rearm(int ctr, uint64 period);
+
+int
+pmu_sampling_overflowed(int ctr);
+
+int
+pmu_available(enum pmu_event ev);
+
+uint64
+pmu_read(enum pmu_event ev);
+
+void
+pmu_read_all(struct pmu_sample *s);
+
+void
+pmu_scope_begin(struct pmu_scope *sc, const char *name);
+
+void
+pmu_scope_end(struct pmu_scope *sc, struct pmu_sample *delta);
+
+void
+pmu_sample_print(const char *name, const struct pmu_sample *s);
+
+#endif /* __PMU_H__ */
@@ -0,0 +1,326 @@
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "memlayout.h"
+#include "cpu.h"
+#include "kalloc.h"
+#include "klibc.h"
+#include "spinlock.h"
+#include "syscall.h"
+#include "thread.h"
+#include "time.h"
+#include "trap.h"
+#include "vm.h"
+#include "proc.h"
+
+// User mode runs at most this long before the other runnable
+// threads on its CPU get a turn, see usertrap().
+#define USER_SLICE_NS (10 * NSEC_PER_MSEC)
+
+static struct proc procs[NPROC];
+static spinlock_t procs_lock = SPIN_LOCK_INITIALIZER;
+
+// An empty address space, with its pid.
+struct proc *
+proc_alloc(void)
+{
+	struct proc *p;
+
+	spin_lock(&procs_lock);
+	for (p = procs; p < &procs[NPROC]; p++) {
+		if (!p->used) {
+			memset(p, 0, sizeof(*p));
+			p->used = 1;
+			p->pid = p - procs + 1;
+			spin_unlock(&procs_lock);
+			p->pagetable = uvm_create();
+			if (!p->pagetable) {
+				proc_free(p);
+				return NULL;
+			}
+			return p;
+		}
+	}
+	spin_unlock(&procs_lock);
+	return NULL;
+}
+
+// Orphan p's children, releasing those that already exited. Called
+// with procs_lock held.
+static void
+reparent(struct proc *p)
+{
+	struct proc *c;
+
+	for (c = procs; c < &procs[NPROC]; c++) {
+		if (!c->used || c->parent != p)
+			continue;
+		c->parent = NULL;
+		if (c->zombie)
+			c->used = 0;
+	}
+}
+
+// Free p and its memory; no thread may be running it.
+void
+proc_free(struct proc *p)
+{
+	uring_free(p);
+	proc_close_files(p);
+	if (p->pagetable)
+		uvm_free(p->pagetable);
+	p->pagetable = NULL;
+	spin_lock(&procs_lock);
+	reparent(p);
+	p->used = 0;
+	spin_unlock(&procs_lock);
+}
+
+// A forked child is done: free its memory and leave its status to
+// the parent, if it still has one.
+static void
+proc_exit(struct proc *p, int status)
+{
+	struct thread *parent = NULL;
+
+	uring_free(p);
+	proc_close_files(p);
+	uvm_free(p->pagetable);
+	p->pagetable = NULL;
+	spin_lock(&procs_lock);
+	reparent(p);
+	if (p->parent) {
+		p->status = status;
+		p->zombie = 1;
+		parent = p->parent->thread;
+	} else {
+		p->used = 0;
+	}
+	spin_unlock(&procs_lock);
+	if (parent)
+		thread_unpark(parent);
+}
+
+// The process the running thread is in, if any.
+struct proc *
+myproc(void)
+{
+	return mythread()->proc;
+}
+
+// Nothing preempts a thread but a timer interrupt of user mode. This
+// one fires every USER_SLICE_NS while a process runs on the thread,
+// so that a process computing without syscalls still lets the
+// thread go.
+static void
+slice_timeout(struct ktimer *t)
+{
+	ktimer_add(t, rdtime() + ns_to_ticks(USER_SLICE_NS), slice_timeout);
+}
+
+// Run p in user mode on the running thread, starting with the
+// registers in regs and fp, until it calls exit(status). Returns
+// status, or -1 if p took a fault or there was no memory. User mode
+// always takes interrupts, even when called with them off.
+static long
+proc_enter(struct proc *p, struct utrapframe *regs,
+	   const struct fpstate *fp)
+{
+	struct thread *t = mythread();
+	int intena = intr_get();
+	struct ktimer slice;
+	long status;
+
+	if (!t->utf && !(t->utf = kalloc()))
+		return -1;
+	memmove(t->utf, regs, sizeof(*regs));
+	thread_fpu_load(fp);
+
+	intr_off();
+	t->proc = p;
+	p->thread = t;
+	vm_switch(p->pagetable);
+	slice_timeout(&slice);
+	status = user_enter(t->utf, &t->ucall);
+	// back from user_return(), on this thread with interrupts off
+	// and kernelvec installed by uservec.S.
+	ktimer_cancel(&slice);
+	mycpu()->utrap = 0;
+	t->proc = NULL;
+	vm_switch(NULL);
+	if (intena)
+		intr_on();
+	return status;
+}
+
+// Run p from its entry point, with its argc and argv.
+long
+proc_run(struct proc *p)
+{
+	struct utrapframe regs;
+	static const struct fpstate fp; // all zero
+
+	memset(&regs, 0, sizeof(regs));
+	regs.epc = p->entry;
+	regs.x[2] = p->sp;
+	regs.x[10] = p->argc;
+	regs.x[11] = p->sp;
+	return proc_enter(p, &regs, &fp);
+}
+
+// Run the program path to exit on this thread, and its status.
+long
+uproc_run(const char *path)
+{
+	char *argv[] = { (char *)path, NULL };
+	struct proc *p = proc_exec(path, argv, 0);
+	long status;
+
+	if (!p)
+		return -1;
+	status = proc_run(p);
+	proc_free(p);
+	return status;
+}
+
+static void
+uproc_main(void *arg)
+{
+	char *path = arg;
+
+	sbi_printf("proc: %s exited with status %ld\n", path,
+		   uproc_run(path));
+}
+
+// Start a process running the program path on CPU cpu.
+struct thread *
+uproc_spawn(const char *path, int cpu)
+{
+	return thread_create(path, uproc_main, (void *)path, cpu);
+}
+
+static void
+fork_main(void *arg)
+{
+	struct proc *p = arg;
+	long status = proc_enter(p, p->fork_regs, &p->fork_fp);
+
+	kfree(p->fork_regs);
+	proc_exit(p, status);
+}
+
+// fork(): a copy of the calling process, in a new thread on this CPU
+// (or the one FORK_CPU() names) that returns 0 from the same syscall,
+// with the same integer and FPU registers. Memory is shared
+// copy-on-write unless flags has FORK_COPY. Called on the slow
+// syscall path, so the trapframe holds every register.
+int
+proc_fork(int flags)
+{
+	struct thread *t = mythread();
+	struct proc *p = t->proc, *np;
+	unsigned int field = (unsigned int)flags >> FORK_CPU_SHIFT;
+	int cpu = field ? field - 1 : t->cpu;
+
+	if ((flags & ((1 << FORK_CPU_SHIFT) - 1) & ~FORK_COPY) ||
+	    cpu < 0 || cpu >= ncpu ||
+	    !__atomic_load_n(&cpus[cpu].online, __ATOMIC_ACQUIRE))
+		return -1;
+	np = proc_alloc();
+	if (!np)
+		return -1;
+	memmove(np->vma, p->vma, sizeof(p->vma));
+	np->nvma = p->nvma;
+	np->brk = p->brk;
+	np->mmap_base = p->mmap_base;
+	proc_dup_files(np, p);
+	np->fork_regs = kalloc();
+	if (!np->fork_regs)
+		goto bad;
+	memmove(np->fork_regs, t->utf, sizeof(*t->utf));
+	np->fork_regs->x[10] = 0;
+	// proc_enter() gave the thread FPU state, so t->fp is valid
+	thread_fpu_sync();
+	np->fork_fp = t->fp;
+	if (uvm_copy(p, np, flags & FORK_COPY) < 0)
+		goto bad;
+	np->parent = p;
+	if (!thread_create("fork", fork_main, np, cpu))
+		goto bad;
+	return np->pid;
+
+bad:
+	if (np->fork_regs)
+		kfree(np->fork_regs);
+	proc_free(np);
+	return -1;
+}
+
+// wait(&status): collect an exited child, blocking until one exits.
+// Returns its pid, or -1 without children.
+int
+proc_wait(uint64 status)
+{
+	struct proc *p = myproc(), *c;
+	int havekids, pid, st;
+
+	for (;;) {
+		havekids = 0;
+		spin_lock(&procs_lock);
+		for (c = procs; c < &procs[NPROC]; c++) {
+			if (!c->used || c->parent != p)
+				continue;
+			havekids = 1;
+			if (c->zombie) {
+				pid = c->pid;
+				st = c->status;
+				c->used = 0;
+				spin_unlock(&procs_lock);
+				if (status && copyout(p, status, &st,
+						      sizeof(st)) < 0)
+					return -1;
+				return pid;
+			}
+		}
+		spin_unlock(&procs_lock);
+		if (!havekids)
+			return -1;
+		thread_park();
+	}
+}
+
+// The heap's vma, which exec() always adds.
+static struct vma *
+heap_vma(struct proc *p)
+{
+	int i;
+
+	for (i = 0; i < p->nvma; i++)
+		if (p->vma[i].flags & VMA_HEAP)
+			break;
+	return &p->vma[i];
+}
+
+// sbrk(n): grow or shrink the heap by n bytes, returning its old
+// end. New heap memory is mapped on first touch.
+uint64
+proc_sbrk(long n)
+{
+	struct proc *p = myproc();
+	struct vma *v = heap_vma(p);
+	uint64 old = p->brk, new = old + n, end = PGROUNDUP(new);
+	int i;
+
+	if (n > 0 && (new < old || end > USTACK_TOP))
+		return -1;
+	if (n < 0 && (new > old || new < v->start))
+		return -1;
+	for (i = 0; i < p->nvma; i++)
+		if (&p->vma[i] != v && v->start < p->vma[i].end &&
+		    p->vma[i].start < end)
+			return -1;
+	if (end < v->end && uvm_unmap(p, end, v->end) < 0)
+		return -1;
+	v->end = end;
+	p->brk = new;
+	return old;
+}
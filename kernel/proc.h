@@ -0,0 +1,139 @@
+#ifndef __PROC_H__
+#define __PROC_H__
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "thread.h"
+#include "vm.h"
+
+// An open file or pipe end of a process. The files are the built-in
+// ones, which live as long as the kernel, so nothing is counted; a
+// pipe counts its open ends.
+struct ofile {
+	struct file *file;      // NULL: fd not a file
+	struct pipe *pipe;      // else a pipe end, or NULL: fd not in use
+	int write;              // which end
+	uint64 off;             // where read() continues in file
+};
+
+// User processes. A process is an address space that a kernel
+// thread runs in user mode with proc_run(); the thread traps back
+// in through uservec.S.
+//
+// fork() gives the child a thread of its own, on the parent's CPU
+// unless it asks for another.
+// A child that exits stays a zombie, holding its status, until its
+// parent wait()s for it or exits itself.
+struct proc {
+	int used;
+	int pid;
+	pagetable_t pagetable;
+	struct vma vma[NVMA];
+	int nvma;
+	uint64 brk;             // end of the heap, see sbrk()
+	uint64 mmap_base;       // mmap() places regions below this
+	struct ofile ofile[NOFILE]; // by fd
+	struct uring *uring;    // disk I/O rings, see uring_setup()
+	uint64 rss;             // resident pages, cached and private
+	uint64 entry;           // where proc_run() starts it
+	uint64 sp;              // initial stack pointer, at argv
+	int argc;
+	struct utrapframe *fork_regs; // registers a fork child starts with
+	struct fpstate fork_fp;       // and FPU registers
+	struct proc *parent;    // NULL once the parent is gone
+	struct thread *thread;  // running it
+	int zombie;             // exited, status not yet collected
+	int status;
+};
+
+struct proc *
+proc_alloc(void);
+
+void
+proc_free(struct proc *p);
+
+struct proc *
+proc_exec(const char *path, char **argv, int eager);
+
+long
+proc_run(struct proc *p);
+
+long
+uproc_run(const char *path);
+
+struct proc *
+myproc(void);
+
+int
+proc_fork(int flags);
+
+int
+proc_wait(uint64 status);
+
+uint64
+proc_sbrk(long n);
+
+uint64
+proc_mmap(uint64 addr, uint64 len, int prot, int flags, int fd,
+	  uint64 off);
+
+int
+proc_open(uint64 path, int flags);
+
+long
+proc_read(int fd, uint64 buf, uint64 n);
+
+int
+proc_close(int fd);
+
+long
+proc_write(int fd, uint64 buf, uint64 n);
+
+int
+proc_pipe(uint64 fds);
+
+long
+proc_splice(int fd_in, int fd_out, uint64 n);
+
+void
+proc_dup_files(struct proc *np, struct proc *p);
+
+void
+proc_close_files(struct proc *p);
+
+struct file *
+proc_file(int fd);
+
+long
+proc_blkread(uint64 buf, uint64 off, uint64 len);
+
+int
+proc_uring_setup(uint64 ring, int flags);
+
+long
+proc_uring_enter(uint64 to_submit, uint64 min_complete, int flags);
+
+int
+proc_uring_register(uint64 addr, uint64 n);
+
+void
+uring_free(struct proc *p);
+
+int
+proc_munmap(uint64 addr, uint64 len);
+
+int
+proc_mprotect(uint64 addr, uint64 len, int prot);
+
+int
+proc_madvise(uint64 addr, uint64 len, int advice);
+
+void
+exec_report(void);
+
+struct thread *
+uproc_spawn(const char *path, int cpu);
+
+#endif /* __PROC_H__ */
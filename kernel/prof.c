@@ -0,0 +1,178 @@
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "cpu.h"
+#include "fmt.h"
+#include "kalloc.h"
+#include "kstack.h"
+#include "time.h"
+#include "trap.h"
+#include "prof.h"
+
+static enum prof_mode mode = PROF_MODE;
+static volatile int sampling;
+
+static const char *mode_names[] = {
+	[PROF_OFF]   = "off",
+	[PROF_TIMER] = "timer",
+	[PROF_PMU]   = "pmu",
+};
+
+// Once, on the boot hart, after pmu_init().
+void
+prof_init(void)
+{
+	if (mode == PROF_OFF)
+		return;
+	if (mode == PROF_PMU && !cpu_has_isa_ext("sscofpmf")) {
+		sbi_puts("prof: no sscofpmf, sampling on the timer instead\n");
+		mode = PROF_TIMER;
+	}
+	sampling = 1;
+	if (mode == PROF_PMU)
+		sbi_printf("prof: sampling every %d cycles\n", PROF_PMU_PERIOD);
+	else
+		sbi_printf("prof: sampling at %d Hz\n", PROF_HZ);
+}
+
+// On each hart, once kalloc() works.
+void
+prof_cpu_start(void)
+{
+	struct prof_cpu *p = &mycpu()->prof;
+	int i;
+
+	p->ctr = -1;
+	if (!sampling)
+		return;
+
+	for (i = 0; i < PROF_BUF_PAGES; i++)
+		p->page[i] = kalloc(); // a NULL page just ends the buffer early
+
+	if (mode == PROF_PMU) {
+		p->ctr = pmu_sampling_open(
+			PMU_HW_EVENT(SBI_PMU_HW_CPU_CYCLES), PROF_PMU_PERIOD);
+		if (p->ctr >= 0) {
+			w_sie(r_sie() | SIE_LCOFIE);
+			return;
+		}
+		sbi_printf("cpu%d: prof: no counter can sample cycles\n",
+			   cpuid());
+	}
+	timer_tick_start(NSEC_PER_SEC / PROF_HZ);
+}
+
+// Stop recording everywhere; the ticks and overflows that still
+// arrive are ignored.
+void
+prof_stop(void)
+{
+	sampling = 0;
+}
+
+static int
+on_stack(uint64 lo, uint64 hi, uint64 fp)
+{
+	return fp > lo && fp <= hi && (fp & 7) == 0;
+}
+
+static void
+prof_record(struct ktrapframe *tf, uint64 pc)
+{
+	struct cpu *c = mycpu();
+	struct prof_cpu *p = &c->prof;
+	struct prof_sample *s;
+	uint64 lo, hi, fp, next, *frame;
+
+	if (!sampling)
+		return;
+	if (p->n == PROF_BUF_PAGES * PROF_PER_PAGE ||
+	    !p->page[p->n / PROF_PER_PAGE]) {
+		p->dropped++;
+		return;
+	}
+	s = &p->page[p->n / PROF_PER_PAGE][p->n % PROF_PER_PAGE];
+	s->pc = pc;
+	s->depth = 0;
+
+	// With -fno-omit-frame-pointer, s0 points just above each
+	// frame's saved {fp, ra} pair. A leaf function saves only fp,
+	// in the ra slot, and its return address is still in ra. A
+	// sample of user code (no tf) gets just its pc.
+	lo = (uint64)c->kstack->stack + 16;
+	hi = (uint64)c->kstack->stack + KSTACK_SIZE;
+	fp = tf ? tf->s0 : 0;
+	while (s->depth < PROF_DEPTH && on_stack(lo, hi, fp)) {
+		frame = (uint64 *)fp - 2;
+		if (s->depth == 0 && on_stack(lo, hi, frame[1])) {
+			s->ra[s->depth++] = tf->ra;
+			next = frame[1];
+		} else {
+			s->ra[s->depth++] = frame[1];
+			next = frame[0];
+		}
+		if (next <= fp)
+			break; // callers' frames are always further up
+		fp = next;
+	}
+	p->n++;
+}
+
+// Timer interrupt: in timer mode, every tick is a sample.
+void
+prof_tick(struct ktrapframe *tf, uint64 pc)
+{
+	if (mode == PROF_TIMER)
+		prof_record(tf, pc);
+}
+
+// Counter overflow interrupt: take a sample and re-arm.
+void
+prof_overflow(struct ktrapframe *tf, uint64 pc)
+{
+	struct prof_cpu *p = &mycpu()->prof;
+
+	w_sip(r_sip() & ~SIP_LCOFIP);
+	if (p->ctr < 0 || !pmu_sampling_overflowed(p->ctr))
+		return;
+	prof_record(tf, pc);
+	pmu_sampling_rearm(p->ctr, PROF_PMU_PERIOD);
+}
+
+// Print every sample, one per line:
+//
+//	prof: <cpu> <pc> <caller> <caller's caller> ...
+//
+// in hex, between "prof: begin" and "prof: end" markers. Call after
+// prof_stop().
+void
+prof_dump(void)
+{
+	struct prof_cpu *p;
+	struct prof_sample *s;
+	char line[160];
+	uint64 i, total = 0, dropped = 0;
+	u32 n;
+	int cpu, d;
+
+	if (mode == PROF_OFF)
+		return;
+
+	sbi_printf("prof: begin %s\n", mode_names[mode]);
+	for (cpu = 0; cpu < ncpu; cpu++) {
+		p = &cpus[cpu].prof;
+		for (i = 0; i < p->n; i++) {
+			s = &p->page[i / PROF_PER_PAGE][i % PROF_PER_PAGE];
+			n = fmt_snprintf(line, sizeof(line), FMT_L("prof: "),
+					 FMT_D(cpu), FMT_L(" "), FMT_X(s->pc));
+			for (d = 0; d < s->depth; d++)
+				n += fmt_snprintf(line + n, sizeof(line) - n,
+						  FMT_L(" "), FMT_X(s->ra[d]));
+			n += fmt_snprintf(line + n, sizeof(line) - n,
+					  FMT_L("\n"));
+			fmt_puts(line, n);
+		}
+		total += p->n;
+		dropped += p->dropped;
+	}
+	sbi_printf("prof: end, %lu samples, %lu dropped\n", total, dropped);
+}
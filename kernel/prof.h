@@ -0,0 +1,69 @@
+#ifndef __PROF_H__
+#define __PROF_H__
+
+#include "types.h"
+#include "riscv.h"
+
+// Sampling profiler. Built with PROF=timer, every hart takes a
+// sample PROF_HZ times a second from a periodic timer tick; with
+// PROF=pmu, every PROF_PMU_PERIOD cycles from a counter overflow
+// interrupt (needs Sscofpmf, falls back to the timer otherwise).
+// Samples stay in per-hart buffers until prof_dump() prints them
+// at shutdown, for tools/kprof.py to turn into a profile.
+enum prof_mode {
+	PROF_OFF,
+	PROF_TIMER,
+	PROF_PMU,
+};
+
+#ifndef PROF_MODE
+#define PROF_MODE PROF_OFF
+#endif
+
+#define PROF_HZ         1000    // timer mode samples per second
+#define PROF_PMU_PERIOD 1000000 // pmu mode cycles between samples
+#define PROF_DEPTH      6       // callers kept per sample
+#define PROF_BUF_PAGES  16      // sample buffer per hart
+
+// The interrupted pc and the return addresses found by walking
+// the frame pointer chain; one cache line.
+struct prof_sample {
+	uint64 pc;
+	uint64 depth;
+	uint64 ra[PROF_DEPTH];
+};
+
+#define PROF_PER_PAGE (PGSIZE / sizeof(struct prof_sample))
+
+// Per-CPU, kept in struct cpu. Only the owning hart appends to it,
+// from its interrupt handler, so no lock is needed; it is only read
+// once sampling has stopped.
+struct prof_cpu {
+	struct prof_sample *page[PROF_BUF_PAGES];
+	uint64 n;       // samples recorded
+	uint64 dropped; // samples lost to a full buffer
+	int ctr;        // pmu mode sampling counter, or -1
+};
+
+// tf is NULL when the interrupt came from user mode.
+struct ktrapframe;
+
+void
+prof_init(void);
+
+void
+prof_cpu_start(void);
+
+void
+prof_stop(void);
+
+void
+prof_tick(struct ktrapframe *tf, uint64 pc);
+
+void
+prof_overflow(struct ktrapframe *tf, uint64 pc);
+
+void
+prof_dump(void);
+
+#endif /* __PROF_H__ */
@@ -0,0 +1,520 @@
+// Quiescent state based RCU, see rcu.h.
+//
+// Grace periods are numbered. Each CPU remembers the number it last
+// saw at a quiescent state (yield(), thread_park(), the idle loop, an
+// interrupt of user code), which on the read side is all it costs; the
+// first quiescent state after a grace period begins also takes it off
+// the period's pending mask, and the last CPU to go ends the period.
+//
+// call_rcu() callbacks wait on rcu.next for the next grace period to
+// begin, which covers all of them at once; one begins as soon as the
+// one in progress, if any, ends. They then wait on rcu.wait, and are
+// finally run by the "rcu" thread rather than by whoever ended the
+// grace period. That thread also IPIs CPUs that hold a grace period
+// up for RCU_KICK_NS: a CPU running user code passes a quiescent state
+// in the interrupt.
+
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "param.h"
+#include "cpu.h"
+#include "cpumask.h"
+#include "spinlock.h"
+#include "thread.h"
+#include "time.h"
+#include "bench.h"
+#include "rcu.h"
+
+#define RCU_KICK_NS (1 * NSEC_PER_MSEC)
+
+struct rcu_list {
+	struct rcu_head *head;
+	struct rcu_head *tail;
+};
+
+static struct {
+	spinlock_t lock;
+	uint64 gp;              // the grace period in progress, or last one
+	uint64 completed;       // the last grace period that ended
+	uint64 gp_start;        // rdtime() when gp began
+	cpumask_t pending;      // CPUs gp still waits for
+	int npending;
+	struct rcu_list next;   // callbacks for the next grace period
+	struct rcu_list wait;   // for gp
+	struct rcu_list done;   // for the rcu thread to run
+	struct thread *thread;
+} rcu = { .lock = SPIN_LOCK_INITIALIZER };
+
+static struct {
+	uint64 gps;             // grace periods
+	uint64 callbacks;       // callbacks run
+	uint64 kicks;           // IPIs to CPUs holding a grace period up
+} rcu_stat;
+
+static void
+list_add(struct rcu_list *l, struct rcu_head *h)
+{
+	h->next = NULL;
+	if (l->tail)
+		l->tail->next = h;
+	else
+		l->head = h;
+	l->tail = h;
+}
+
+// Move all of from to the end of to.
+static void
+list_splice(struct rcu_list *to, struct rcu_list *from)
+{
+	if (!from->head)
+		return;
+	if (to->tail)
+		to->tail->next = from->head;
+	else
+		to->head = from->head;
+	to->tail = from->tail;
+	from->head = from->tail = NULL;
+}
+
+static int
+gp_active(void)
+{
+	return rcu.gp != rcu.completed;
+}
+
+// The grace period in progress is over. Called with rcu.lock held.
+static void
+gp_end(void)
+{
+	rcu.completed = rcu.gp;
+	rcu_stat.gps++;
+	list_splice(&rcu.done, &rcu.wait);
+}
+
+// Begin a grace period for the callbacks on rcu.next. Called with
+// rcu.lock held and no grace period in progress.
+static void
+gp_start(void)
+{
+	struct cpu *c;
+	int cpu;
+
+	list_splice(&rcu.wait, &rcu.next);
+	__atomic_store_n(&rcu.gp, rcu.gp + 1, __ATOMIC_RELAXED);
+	// Pairs with rcu_idle_enter() and rcu_idle_exit(): a CPU we
+	// see idle reads what was unlinked before only after it wakes.
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	cpumask_clear(&rcu.pending);
+	rcu.npending = 0;
+	for (cpu = 0; cpu < ncpu; cpu++) {
+		c = &cpus[cpu];
+		if (__atomic_load_n(&c->online, __ATOMIC_ACQUIRE) &&
+		    !__atomic_load_n(&c->rcu.idle, __ATOMIC_RELAXED)) {
+			cpumask_set_cpu(cpu, &rcu.pending);
+			rcu.npending++;
+		}
+	}
+	rcu.gp_start = rdtime();
+	if (rcu.npending == 0)
+		gp_end();
+}
+
+// Let the rcu thread know about a new grace period or callbacks to
+// run. Called without rcu.lock: thread_unpark() takes a run queue
+// lock, and the scheduler reports quiescent states.
+static void
+wake_thread(void)
+{
+	if (rcu.thread)
+		thread_unpark(rcu.thread);
+}
+
+// This CPU holds no reference from an earlier read-side critical
+// section. Free unless a grace period has begun since the last one.
+void
+rcu_quiescent(void)
+{
+	struct cpu *c = mycpu();
+	uint64 gp = __atomic_load_n(&rcu.gp, __ATOMIC_ACQUIRE);
+	int wake = 0;
+
+	if (c->rcu.gp == gp)
+		return;
+	spin_lock(&rcu.lock);
+	c->rcu.gp = rcu.gp;
+	if (gp_active() && cpumask_test_cpu(c->id, &rcu.pending)) {
+		cpumask_clear_cpu(c->id, &rcu.pending);
+		if (--rcu.npending == 0) {
+			gp_end();
+			if (rcu.next.head)
+				gp_start();
+			wake = 1;
+		}
+	}
+	spin_unlock(&rcu.lock);
+	if (wake)
+		wake_thread();
+}
+
+// The idle loop is about to sleep: until rcu_idle_exit(), new grace
+// periods leave this CPU out, and it leaves the current one.
+void
+rcu_idle_enter(void)
+{
+	__atomic_store_n(&mycpu()->rcu.idle, 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	rcu_quiescent();
+}
+
+void
+rcu_idle_exit(void)
+{
+	__atomic_store_n(&mycpu()->rcu.idle, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+// Call fn(h) after a grace period, on the rcu thread.
+void
+call_rcu(struct rcu_head *h, void (*fn)(struct rcu_head *h))
+{
+	int wake = 0;
+
+	h->fn = fn;
+	spin_lock(&rcu.lock);
+	list_add(&rcu.next, h);
+	if (!gp_active()) {
+		gp_start();
+		wake = 1;
+	}
+	spin_unlock(&rcu.lock);
+	if (wake)
+		wake_thread();
+}
+
+struct rcu_sync {
+	struct rcu_head head;   // must stay first, see sync_done()
+	struct thread *thread;
+	int done;
+};
+
+static void
+sync_done(struct rcu_head *h)
+{
+	struct rcu_sync *s = (struct rcu_sync *)h;
+	struct thread *t = s->thread;
+
+	// s is gone as soon as the waiter sees done.
+	__atomic_store_n(&s->done, 1, __ATOMIC_RELEASE);
+	thread_unpark(t);
+}
+
+// Wait for a grace period, from a thread outside any read-side
+// critical section.
+void
+synchronize_rcu(void)
+{
+	struct rcu_sync s;
+
+	s.thread = mythread();
+	s.done = 0;
+	call_rcu(&s.head, sync_done);
+	while (!__atomic_load_n(&s.done, __ATOMIC_ACQUIRE))
+		thread_park();
+}
+
+// IPI the CPUs that have held grace period gp up for RCU_KICK_NS.
+static void
+kick(uint64 gp)
+{
+	cpumask_t mask;
+
+	spin_lock(&rcu.lock);
+	if (rcu.gp != gp || !gp_active() ||
+	    rdtime() - rcu.gp_start < ns_to_ticks(RCU_KICK_NS)) {
+		spin_unlock(&rcu.lock);
+		return;
+	}
+	mask = rcu.pending;
+	rcu_stat.kicks += rcu.npending;
+	spin_unlock(&rcu.lock);
+	cpumask_clear_cpu(cpuid(), &mask);
+	sbi_send_ipi_cpumask(&mask);
+}
+
+static void
+kick_timeout(struct ktimer *t)
+{
+	thread_unpark(rcu.thread);
+}
+
+// The rcu thread: runs callbacks whose grace period is over, and
+// watches the one in progress.
+static void
+rcu_main(void *arg)
+{
+	struct rcu_head *h, *next;
+	struct ktimer timer;
+	uint64 gp, n;
+
+	for (;;) {
+		spin_lock(&rcu.lock);
+		h = rcu.done.head;
+		rcu.done.head = rcu.done.tail = NULL;
+		gp = gp_active() ? rcu.gp : 0;
+		spin_unlock(&rcu.lock);
+		if (h) {
+			for (n = 0; h; h = next, n++) {
+				next = h->next;
+				h->fn(h);
+			}
+			__atomic_fetch_add(&rcu_stat.callbacks, n,
+					   __ATOMIC_RELAXED);
+			continue;
+		}
+		if (!gp) {
+			thread_park();
+			continue;
+		}
+		ktimer_add(&timer, rdtime() + ns_to_ticks(RCU_KICK_NS),
+			   kick_timeout);
+		thread_park();
+		ktimer_cancel(&timer);
+		kick(gp);
+	}
+}
+
+// Once the other harts are up: start the rcu thread, on the last CPU
+// that came online.
+void
+rcu_init(void)
+{
+	int cpu;
+
+	for (cpu = ncpu - 1; cpu >= 0 && !rcu.thread; cpu--)
+		rcu.thread = thread_create("rcu", rcu_main, NULL, cpu);
+	if (!rcu.thread)
+		sbi_panic("rcu_init: no thread");
+}
+
+void
+rcu_report(void)
+{
+	sbi_printf("rcu: %lu grace periods, %lu callbacks, %lu cpus kicked\n",
+		   rcu_stat.gps, rcu_stat.callbacks, rcu_stat.kicks);
+}
+
+// A read-mostly hash table, looked up under a spinlock or under RCU
+// by the boot hart, which also replaces one entry in HT_UPDATE, and
+// by readers on up to HT_CPUS - 1 more harts at the same time.
+#define HT_CPUS    8
+#define HT_BUCKETS 64
+#define HT_KEYS    256
+#define HT_NODES   (HT_KEYS + 256) // spares wait out grace periods
+#define HT_UPDATE  64
+#define HT_BATCH   64              // reader lookups between yields
+#define HT_LEASE_NS (1 * NSEC_PER_MSEC)
+
+struct ht_node {
+	struct rcu_head rcu;   // must stay first, see ht_node_rcu_free()
+	uint64 key;
+	uint64 val;
+	struct ht_node *next;
+};
+
+static struct ht_node ht_pool[HT_NODES];
+static struct ht_node *ht_free;
+static spinlock_t ht_free_lock = SPIN_LOCK_INITIALIZER;
+static struct ht_node *ht[HT_BUCKETS];
+static spinlock_t ht_lock = SPIN_LOCK_INITIALIZER;
+static int ht_use_rcu;
+static uint64 ht_lease;        // rdtime() until which readers look up
+static struct thread *ht_readers[HT_CPUS];
+static int ht_barrier_passed;
+
+static struct ht_node *
+ht_node_alloc(void)
+{
+	struct ht_node *n;
+
+	spin_lock(&ht_free_lock);
+	n = ht_free;
+	if (n)
+		ht_free = n->next;
+	spin_unlock(&ht_free_lock);
+	return n;
+}
+
+static void
+ht_node_free(struct ht_node *n)
+{
+	spin_lock(&ht_free_lock);
+	n->next = ht_free;
+	ht_free = n;
+	spin_unlock(&ht_free_lock);
+}
+
+static void
+ht_node_rcu_free(struct rcu_head *h)
+{
+	ht_node_free((struct ht_node *)h);
+}
+
+static uint64
+ht_lookup(uint64 key)
+{
+	struct ht_node *n;
+	uint64 val = 0;
+
+	if (__atomic_load_n(&ht_use_rcu, __ATOMIC_RELAXED)) {
+		rcu_read_lock();
+		for (n = rcu_dereference(ht[key % HT_BUCKETS]); n;
+		     n = rcu_dereference(n->next)) {
+			if (n->key == key) {
+				val = n->val;
+				break;
+			}
+		}
+		rcu_read_unlock();
+		return val;
+	}
+	spin_lock(&ht_lock);
+	for (n = ht[key % HT_BUCKETS]; n; n = n->next) {
+		if (n->key == key) {
+			val = n->val;
+			break;
+		}
+	}
+	spin_unlock(&ht_lock);
+	return val;
+}
+
+// Replace key's node with a copy holding the next value.
+static int
+ht_update(uint64 key)
+{
+	struct ht_node **pp, *old, *n;
+
+	while (!(n = ht_node_alloc())) {
+		if (!ht_use_rcu)
+			return -1;
+		rcu_quiescent(); // wait for the rcu thread to free some
+	}
+	spin_lock(&ht_lock);
+	for (pp = &ht[key % HT_BUCKETS]; (old = *pp); pp = &old->next)
+		if (old->key == key)
+			break;
+	if (!old) {
+		spin_unlock(&ht_lock);
+		ht_node_free(n);
+		return -1;
+	}
+	n->key = key;
+	n->val = old->val + 1;
+	n->next = old->next;
+	rcu_assign_pointer(*pp, n);
+	spin_unlock(&ht_lock);
+	if (ht_use_rcu)
+		call_rcu(&old->rcu, ht_node_rcu_free);
+	else
+		ht_node_free(old);
+	return 0;
+}
+
+static void
+ht_reader(void *arg)
+{
+	uint64 key = (uint64)arg, i;
+
+	for (;;) {
+		while (rdtime() < __atomic_load_n(&ht_lease,
+						  __ATOMIC_RELAXED)) {
+			for (i = 0; i < HT_BATCH; i++) {
+				ht_lookup(key);
+				key = (key * 5 + 1) % HT_KEYS;
+			}
+			rcu_quiescent();
+			yield();
+		}
+		thread_park();
+	}
+}
+
+static void
+ht_barrier_done(struct rcu_head *h)
+{
+	__atomic_store_n(&ht_barrier_passed, 1, __ATOMIC_RELEASE);
+}
+
+// Wait out lookups begun before a change of ht_use_rcu, and nodes
+// still to be freed: callbacks run in the order they were queued.
+static void
+ht_barrier(void)
+{
+	static struct rcu_head h;
+
+	ht_barrier_passed = 0;
+	call_rcu(&h, ht_barrier_done);
+	while (!__atomic_load_n(&ht_barrier_passed, __ATOMIC_ACQUIRE))
+		rcu_quiescent();
+}
+
+static int
+ht_bench(int use_rcu, uint64 iters)
+{
+	static int ready;
+	uint64 key = 0, i;
+	int cpu;
+
+	if (ncpu < 2)
+		return -1;
+	if (!ready) {
+		for (i = 0; i < HT_NODES; i++) {
+			if (i < HT_KEYS) {
+				ht_pool[i].key = i;
+				ht_pool[i].val = 1;
+				ht_pool[i].next = ht[i % HT_BUCKETS];
+				ht[i % HT_BUCKETS] = &ht_pool[i];
+			} else {
+				ht_node_free(&ht_pool[i]);
+			}
+		}
+		ht_use_rcu = use_rcu;
+		ready = 1;
+	}
+	if (use_rcu != ht_use_rcu) {
+		__atomic_store_n(&ht_use_rcu, use_rcu, __ATOMIC_RELAXED);
+		ht_barrier();
+	}
+	__atomic_store_n(&ht_lease, rdtime() + ns_to_ticks(HT_LEASE_NS),
+			 __ATOMIC_RELAXED);
+	for (cpu = 1; cpu < ncpu && cpu < HT_CPUS; cpu++) {
+		if (!ht_readers[cpu])
+			ht_readers[cpu] = thread_create("ht_reader",
+							ht_reader,
+							(void *)(uint64)cpu,
+							cpu);
+		if (ht_readers[cpu])
+			thread_unpark(ht_readers[cpu]);
+	}
+	for (i = 0; i < iters; i++) {
+		if (i % HT_UPDATE == HT_UPDATE - 1) {
+			if (ht_update(key) < 0)
+				return -1;
+			rcu_quiescent();
+		} else if (!ht_lookup(key)) {
+			return -1;
+		}
+		key = (key * 5 + 1) % HT_KEYS;
+	}
+	return 0;
+}
+
+BENCH(hash_lock, 1024)
+{
+	return ht_bench(0, iters);
+}
+
+BENCH(hash_rcu, 1024)
+{
+	return ht_bench(1, iters);
+}
@@ -0,0 +1,79 @@
+#ifndef __RCU_H__
+#define __RCU_H__
+
+#include "types.h"
+
+// Read-copy-update, quiescent state based. Kernel threads are never
+// preempted, so readers need no marker at all: between
+// rcu_read_lock() and rcu_read_unlock() a thread must only not yield,
+// park or return to user mode. Those are the quiescent states: once a
+// CPU has passed one, it holds no reference it took before.
+//
+//	rcu_read_lock();
+//	for (n = rcu_dereference(b->head); n; n = rcu_dereference(n->next))
+//		if (n->key == key)
+//			break;
+//	...
+//	rcu_read_unlock();
+//
+// Updaters keep out of each other's way with a lock of their own,
+// publish with rcu_assign_pointer(), and free what they unlinked with
+// call_rcu() or after synchronize_rcu(): a grace period later, when
+// every CPU that was busy when it began has passed a quiescent state.
+// CPUs in the idle loop are not waited for. Kernel loops that run a
+// long time without yielding call rcu_quiescent() now and then.
+
+struct rcu_head {
+	struct rcu_head *next;
+	void (*fn)(struct rcu_head *h);
+};
+
+// Per-CPU state, kept in struct cpu.
+struct rcu_cpu {
+	uint64 gp;          // grace period last seen at a quiescent state
+	int idle;           // in the idle loop, see rcu_idle_enter()
+};
+
+// Compile-time fences only: they keep the compiler from moving the
+// reader's loads out of the critical section.
+static inline void
+rcu_read_lock(void)
+{
+	asm volatile("" ::: "memory");
+}
+
+static inline void
+rcu_read_unlock(void)
+{
+	asm volatile("" ::: "memory");
+}
+
+// RVWMO orders a load after the load its address came from, so
+// following a published pointer needs no fence.
+#define rcu_dereference(p) __atomic_load_n(&(p), __ATOMIC_RELAXED)
+
+// Publish v, initialized, to readers.
+#define rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+void
+rcu_init(void);
+
+void
+rcu_quiescent(void);
+
+void
+rcu_idle_enter(void);
+
+void
+rcu_idle_exit(void);
+
+void
+call_rcu(struct rcu_head *h, void (*fn)(struct rcu_head *h));
+
+void
+synchronize_rcu(void);
+
+void
+rcu_report(void);
+
+#endif /* __RCU_H__ */
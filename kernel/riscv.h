@@ -3,12 +3,39 @@
 
 #include "types.h"
 
+#define PGSIZE 4096 // bytes per page
+#define PGSHIFT 12  // bits of offset within a page
+#define HPGSIZE (1L << 21) // bytes per megapage, a level-1 leaf PTE
+
+#define PGROUNDUP(sz)  (((sz)+PGSIZE-1) & ~(PGSIZE-1))
+#define PGROUNDDOWN(a) (((a)) & ~(PGSIZE-1))
+
+// Supervisor Status Register, sstatus
+#define SSTATUS_FS (3L << 13)  // FPU state: Off, Initial, Clean, Dirty
+#define SSTATUS_FS_CLEAN (2L << 13)
+#define SSTATUS_FS_DIRTY (3L << 13)
+#define SSTATUS_VS (3L << 9)   // vector state, same encoding as FS
+#define SSTATUS_SPP (1L << 8)  // Previous mode, 1=Supervisor, 0=User
+#define SSTATUS_SPIE (1L << 5) // Supervisor Previous Interrupt Enable
+#define SSTATUS_SIE (1L << 1)  // S-mode interrupts
+
 // Supervisor Interrupt Enable
-#define SSTATUS_SIE (1L << 1) // S-mode interrupts
+#define SIE_LCOFIE (1L << 13) // counter overflow (Sscofpmf)
 #define SIE_SEIE (1L << 9)    // external
 #define SIE_STIE (1L << 5)    // timer
 #define SIE_SSIE (1L << 1)    // software
 
+// Supervisor Cause, interrupt bit and interrupt numbers
+#define SCAUSE_INTR (1UL << 63)
+#define IRQ_S_SOFT   1
+#define IRQ_S_TIMER  5
+#define IRQ_S_EXT    9
+#define IRQ_PMU_OVF  13
+#define EXC_U_ECALL  8 // exception: environment call from U-mode
+#define EXC_INST_PAGE_FAULT  12
+#define EXC_LOAD_PAGE_FAULT  13
+#define EXC_STORE_PAGE_FAULT 15
+
 static inline uint64
 r_tp()
 {
@@ -17,6 +44,28 @@ r_tp()
 	return x;
 }
 
+static inline void
+w_tp(uint64 x)
+{
+	asm volatile("mv tp, %0" : : "r" (x));
+}
+
+// Supervisor Scratch register, holds this hart's struct cpu
+// pointer so a trap entry can recover it.
+static inline void
+w_sscratch(uint64 x)
+{
+	asm volatile("csrw sscratch, %0" : : "r" (x));
+}
+
+static inline uint64
+r_sscratch()
+{
+	uint64 x;
+	asm volatile("csrr %0, sscratch" : "=r" (x));
+	return x;
+}
+
 static inline uint64
 rdtime()
 {
@@ -25,6 +74,50 @@ rdtime()
 	return x;
 }
 
+// Cycle and retired instruction counters; readable from S-mode
+// since OpenSBI leaves mcounteren.CY and .IR set.
+static inline uint64
+rdcycle()
+{
+	uint64 x;
+	asm volatile("rdcycle %0" : "=r" (x));
+	return x;
+}
+
+static inline uint64
+rdinstret()
+{
+	uint64 x;
+	asm volatile("rdinstret %0" : "=r" (x));
+	return x;
+}
+
+// Supervisor timer compare (Sstc extension). Spelled as a CSR
+// number for assemblers that predate Sstc.
+static inline void
+w_stimecmp(uint64 x)
+{
+	asm volatile("csrw 0x14d, %0" : : "r" (x));
+}
+
+// Supervisor Interrupt Pending
+#define SIP_LCOFIP (1L << 13) // counter overflow
+#define SIP_SSIP (1L << 1)    // software
+
+static inline uint64
+r_sip()
+{
+	uint64 x;
+	asm volatile("csrr %0, sip" : "=r" (x) );
+	return x;
+}
+
+static inline void
+w_sip(uint64 x)
+{
+	asm volatile("csrw sip, %0" : : "r" (x));
+}
+
 static inline uint64
 r_sie()
 {
@@ -39,6 +132,17 @@ w_sie(uint64 x)
 	asm volatile("csrw sie, %0" : : "r" (x));
 }
 
+// Counters user mode may read: bit 0 cycle, 1 time, 2 instret.
+#define SCOUNTEREN_CY (1L << 0)
+#define SCOUNTEREN_TM (1L << 1)
+#define SCOUNTEREN_IR (1L << 2)
+
+static inline void
+w_scounteren(uint64 x)
+{
+	asm volatile("csrw scounteren, %0" : : "r" (x));
+}
+
 // Supervisor trap-vector base address
 // Low two bits are mode.
 static inline void
@@ -69,4 +173,131 @@ r_sstatus()
   return x;
 }
 
+// Supervisor exception program counter, holds the
+// instruction address to which a return from exception will go.
+static inline void
+w_sepc(uint64 x)
+{
+  asm volatile("csrw sepc, %0" : : "r" (x));
+}
+
+static inline uint64
+r_sepc()
+{
+  uint64 x;
+  asm volatile("csrr %0, sepc" : "=r" (x) );
+  return x;
+}
+
+// Supervisor Trap Cause
+static inline uint64
+r_scause()
+{
+  uint64 x;
+  asm volatile("csrr %0, scause" : "=r" (x) );
+  return x;
+}
+
+// Supervisor Trap Value
+static inline uint64
+r_stval()
+{
+  uint64 x;
+  asm volatile("csrr %0, stval" : "=r" (x) );
+  return x;
+}
+
+// enable device interrupts
+static inline void
+intr_on()
+{
+  w_sstatus(r_sstatus() | SSTATUS_SIE);
+}
+
+// disable device interrupts
+static inline void
+intr_off()
+{
+  w_sstatus(r_sstatus() & ~SSTATUS_SIE);
+}
+
+// are device interrupts enabled?
+static inline int
+intr_get()
+{
+  uint64 x = r_sstatus();
+  return (x & SSTATUS_SIE) != 0;
+}
+
+// use riscv's sv39 page table scheme.
+#define SATP_SV39 (8L << 60)
+
+#define MAKE_SATP(pagetable) (SATP_SV39 | (((uint64)(pagetable)) >> 12))
+
+// supervisor address translation and protection;
+// holds the address of the page table.
+static inline void
+w_satp(uint64 x)
+{
+  asm volatile("csrw satp, %0" : : "r" (x));
+}
+
+static inline uint64
+r_satp()
+{
+  uint64 x;
+  asm volatile("csrr %0, satp" : "=r" (x) );
+  return x;
+}
+
+// flush the TLB.
+static inline void
+sfence_vma()
+{
+  // the zero, zero means flush all TLB entries.
+  asm volatile("sfence.vma zero, zero");
+}
+
+// flush the TLB entries of one virtual page.
+static inline void
+sfence_vma_page(uint64 va)
+{
+  asm volatile("sfence.vma %0, zero" : : "r" (va));
+}
+
+typedef uint64 pte_t;
+typedef uint64 *pagetable_t; // 512 PTEs
+
+#define PTE_V (1L << 0) // valid
+#define PTE_R (1L << 1)
+#define PTE_W (1L << 2)
+#define PTE_X (1L << 3)
+#define PTE_U (1L << 4) // user can access
+#define PTE_G (1L << 5) // global, in every address space
+#define PTE_A (1L << 6) // accessed
+#define PTE_D (1L << 7) // dirty
+#define PTE_RSW0 (1L << 8) // bits 8, 9 are left to software
+#define PTE_RSW1 (1L << 9)
+
+// shift a physical address to the right place for a PTE.
+#define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
+
+#define PTE2PA(pte) (((pte) >> 10) << 12)
+
+#define PTE_FLAGS(pte) ((pte) & 0x3FF)
+
+// a valid PTE that maps memory rather than pointing at a table.
+#define PTE_LEAF(pte) ((pte) & (PTE_R | PTE_W | PTE_X))
+
+// extract the three 9-bit page table indices from a virtual address.
+#define PXMASK          0x1FF // 9 bits
+#define PXSHIFT(level)  (12+(9*(level)))
+#define PX(level, va) ((((uint64) (va)) >> PXSHIFT(level)) & PXMASK)
+
+// one beyond the highest possible virtual address.
+// MAXVA is actually one bit less than the max allowed by
+// Sv39, to avoid having to sign-extend virtual addresses
+// that have the high bit set.
+#define MAXVA (1L << (9 + 9 + 9 + 12 - 1))
+
 #endif /* __RISCV_H__ */
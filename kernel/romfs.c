@@ -0,0 +1,58 @@
+// Read-only files built into the kernel image, until there is a
+// disk filesystem. Reads still go through the page cache, with a
+// copy out of the image standing in for the disk read.
+
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "klibc.h"
+#include "file.h"
+
+#define ROMFS_MAX 16
+
+struct romfs_entry {
+	const char *name;
+	const uint8 *data;
+	uint64 size;
+};
+
+// in romfs_data.S
+extern struct romfs_entry romfs_table[];
+
+static struct file files[ROMFS_MAX];
+static int nfiles;
+
+static int
+romfs_fill(struct file *f, void *dst, uint64 off, uint64 n)
+{
+	const struct romfs_entry *e = f->priv;
+
+	memcpy(dst, e->data + off, n);
+	return 0;
+}
+
+void
+romfs_init(void)
+{
+	struct romfs_entry *e;
+	struct file *f;
+
+	for (e = romfs_table; e->name && nfiles < ROMFS_MAX; e++) {
+		f = &files[nfiles++];
+		f->name = e->name;
+		f->size = e->size;
+		f->fill = romfs_fill;
+		f->priv = e;
+		f->lock = __SPIN_LOCK_UNLOCKED;
+	}
+}
+
+struct file *
+romfs_lookup(const char *name)
+{
+	int i;
+
+	for (i = 0; i < nfiles; i++)
+		if (strcmp(files[i].name, name) == 0)
+			return &files[i];
+	return NULL;
+}
@@ -1,6 +1,10 @@
 #include "klibc.h"
 #include "sbi/sbi.h"
 #include "sbi/sbi_ecall_interface.h"
+#include "cpu.h"
+#include "trace.h"
+
+TRACE_EVENT(sbi_ecall, TRACE_SBI, 'i', "ext", "fid", "arg0");
 
 
 /* Inspired by this example:
@@ -13,6 +17,9 @@ struct sbiret sbi_ecall(int ext,  int fid,  unsigned long arg0,
 {
 	struct sbiret ret;
 
+	cpu_stat_inc(CPU_STAT_ECALL);
+	trace(sbi_ecall, ext, fid, arg0);
+
 	register unsigned long a0 asm ("a0") = (unsigned long)(arg0);
 	register unsigned long a1 asm ("a1") = (unsigned long)(arg1);
 	register unsigned long a2 asm ("a2") = (unsigned long)(arg2);
@@ -96,6 +103,35 @@ sbi_hart_start(unsigned long hartid,
 			hartid, start_addr, opaque, 0, 0, 0);
 }
 
+inline struct sbiret
+sbi_hart_get_status(unsigned long hartid)
+{
+	return sbi_ecall(SBI_EXT_HSM, SBI_EXT_HSM_HART_GET_STATUS,
+			hartid, 0, 0, 0, 0, 0);
+}
+
+inline struct sbiret
+sbi_hart_suspend(uint32_t suspend_type,
+		unsigned long resume_addr, unsigned long opaque)
+{
+	return sbi_ecall(SBI_EXT_HSM, SBI_EXT_HSM_HART_SUSPEND,
+			suspend_type, resume_addr, opaque, 0, 0, 0);
+}
+
+inline struct sbiret
+sbi_send_ipi(unsigned long hart_mask, unsigned long hart_mask_base)
+{
+	return sbi_ecall(SBI_EXT_IPI, SBI_EXT_IPI_SEND_IPI,
+			hart_mask, hart_mask_base, 0, 0, 0, 0);
+}
+
+inline struct sbiret
+sbi_remote_fence_i(unsigned long hart_mask, unsigned long hart_mask_base)
+{
+	return sbi_ecall(SBI_EXT_RFENCE, SBI_EXT_RFENCE_REMOTE_FENCE_I,
+			hart_mask, hart_mask_base, 0, 0, 0, 0);
+}
+
 inline struct sbiret
 sbi_system_reset(uint32_t reset_type, uint32_t reset_reason)
 {
@@ -179,3 +215,61 @@ sbi_timer_set_timer(uint64_t stime_value)
 	return sbi_ecall(SBI_EXT_TIME, SBI_EXT_TIME_SET_TIMER,
 			stime_value, 0, 0, 0, 0, 0);
 }
+
+inline struct sbiret
+sbi_pmu_num_counters(void)
+{
+	return sbi_ecall(SBI_EXT_PMU, SBI_EXT_PMU_NUM_COUNTERS,
+			0, 0, 0, 0, 0, 0);
+}
+
+inline struct sbiret
+sbi_pmu_counter_get_info(unsigned long counter_idx)
+{
+	return sbi_ecall(SBI_EXT_PMU, SBI_EXT_PMU_COUNTER_GET_INFO,
+			counter_idx, 0, 0, 0, 0, 0);
+}
+
+inline struct sbiret
+sbi_pmu_counter_config_matching(unsigned long counter_idx_base,
+		unsigned long counter_idx_mask, unsigned long config_flags,
+		unsigned long event_idx, uint64_t event_data)
+{
+	return sbi_ecall(SBI_EXT_PMU, SBI_EXT_PMU_COUNTER_CFG_MATCH,
+			counter_idx_base, counter_idx_mask, config_flags,
+			event_idx, event_data, 0);
+}
+
+inline struct sbiret
+sbi_pmu_counter_start(unsigned long counter_idx_base,
+		unsigned long counter_idx_mask, unsigned long start_flags,
+		uint64_t initial_value)
+{
+	return sbi_ecall(SBI_EXT_PMU, SBI_EXT_PMU_COUNTER_START,
+			counter_idx_base, counter_idx_mask, start_flags,
+			initial_value, 0, 0);
+}
+
+inline struct sbiret
+sbi_pmu_counter_stop(unsigned long counter_idx_base,
+		unsigned long counter_idx_mask, unsigned long stop_flags)
+{
+	return sbi_ecall(SBI_EXT_PMU, SBI_EXT_PMU_COUNTER_STOP,
+			counter_idx_base, counter_idx_mask, stop_flags,
+			0, 0, 0);
+}
+
+inline struct sbiret
+sbi_pmu_counter_fw_read(unsigned long counter_idx)
+{
+	return sbi_ecall(SBI_EXT_PMU, SBI_EXT_PMU_COUNTER_FW_READ,
+			counter_idx, 0, 0, 0, 0, 0);
+}
+
+inline struct sbiret
+sbi_pmu_snapshot_set_shmem(unsigned long shmem_phys_lo,
+		unsigned long shmem_phys_hi, unsigned long flags)
+{
+	return sbi_ecall(SBI_EXT_PMU, SBI_EXT_PMU_SNAPSHOT_SET_SHMEM,
+			shmem_phys_lo, shmem_phys_hi, flags, 0, 0, 0);
+}
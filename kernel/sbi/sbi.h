@@ -5,6 +5,8 @@
 #include "sbi_ecall_interface.h"
 #include "sbi_console.h"
 
+struct cpumask;
+
 /* Inspired by this example:
  * https://github.com/riscv-software-src/opensbi/blob/v1.5/firmware/payloads/test_main.c
  */
@@ -47,6 +49,19 @@ struct sbiret
 sbi_hart_start(unsigned long hartid,
 		unsigned long start_addr, unsigned long opaque);
 
+struct sbiret
+sbi_hart_get_status(unsigned long hartid);
+
+struct sbiret
+sbi_hart_suspend(uint32_t suspend_type,
+		unsigned long resume_addr, unsigned long opaque);
+
+struct sbiret
+sbi_send_ipi(unsigned long hart_mask, unsigned long hart_mask_base);
+
+struct sbiret
+sbi_remote_fence_i(unsigned long hart_mask, unsigned long hart_mask_base);
+
 struct sbiret
 sbi_system_reset(uint32_t reset_type, uint32_t reset_reason);
 
@@ -77,6 +92,33 @@ sbi_legacy_set_timer(uint64_t stime_value);
 struct sbiret
 sbi_timer_set_timer(uint64_t stime_value);
 
+struct sbiret
+sbi_pmu_num_counters(void);
+
+struct sbiret
+sbi_pmu_counter_get_info(unsigned long counter_idx);
+
+struct sbiret
+sbi_pmu_counter_config_matching(unsigned long counter_idx_base,
+		unsigned long counter_idx_mask, unsigned long config_flags,
+		unsigned long event_idx, uint64_t event_data);
+
+struct sbiret
+sbi_pmu_counter_start(unsigned long counter_idx_base,
+		unsigned long counter_idx_mask, unsigned long start_flags,
+		uint64_t initial_value);
+
+struct sbiret
+sbi_pmu_counter_stop(unsigned long counter_idx_base,
+		unsigned long counter_idx_mask, unsigned long stop_flags);
+
+struct sbiret
+sbi_pmu_counter_fw_read(unsigned long counter_idx);
+
+struct sbiret
+sbi_pmu_snapshot_set_shmem(unsigned long shmem_phys_lo,
+		unsigned long shmem_phys_hi, unsigned long flags);
+
 /* Other SBI related tasks */
 
 void
@@ -88,6 +130,12 @@ sbi_identify(void);
 void
 sbi_non_boot_hart_start(unsigned long entry_point);
 
+void
+sbi_send_ipi_cpumask(const struct cpumask *mask);
+
+void
+sbi_remote_fence_i_cpumask(const struct cpumask *mask);
+
 void __attribute__((noreturn))
 sbi_hart_hang(void);
 
@@ -47,6 +47,9 @@ int __printf(2, 3) sbi_sprintf(char *out, const char *format, ...);
 
 int __printf(3, 4) sbi_snprintf(char *out, u32 out_sz, const char *format, ...);
 
+int sbi_snprintf_argv(char *out, u32 out_sz, const char *format,
+		      const unsigned long *args);
+
 int __printf(1, 2) sbi_printf(const char *format, ...);
 
 void __printf(1, 2) __attribute__((noreturn)) sbi_panic(const char *format, ...);
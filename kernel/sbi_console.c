@@ -392,6 +392,42 @@ literal:
 	return pc;
 }
 
+/*
+ * Same engine over arguments captured earlier as an array of unsigned
+ * longs (see klog.c). Every conversion print() supports takes an
+ * integer or a pointer, and on rv64 each of those fits one array slot,
+ * so va_arg() just becomes "next slot, converted to the asked type".
+ */
+#undef va_arg
+#define va_arg(args, type) ((type)(*(args)++))
+
+static int print_argv(char **out, u32 *out_len, const char *format,
+		      const unsigned long *args)
+{
+	bool flags_done;
+	int width, flags, pc = 0;
+	char type, scr[2];
+
+	if (!out_len || *out_len)
+		**out = '\0';
+
+	for (; *format != 0; ++format) {
+		width = flags = 0;
+		if (*format == '%') {
+			PRINTF_FORMAT();
+		} else {
+literal:
+			printc(out, out_len, *format, flags);
+			++pc;
+		}
+	}
+
+	return pc;
+}
+
+#undef va_arg
+#define va_arg __builtin_va_arg
+
 int sbi_sprintf(char *out, const char *format, ...)
 {
 	va_list args;
@@ -423,6 +459,16 @@ int sbi_snprintf(char *out, u32 out_sz, const char *format, ...)
 	return retval;
 }
 
+int sbi_snprintf_argv(char *out, u32 out_sz, const char *format,
+		      const unsigned long *args)
+{
+	if (!out && out_sz != 0)
+		sbi_panic("sbi_snprintf_argv called with NULL output string and "
+			  "output size is not zero\n");
+
+	return print_argv(&out, &out_sz, format, args);
+}
+
 int sbi_printf(const char *format, ...)
 {
 	va_list args;
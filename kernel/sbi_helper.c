@@ -1,5 +1,6 @@
 #include "sbi/sbi.h"
 #include "cpu.h"
+#include "cpumask.h"
 #include "param.h"
 
 enum sbi_imp {
@@ -83,7 +84,7 @@ sbi_identify(void)
 void
 sbi_non_boot_hart_start(unsigned long entry_point)
 {
-	int i, hart_id;
+	int i;
 	const char *warn, *error;
 	struct sbiret ret;
 
@@ -96,15 +97,54 @@ sbi_non_boot_hart_start(unsigned long entry_point)
 		return;
 	}
 
-	hart_id = hartid();
-	// XXX: look at devicetree data instead of attempting start
-	// on non-existent harts...
-	for (i = 0; i < NCPU; i++) {
-		if (hart_id == i) continue;
-		ret = sbi_hart_start(i, entry_point, 0);
+	// cpu_enumerate() found these harts in the devicetree; each
+	// one gets its struct cpu as opaque, entry.S takes it from a1.
+	for (i = 1; i < ncpu; i++) {
+		boot_stamp_cpu(&cpus[i], "hart_start", rdtime());
+		ret = sbi_hart_start(cpus[i].hartid, entry_point,
+				     (unsigned long)&cpus[i]);
+		if (ret.error)
+			sbi_printf("sbi: error: hart %d failed to start (%ld)\n",
+				   cpus[i].hartid, (long)ret.error);
 	}
 }
 
+// The IPI and RFENCE calls take a 64-bit hart mask relative to
+// hart_mask_base, so a CPU mask turns into one call per window of
+// BITS_PER_LONG consecutive hart ids.
+static void
+sbi_cpumask_call(const cpumask_t *mask,
+		 struct sbiret (*fn)(unsigned long, unsigned long))
+{
+	unsigned long hmask = 0, hbase = 0, h;
+	int cpu;
+
+	for_each_cpu(cpu, mask) {
+		h = cpus[cpu].hartid;
+		if (hmask && (h < hbase || h >= hbase + BITS_PER_LONG)) {
+			fn(hmask, hbase);
+			hmask = 0;
+		}
+		if (!hmask)
+			hbase = h;
+		hmask |= 1UL << (h - hbase);
+	}
+	if (hmask)
+		fn(hmask, hbase);
+}
+
+void
+sbi_send_ipi_cpumask(const cpumask_t *mask)
+{
+	sbi_cpumask_call(mask, sbi_send_ipi);
+}
+
+void
+sbi_remote_fence_i_cpumask(const cpumask_t *mask)
+{
+	sbi_cpumask_call(mask, sbi_remote_fence_i);
+}
+
 void __attribute__((noreturn))
 sbi_hart_hang(void)
 {
@@ -116,11 +156,14 @@ sbi_hart_hang(void)
 struct sbiret
 sbi_set_timer(uint64_t stime_value)
 {
-	struct sbiret ret;
+	static int has_time_ext = -1;
+	struct sbiret ret = { 0, 0 };
 	long r;
 
-	ret = sbi_probe_extension(SBI_EXT_TIME);
-	if (!ret.value) {
+	// Probe once: this sits on the timer programming path.
+	if (has_time_ext < 0)
+		has_time_ext = sbi_probe_extension(SBI_EXT_TIME).value != 0;
+	if (!has_time_ext) {
 		if ((r = sbi_legacy_set_timer(stime_value)))
 			ret.error = r;
 		ret.value = 0;
@@ -9,11 +9,14 @@ holding(spinlock_t *lock);
 void
 spin_lock(spinlock_t *lock)
 {
+	push_off(); // disable interrupts to avoid deadlock.
+
 	// On RISC-V, sync_lock_test_and_set turns into an atomic swap:
 	//   a5 = 1
 	//   s1 = &lock->locked
 	//   amoswap.w.aq a5, a5, (s1)
-	while (__sync_lock_test_and_set(&lock->locked, 1) != 0);
+	while (__sync_lock_test_and_set(&lock->locked, 1) != 0)
+		cpu_stat_inc(CPU_STAT_LOCK_SPIN);
 	// Tell the C compiler and the processor to not move loads or stores
 	// past this point, to ensure that the critical section's memory
 	// references happen strictly after the lock is acquired.
@@ -22,6 +25,7 @@ spin_lock(spinlock_t *lock)
 
 	// Record info about lock acquisition for holding() and debugging.
 	lock->cpu = cpuid();
+	cpu_stat_inc(CPU_STAT_LOCK_ACQUIRE);
 }
 
 void
@@ -48,6 +52,8 @@ spin_unlock(spinlock_t *lock)
 	//   s1 = &lock->locked
 	//   amoswap.w zero, zero, (s1)
 	__sync_lock_release(&lock->locked);
+
+	pop_off();
 }
 
 unsigned int
@@ -57,3 +63,31 @@ holding(spinlock_t *lock)
 	r = (lock->locked && lock->cpu == cpuid());
 	return r;
 }
+
+// push_off/pop_off are like intr_off()/intr_on() except that they are
+// matched: it takes two pop_off()s to undo two push_off()s. Also, if
+// interrupts are initially off, then push_off, pop_off leaves them off.
+void
+push_off(void)
+{
+	int old = intr_get();
+
+	intr_off();
+	if (mycpu()->noff == 0)
+		mycpu()->intena = old;
+	mycpu()->noff += 1;
+}
+
+void
+pop_off(void)
+{
+	struct cpu *c = mycpu();
+
+	if (intr_get())
+		sbi_panic("pop_off - interruptible");
+	if (c->noff < 1)
+		sbi_panic("pop_off");
+	c->noff -= 1;
+	if (c->noff == 0 && c->intena)
+		intr_on();
+}
@@ -21,4 +21,10 @@ spin_lock(spinlock_t *lock);
 void
 spin_unlock(spinlock_t *lock);
 
+void
+push_off(void);
+
+void
+pop_off(void);
+
 #endif /* __SPINLOCK__ */
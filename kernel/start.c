@@ -4,14 +4,36 @@
 #include "klibc.h"
 #include "cpu.h"
 #include "uart.h"
-
-// entry.S needs one stack per CPU.
-__attribute__ ((aligned (16))) char stack0[4096 * NCPU];
+#include "kstack.h"
+#include "kalloc.h"
+#include "fdt.h"
+#include "time.h"
+#include "cpuidle.h"
+#include "prof.h"
+#include "trap.h"
+#include "trace.h"
+#include "bench.h"
+#include "bootprof.h"
+#include "klog.h"
+#include "thread.h"
+#include "plic.h"
+#include "iodemo.h"
+#include "pipe.h"
+#include "rcu.h"
+#include "workq.h"
+#include "proc.h"
+#include "vm.h"
+#include "file.h"
 
 int boot_hart_id = -1;
 
 extern void _entry(void);
 
+// How long start() waits for the other harts to come online.
+#define SMP_ONLINE_TIMEOUT_MS 1000
+// How long the other harts get to run before shutdown.
+#define SHUTDOWN_DELAY_MS     3000
+
 #define OSNAME  "Kleinix"
 #define VERSION "0.0.1"
 #define BANNER                                    \
@@ -23,43 +45,147 @@ extern void _entry(void);
 	"|_| \\_)\\_)_____)_|_| |_|_(_/ \\_)\n\n"
 
 
-// entry.S: boot cpu jumps here in supervisor mode on stack0.
+// entry.S: boot cpu jumps here in supervisor mode on its kstack,
+// with the rdtime() stamps of _entry and of the end of .bss clear.
 void
-start()
+start(int hart_id, uint64 dtb, uint64 entry_time, uint64 bss_time)
 {
-	int hart_id = hartid();
+	// Cost of the boot path, up to boot_done(); see make boot-icount.
+	uint64 boot_instret = rdinstret();
+	uint64 boot_cycles = rdcycle();
+	uint64 boot_ticks = rdtime();
+	struct pmu_scope sc;
+	struct pmu_sample d;
+	uint64 t0;
+	int online;
 
+	cpu_init(hart_id);
+	boot_stamp_cpu(mycpu(), "firmware", entry_time);
+	boot_stamp_cpu(mycpu(), "bss", bss_time);
+	boot_stamp("cpu_init");
+	trapinithart();
 	sbi_console_init();
 	uart_init();
+	boot_stamp("console");
 
 	sbi_puts(BANNER);
 	sbi_printf("%s v%s\n", OSNAME, VERSION);
 	sbi_identify();
-	cpu_identify(hart_id);
-	sbi_printf("cpu%d: Hello World!!!\n", hart_id);
+	cpu_identify(cpuid());
+	sbi_printf("cpu%d: Hello World!!!\n", cpuid());
 	sbi_printf("boot_hart_id: %d\n", boot_hart_id);
+	boot_stamp("banner");
+
+	if (fdt_init(dtb) < 0)
+		sbi_puts("fdt: no devicetree, using defaults\n");
+	time_init();
+	boot_stamp("time");
+	cpuidle_init();
+	boot_stamp("cpuidle");
+	kmem_detect();
+	cpu_enumerate();
+	tstack_init();
+	boot_stamp("cpus");
+	kinit();
+	boot_stamp("kinit");
+	kvminit();
+	kvminithart();
+	romfs_init();
+	boot_stamp("vm");
+	plic_init();
+	pmu_init();
+	pmu_cpu_init();
+	boot_stamp("pmu");
+	trace_cpu_init();
+	trace_enable(trace_parse(TRACE_DEFAULT));
+	prof_init();
+	prof_cpu_start();
+	klog_cpu_init();
+	thread_cpu_init();
+	intr_on();
+	boot_stamp("debug");
+
+	t0 = ktime_get();
+	pmu_scope_begin(&sc, "smp boot");
 	sbi_non_boot_hart_start((unsigned long)_entry);
+	online = smp_wait_online(SMP_ONLINE_TIMEOUT_MS * NSEC_PER_MSEC);
+	pmu_scope_end(&sc, &d);
+	sbi_printf("smp: %d/%d cpus online in %lu us\n",
+		   online, ncpu, (ktime_get() - t0) / NSEC_PER_USEC);
+	pmu_sample_print(sc.name, &d);
+	boot_stamp("smp");
+	rcu_init();
+	boot_done();
+	sbi_printf("boot: instret=%lu cycles=%lu ticks=%lu\n",
+		   rdinstret() - boot_instret, rdcycle() - boot_cycles,
+		   rdtime() - boot_ticks);
+	boot_report();
+	if (bench_enabled()) {
+		bench_run_all();
+		klog_flush();
+		sbi_system_shutdown();
+	}
 	uart_puts("uart device is initialized!\n");
+	iodemo_start();
+	if (uproc_spawn("init", cpuid()))
+		yield(); // let it run to exit
+	else
+		sbi_printf("proc: cannot start init\n");
+	exec_report();
+	uproc_run("forkbench");
+	uproc_run("thpbench");
+	uproc_run("mmapbench");
+	uproc_run("futexbench");
+	uproc_run("uringbench");
+	uproc_run("pipebench");
+	iodemo_storm();
 	// assert boot_hart_id > 0;
 	// report boot_hart_id
 	// main();
-	sbi_printf("cpu%d: system will shutdown in a few secs...\n", hart_id);
-	delay(10);
+	sbi_printf("cpu%d: system will shutdown in a few secs...\n", cpuid());
+	msleep(SHUTDOWN_DELAY_MS);
+	prof_stop();
+	trace_enable(0);
+	klog_flush();
+	sbi_printf("cpu stats: ecalls %lu, locks %lu, lock spins %lu, "
+		   "interrupts %lu\n",
+		   cpu_stat_sum(CPU_STAT_ECALL),
+		   cpu_stat_sum(CPU_STAT_LOCK_ACQUIRE),
+		   cpu_stat_sum(CPU_STAT_LOCK_SPIN),
+		   cpu_stat_sum(CPU_STAT_INTR));
+	iodemo_report();
+	syscall_report();
+	vm_report();
+	pipe_report();
+	rcu_report();
+	work_report();
+	kstack_report();
+	cpuidle_report();
+	trace_dump();
+	prof_dump();
 	sbi_system_shutdown();
 	sbi_hart_hang(); // unreachable
 }
 
-// non-boot cpu(s) jump here in supervisor mode on stack0.
+// non-boot cpu(s) jump here in supervisor mode on their kstack,
+// with their struct cpu and the rdtime() stamp of _entry.
 void
-non_boot_start(void)
+non_boot_start(int hart_id, struct cpu *c, uint64 entry_time)
 {
-	int hart_id = hartid();
-	cpu_identify(hart_id);
-	sbi_printf("cpu%d: non_boot_cpu\n", hart_id);
-	if (hart_id == 1) { // testing enabling interrups in 1 core
-		intrsinit();
-		timerinit();
-	}
-	delay(10);       // not reached for now
-	sbi_hart_hang(); // not reached for now
+	cpu_init(hart_id);
+	boot_stamp_cpu(c, "entry", entry_time);
+	boot_stamp("cpu_init");
+	trapinithart();
+	kvminithart();
+	pmu_cpu_init();
+	boot_stamp("pmu");
+	trace_cpu_init();
+	prof_cpu_start();
+	klog_cpu_init();
+	thread_cpu_init();
+	boot_stamp("debug");
+	cpu_identify(cpuid());
+	sbi_printf("cpu%d: non_boot_cpu (hart %d)\n", cpuid(), hart_id);
+	boot_done();
+	cpu_idle();
 }
@@ -0,0 +1,263 @@
+// System calls, entered from uservec.S. The jump table keeps
+// dispatch to one bounds check (done in uservec.S) and an indirect
+// call; each handler takes the six argument registers as they are.
+
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "cpu.h"
+#include "kalloc.h"
+#include "thread.h"
+#include "trap.h"
+#include "bench.h"
+#include "proc.h"
+#include "futex.h"
+#include "vm.h"
+#include "syscall.h"
+
+#define SYSCALL_ARGS                                                   \
+	uint64 a0, uint64 a1, uint64 a2, uint64 a3, uint64 a4, uint64 a5
+
+static uint64
+sys_exit(SYSCALL_ARGS)
+{
+	intr_off(); // proc_enter() expects them off
+	user_return(&mythread()->ucall, a0);
+}
+
+static uint64
+sys_getpid(SYSCALL_ARGS)
+{
+	return myproc()->pid;
+}
+
+// write(fd, buf, n): the console, as fd 1 and 2, or a pipe.
+static uint64
+sys_write(SYSCALL_ARGS)
+{
+	char buf[128];
+	uint64 done, m;
+
+	if (a0 != 1 && a0 != 2)
+		return proc_write(a0, a1, a2);
+	for (done = 0; done < a2; done += m) {
+		m = a2 - done < sizeof(buf) ? a2 - done : sizeof(buf);
+		if (copyin(myproc(), buf, a1 + done, m) < 0)
+			return done ? done : -1;
+		sbi_nputs(buf, m);
+	}
+	return done;
+}
+
+static uint64
+sys_yield(SYSCALL_ARGS)
+{
+	yield();
+	return 0;
+}
+
+static uint64
+sys_sbrk(SYSCALL_ARGS)
+{
+	return proc_sbrk(a0);
+}
+
+// freemem(): bytes of free physical memory, to measure what an
+// operation costs in memory from user mode.
+static uint64
+sys_freemem(SYSCALL_ARGS)
+{
+	return kmem_free_pages() * PGSIZE;
+}
+
+static uint64
+sys_mmap(SYSCALL_ARGS)
+{
+	return proc_mmap(a0, a1, a2, a3, a4, a5);
+}
+
+static uint64
+sys_munmap(SYSCALL_ARGS)
+{
+	return proc_munmap(a0, a1);
+}
+
+static uint64
+sys_mprotect(SYSCALL_ARGS)
+{
+	return proc_mprotect(a0, a1, a2);
+}
+
+static uint64
+sys_madvise(SYSCALL_ARGS)
+{
+	return proc_madvise(a0, a1, a2);
+}
+
+static uint64
+sys_open(SYSCALL_ARGS)
+{
+	return proc_open(a0, a1);
+}
+
+static uint64
+sys_read(SYSCALL_ARGS)
+{
+	return proc_read(a0, a1, a2);
+}
+
+static uint64
+sys_close(SYSCALL_ARGS)
+{
+	return proc_close(a0);
+}
+
+static uint64
+sys_futex(SYSCALL_ARGS)
+{
+	return futex_op(a0, a1, a2, a3, a4);
+}
+
+static uint64
+sys_blkread(SYSCALL_ARGS)
+{
+	return proc_blkread(a0, a1, a2);
+}
+
+static uint64
+sys_uring_setup(SYSCALL_ARGS)
+{
+	return proc_uring_setup(a0, a1);
+}
+
+static uint64
+sys_uring_enter(SYSCALL_ARGS)
+{
+	return proc_uring_enter(a0, a1, a2);
+}
+
+static uint64
+sys_uring_register(SYSCALL_ARGS)
+{
+	return proc_uring_register(a0, a1);
+}
+
+static uint64
+sys_pipe(SYSCALL_ARGS)
+{
+	return proc_pipe(a0);
+}
+
+static uint64
+sys_splice(SYSCALL_ARGS)
+{
+	return proc_splice(a0, a1, a2);
+}
+
+static uint64
+sys_fork(SYSCALL_ARGS)
+{
+	return proc_fork(a0);
+}
+
+static uint64
+sys_wait(SYSCALL_ARGS)
+{
+	return proc_wait(a0);
+}
+
+// Handlers run with interrupts on: copyin(), copyout() and
+// uvm_copy() take time in proportion to what user mode asks for.
+// Those marked quick take a bounded few dozen instructions and skip
+// the two CSR writes.
+static const struct {
+	uint64 (*fn)(SYSCALL_ARGS);
+	const char *name;
+	int quick;
+} syscalls[NSYSCALL] = {
+	[SYS_exit]           = { sys_exit, "exit" },
+	[SYS_getpid]         = { sys_getpid, "getpid", 1 },
+	[SYS_write]          = { sys_write, "write" },
+	[SYS_yield]          = { sys_yield, "yield" },
+	[SYS_sbrk]           = { sys_sbrk, "sbrk" },
+	[SYS_freemem]        = { sys_freemem, "freemem", 1 },
+	[SYS_mmap]           = { sys_mmap, "mmap" },
+	[SYS_munmap]         = { sys_munmap, "munmap" },
+	[SYS_mprotect]       = { sys_mprotect, "mprotect" },
+	[SYS_madvise]        = { sys_madvise, "madvise" },
+	[SYS_open]           = { sys_open, "open" },
+	[SYS_read]           = { sys_read, "read" },
+	[SYS_close]          = { sys_close, "close" },
+	[SYS_futex]          = { sys_futex, "futex" },
+	[SYS_blkread]        = { sys_blkread, "blkread" },
+	[SYS_uring_setup]    = { sys_uring_setup, "uring_setup" },
+	[SYS_uring_enter]    = { sys_uring_enter, "uring_enter" },
+	[SYS_uring_register] = { sys_uring_register, "uring_register" },
+	[SYS_pipe]           = { sys_pipe, "pipe" },
+	[SYS_splice]         = { sys_splice, "splice" },
+	[SYS_fork]           = { sys_fork, "fork" },
+	[SYS_wait]           = { sys_wait, "wait" },
+};
+
+// Called by uservec.S, or usertrap() for the syscalls off the fast
+// path, with interrupts off and the user's argument registers,
+// nr < NSYSCALL. Returns with interrupts off. The counters are this
+// CPU's own, and the thread cannot migrate while the handler runs;
+// its cycles include the interrupts it took.
+uint64
+syscall_dispatch(uint64 a0, uint64 a1, uint64 a2, uint64 a3, uint64 a4,
+		 uint64 a5, uint64 a6, uint64 nr)
+{
+	struct syscall_stat *st = &mycpu()->sysstat[nr];
+	uint64 t0 = rdcycle(), ret;
+
+	st->count++;
+	if (syscalls[nr].quick) {
+		ret = syscalls[nr].fn(a0, a1, a2, a3, a4, a5);
+	} else {
+		intr_on();
+		ret = syscalls[nr].fn(a0, a1, a2, a3, a4, a5);
+		intr_off();
+	}
+	st->cycles += rdcycle() - t0;
+	return ret;
+}
+
+// Calls and average handler cycles of each syscall, over all CPUs.
+// exit never returns, so it shows calls only.
+void
+syscall_report(void)
+{
+	uint64 count, cycles;
+	int nr, cpu;
+
+	for (nr = 0; nr < NSYSCALL; nr++) {
+		count = cycles = 0;
+		for (cpu = 0; cpu < ncpu; cpu++) {
+			count += cpus[cpu].sysstat[nr].count;
+			cycles += cpus[cpu].sysstat[nr].cycles;
+		}
+		if (count && cycles)
+			sbi_printf("syscall: %s calls=%lu avg_cycles=%lu\n",
+				   syscalls[nr].name, count, cycles / count);
+		else if (count)
+			sbi_printf("syscall: %s calls=%lu\n",
+				   syscalls[nr].name, count);
+	}
+}
+
+// Null syscall round trip: U-mode ecall, uservec.S fast path,
+// sys_getpid() and sret, iters times, plus one proc_run() entry and
+// exit per sample. user/ubench.c is loaded once and rerun.
+BENCH(syscall_null, 64)
+{
+	static struct proc *p;
+	static char n[24], *argv[] = { "ubench", n, NULL };
+
+	if (!p) {
+		sbi_snprintf(n, sizeof(n), "%lu", iters);
+		p = proc_exec("ubench", argv, 0);
+		if (!p)
+			return -1;
+	}
+	return proc_run(p) == 0 ? 0 : -1;
+}
@@ -0,0 +1,59 @@
+#ifndef __SYSCALL_H__
+#define __SYSCALL_H__
+
+// System call numbers, passed in a7; arguments in a0..a5, the result
+// comes back in a0 and every other register is preserved. Shared
+// with uservec.S and user/usys.S.
+//
+// Those below NSYSCALL_FAST take the fast path in uservec.S, which
+// leaves s0..s11 unsaved. The rest need the whole register file in
+// the trapframe (fork copies it) and go through usertrap().
+#define SYS_exit           0
+#define SYS_getpid         1
+#define SYS_write          2
+#define SYS_yield          3
+#define SYS_sbrk           4
+#define SYS_freemem        5
+#define SYS_mmap           6
+#define SYS_munmap         7
+#define SYS_mprotect       8
+#define SYS_madvise        9
+#define SYS_open           10
+#define SYS_read           11
+#define SYS_close          12
+#define SYS_futex          13
+#define SYS_blkread        14
+#define SYS_uring_setup    15
+#define SYS_uring_enter    16
+#define SYS_uring_register 17
+#define SYS_pipe           18
+#define SYS_splice         19
+#define NSYSCALL_FAST      20
+#define SYS_fork           20
+#define SYS_wait           21
+#define NSYSCALL           22
+
+// fork() flags
+#define FORK_COPY      1 // copy every page now instead of on write
+// run the child on CPU c, not this one; other bits are invalid
+#define FORK_CPU_SHIFT 8
+#define FORK_CPU(c)    (((c) + 1) << FORK_CPU_SHIFT)
+
+#ifndef __ASSEMBLER__
+#include "types.h"
+
+// Per-CPU counters, kept in struct cpu.
+struct syscall_stat {
+	uint64 count;
+	uint64 cycles; // total time in the handler
+};
+
+uint64
+syscall_dispatch(uint64 a0, uint64 a1, uint64 a2, uint64 a3, uint64 a4,
+		 uint64 a5, uint64 a6, uint64 nr);
+
+void
+syscall_report(void);
+#endif
+
+#endif /* __SYSCALL_H__ */
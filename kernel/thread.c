@@ -0,0 +1,413 @@
+#include "sbi/sbi.h"
+#include "param.h"
+#include "riscv.h"
+#include "cpu.h"
+#include "kalloc.h"
+#include "kstack.h"
+#include "cpuidle.h"
+#include "spinlock.h"
+#include "klibc.h"
+#include "bench.h"
+#include "vm.h"
+#include "proc.h"
+#include "rcu.h"
+#include "thread.h"
+
+static struct thread threads[NTHREAD];
+static spinlock_t threads_lock = SPIN_LOCK_INITIALIZER;
+
+static void
+runq_push(struct runq *q, struct thread *t)
+{
+	t->next = NULL;
+	if (q->tail)
+		q->tail->next = t;
+	else
+		q->head = t;
+	q->tail = t;
+}
+
+static struct thread *
+runq_pop(struct runq *q)
+{
+	struct thread *t = q->head;
+
+	if (t) {
+		q->head = t->next;
+		if (!q->head)
+			q->tail = NULL;
+	}
+	return t;
+}
+
+static struct thread *
+thread_alloc(void)
+{
+	struct thread *t;
+
+	spin_lock(&threads_lock);
+	for (t = threads; t < &threads[NTHREAD]; t++) {
+		if (t->state == THREAD_UNUSED) {
+			memset(t, 0, sizeof(*t));
+			t->state = THREAD_BLOCKED; // not runnable yet
+			spin_unlock(&threads_lock);
+			return t;
+		}
+	}
+	spin_unlock(&threads_lock);
+	return NULL;
+}
+
+// Free a thread that exited on this CPU, once off its stack.
+static void
+reap(struct cpu *c)
+{
+	struct thread *t = c->zombie;
+
+	if (!t)
+		return;
+	c->zombie = NULL;
+	if (c->fpu_owner == t)
+		c->fpu_owner = NULL;
+	tstack_free(t->stack);
+	if (t->utf)
+		kfree(t->utf);
+	__atomic_store_n(&t->state, THREAD_UNUSED, __ATOMIC_RELEASE);
+}
+
+// Lazy FPU switch: save prev's registers only if it wrote them
+// (FS Dirty), and load next's only if it has some saved and the
+// registers do not already hold them. A thread that never touches
+// the FPU costs one csrr.
+static void
+fpu_switch(struct cpu *c, struct thread *prev, struct thread *next)
+{
+	uint64 s = r_sstatus();
+
+	if ((s & SSTATUS_FS) == SSTATUS_FS_DIRTY) {
+		fpu_save(&prev->fp);
+		prev->fp_saved = 1;
+		c->fpu_owner = prev;
+		s = (s & ~SSTATUS_FS) | SSTATUS_FS_CLEAN;
+		w_sstatus(s);
+	}
+	if (next->fp_saved && c->fpu_owner != next) {
+		fpu_restore(&next->fp);
+		c->fpu_owner = next;
+		w_sstatus((r_sstatus() & ~SSTATUS_FS) | SSTATUS_FS_CLEAN);
+	}
+}
+
+// Bring the running thread's fp up to date with the FPU registers,
+// e.g. for fork() to copy them.
+void
+thread_fpu_sync(void)
+{
+	struct cpu *c;
+	struct thread *t;
+	uint64 s;
+
+	push_off();
+	c = mycpu();
+	t = c->thread;
+	s = r_sstatus();
+	if ((s & SSTATUS_FS) == SSTATUS_FS_DIRTY) {
+		fpu_save(&t->fp);
+		t->fp_saved = 1;
+		c->fpu_owner = t;
+		w_sstatus((s & ~SSTATUS_FS) | SSTATUS_FS_CLEAN);
+	}
+	pop_off();
+}
+
+// Give the running thread the FPU registers in fp, e.g. a process's
+// first ones before it enters user mode: whatever the registers held
+// belongs to some other thread.
+void
+thread_fpu_load(const struct fpstate *fp)
+{
+	struct cpu *c;
+	struct thread *t;
+
+	push_off();
+	c = mycpu();
+	t = c->thread;
+	memmove(&t->fp, fp, sizeof(t->fp));
+	t->fp_saved = 1;
+	fpu_restore(&t->fp);
+	c->fpu_owner = t;
+	w_sstatus((r_sstatus() & ~SSTATUS_FS) | SSTATUS_FS_CLEAN);
+	pop_off();
+}
+
+// Switch from the running thread to next, whose state the caller
+// has not set yet. Called with c->runq.lock held; returns with it
+// held again when some thread on this CPU switches back. The
+// push_off() depth and saved interrupt state belong to the thread,
+// not the CPU, so they travel with it.
+static void
+switch_to(struct cpu *c, struct thread *next)
+{
+	struct thread *prev = c->thread;
+	int noff, intena;
+
+	next->state = THREAD_RUNNING;
+	if (next == prev)
+		return;
+	fpu_switch(c, prev, next);
+	if (next->proc != prev->proc)
+		vm_switch(next->proc ? next->proc->pagetable : NULL);
+	noff = c->noff;
+	intena = c->intena;
+	c->thread = next;
+	swtch(&prev->ctx, &next->ctx);
+	// Threads don't migrate: c is still this hart's struct cpu.
+	c->noff = noff;
+	c->intena = intena;
+	reap(c);
+}
+
+// Run the next runnable thread, or the idle thread if there is
+// none. The caller has already queued or parked the current one.
+static void
+schedule(struct cpu *c)
+{
+	struct thread *next = runq_pop(&c->runq);
+
+	switch_to(c, next ? next : c->idle_thread);
+}
+
+// First code a new thread runs, coming out of swtch() in
+// switch_to() with the run queue lock held.
+static void
+thread_start(void)
+{
+	struct cpu *c = mycpu();
+	struct thread *t = c->thread;
+
+	c->noff = 1; // the run queue lock
+	c->intena = 1;
+	reap(c);
+	spin_unlock(&c->runq.lock);
+	t->fn(t->arg);
+	thread_exit();
+}
+
+static struct thread *
+thread_new(const char *name, void (*fn)(void *), void *arg, int cpu)
+{
+	struct thread *t = thread_alloc();
+
+	if (!t)
+		return NULL;
+	t->stack = tstack_alloc();
+	if (!t->stack) {
+		__atomic_store_n(&t->state, THREAD_UNUSED, __ATOMIC_RELEASE);
+		return NULL;
+	}
+	t->name = name;
+	t->cpu = cpu;
+	t->fn = fn;
+	t->arg = arg;
+	t->ctx.ra = (uint64)thread_start;
+	t->ctx.sp = (uint64)(t->stack->stack + TSTACK_SIZE);
+	return t;
+}
+
+static void
+idle_main(void *arg)
+{
+	cpu_idle();
+}
+
+// On each hart, once kalloc() works: make the running call chain
+// this CPU's first thread. Kernel code does not use the vector unit,
+// so VS is turned off; a stray vector instruction then traps rather
+// than leave state no switch saves.
+void
+thread_cpu_init(void)
+{
+	struct cpu *c = mycpu();
+	struct thread *t = thread_alloc();
+
+	if (!t)
+		sbi_panic("thread_cpu_init: no thread slots");
+	t->name = c->id == 0 ? "main" : "idle";
+	t->cpu = c->id;
+	t->state = THREAD_RUNNING;
+	c->thread = t;
+	c->idle_thread = t;
+	if (c->id == 0) {
+		c->idle_thread = thread_new("idle", idle_main, NULL, 0);
+		if (!c->idle_thread)
+			sbi_panic("thread_cpu_init: no idle thread");
+		c->idle_thread->state = THREAD_RUNNABLE;
+	}
+	w_sstatus(r_sstatus() & ~SSTATUS_VS);
+}
+
+// Create a thread running fn(arg) on CPU cpu, with interrupts on and
+// a guarded TSTACK_SIZE stack. It returns from fn into thread_exit().
+struct thread *
+thread_create(const char *name, void (*fn)(void *), void *arg, int cpu)
+{
+	struct thread *t;
+
+	if (cpu < 0 || cpu >= ncpu || !cpus[cpu].thread)
+		return NULL;
+	t = thread_new(name, fn, arg, cpu);
+	if (t)
+		thread_unpark(t); // new threads start out blocked
+	return t;
+}
+
+struct thread *
+mythread(void)
+{
+	struct thread *t;
+
+	push_off();
+	t = mycpu()->thread;
+	pop_off();
+	return t;
+}
+
+// Let the other runnable threads on this CPU run first. A no-op if
+// there are none, but for RCU a quiescent state either way, as is
+// thread_park().
+void
+yield(void)
+{
+	struct cpu *c;
+
+	spin_lock(&mycpu()->runq.lock);
+	c = mycpu();
+	if (c->runq.head) {
+		if (c->thread != c->idle_thread) {
+			c->thread->state = THREAD_RUNNABLE;
+			runq_push(&c->runq, c->thread);
+		}
+		schedule(c);
+	}
+	spin_unlock(&c->runq.lock);
+	rcu_quiescent();
+}
+
+// Block until thread_unpark(), or return at once if one came since
+// the last thread_park(). Wakeups do not count: several unparks
+// before a park release one park.
+void
+thread_park(void)
+{
+	struct cpu *c;
+	struct thread *t;
+
+	spin_lock(&mycpu()->runq.lock);
+	c = mycpu();
+	t = c->thread;
+	if (t == c->idle_thread)
+		sbi_panic("thread_park: cpu%d idle thread", c->id);
+	if (t->wakeup) {
+		t->wakeup = 0;
+	} else {
+		t->state = THREAD_BLOCKED;
+		schedule(c);
+	}
+	spin_unlock(&c->runq.lock);
+	rcu_quiescent();
+}
+
+// Make t runnable on its CPU, from any CPU. An idle remote CPU gets
+// an IPI to notice; a busy one finds t when its thread next yields
+// or parks.
+void
+thread_unpark(struct thread *t)
+{
+	struct cpu *c = &cpus[t->cpu];
+	int kick = 0;
+
+	spin_lock(&c->runq.lock);
+	if (t->state == THREAD_BLOCKED) {
+		t->state = THREAD_RUNNABLE;
+		runq_push(&c->runq, t);
+		kick = c->thread == c->idle_thread;
+	} else {
+		t->wakeup = 1;
+	}
+	spin_unlock(&c->runq.lock);
+	if (kick && c != mycpu())
+		sbi_send_ipi(1, c->hartid);
+}
+
+void
+thread_exit(void)
+{
+	struct cpu *c;
+	struct thread *t;
+
+	spin_lock(&mycpu()->runq.lock);
+	c = mycpu();
+	t = c->thread;
+	if (!t->stack)
+		sbi_panic("thread_exit: cpu%d boot thread", c->id);
+	t->state = THREAD_ZOMBIE;
+	c->zombie = t;
+	schedule(c);
+	sbi_panic("thread_exit: zombie ran");
+}
+
+// Anything waiting on this CPU's run queue? For the idle loop,
+// which calls it with interrupts off.
+int
+thread_runnable(void)
+{
+	return __atomic_load_n(&mycpu()->runq.head, __ATOMIC_RELAXED) !=
+	       NULL;
+}
+
+// Ping-pong between the benchmark (the main thread) and a peer
+// parked on the same CPU, or on the next one: one iteration is two
+// switches, plus two IPIs and wakeups from idle when remote.
+static struct thread *bench_main;
+static struct thread *bench_peer[2];
+
+static void
+pingpong(void *arg)
+{
+	for (;;) {
+		thread_park();
+		thread_unpark(bench_main);
+	}
+}
+
+static int
+pingpong_bench(int remote, uint64 iters)
+{
+	int cpu = remote ? cpuid() + 1 : cpuid();
+
+	if (cpu >= ncpu || !__atomic_load_n(&cpus[cpu].online,
+					     __ATOMIC_ACQUIRE))
+		return -1;
+	bench_main = mythread();
+	if (!bench_peer[remote]) {
+		bench_peer[remote] = thread_create("pingpong", pingpong,
+						   NULL, cpu);
+		if (!bench_peer[remote])
+			return -1;
+	}
+	while (iters--) {
+		thread_unpark(bench_peer[remote]);
+		thread_park();
+	}
+	return 0;
+}
+
+BENCH(switch_local, 64)
+{
+	return pingpong_bench(0, iters);
+}
+
+BENCH(switch_remote, 64)
+{
+	return pingpong_bench(1, iters);
+}
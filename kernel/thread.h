@@ -0,0 +1,106 @@
+#ifndef __THREAD_H__
+#define __THREAD_H__
+
+#include "types.h"
+#include "spinlock.h"
+
+// Kernel threads, scheduled cooperatively on the CPU they were
+// created for; they never migrate. A thread runs until it calls
+// yield(), thread_park() or thread_exit().
+//
+// Each CPU's boot call chain is adopted as a thread by
+// thread_cpu_init(). On the other harts that chain ends in
+// cpu_idle() and is the CPU's idle thread; the boot hart's (start())
+// is an ordinary thread and gets a separate idle thread.
+
+// Registers swtch() saves: the callee-saved ones. Everything else
+// is dead across the call by the calling convention.
+struct context {
+	uint64 ra;
+	uint64 sp;
+	uint64 s[12];
+};
+
+// FPU registers, saved only when sstatus.FS says they were written.
+struct fpstate {
+	uint64 f[32];
+	uint64 fcsr;
+};
+
+struct utrapframe;
+struct proc;
+struct tstack;
+
+enum thread_state {
+	THREAD_UNUSED,
+	THREAD_RUNNABLE, // on its CPU's run queue
+	THREAD_RUNNING,
+	THREAD_BLOCKED,  // in thread_park()
+	THREAD_ZOMBIE,   // exited, stack not yet freed
+};
+
+struct thread {
+	struct context ctx;      // must stay first, see swtch.S
+	enum thread_state state;
+	const char *name;
+	int cpu;                 // logical CPU it runs on
+	int wakeup;              // thread_unpark() came while not parked
+	int fp_saved;            // fp holds this thread's FPU registers
+	struct thread *next;     // run queue link
+	void (*fn)(void *);
+	void *arg;
+	struct tstack *stack;    // NULL for a boot thread
+	struct proc *proc;       // process it runs in user mode, or NULL
+	struct utrapframe *utf;  // user registers, see proc_run()
+	struct context ucall;    // where proc_run() returns to
+	struct fpstate fp;
+};
+
+// Per-CPU FIFO of runnable threads, kept in struct cpu. The lock
+// is held across every switch on that CPU.
+struct runq {
+	spinlock_t lock;
+	struct thread *head;
+	struct thread *tail;
+};
+
+void
+swtch(struct context *old, struct context *new);
+
+void
+fpu_save(struct fpstate *fp);
+
+void
+fpu_restore(struct fpstate *fp);
+
+void
+thread_fpu_sync(void);
+
+void
+thread_fpu_load(const struct fpstate *fp);
+
+void
+thread_cpu_init(void);
+
+struct thread *
+thread_create(const char *name, void (*fn)(void *), void *arg, int cpu);
+
+struct thread *
+mythread(void);
+
+void
+yield(void);
+
+void
+thread_park(void);
+
+void
+thread_unpark(struct thread *t);
+
+void __attribute__((noreturn))
+thread_exit(void);
+
+int
+thread_runnable(void);
+
+#endif /* __THREAD_H__ */
@@ -0,0 +1,247 @@
+// Time keeping on top of the rdtime counter and the devicetree
+// timebase-frequency, plus short (spinning) and long (parked) waits.
+
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "cpu.h"
+#include "spinlock.h"
+#include "fdt.h"
+#include "time.h"
+#include "thread.h"
+#include "trace.h"
+
+#define TIMEBASE_DEFAULT 10000000 // QEMU virt, 10 MHz
+
+static uint64 timebase = TIMEBASE_DEFAULT;
+static uint64 ns_mult;    // ns = (ticks * ns_mult) >> 32
+static uint64 ticks_mult; // ticks = (ns * ticks_mult) >> 32
+static int has_sstc;      // stimecmp CSR instead of an SBI call
+
+TRACE_EVENT(timer_set, TRACE_TIMER, 'i', "deadline", NULL, NULL);
+
+void
+time_init(void)
+{
+	int node;
+	uint32 freq;
+
+	node = fdt_path_offset("/cpus");
+	if (fdt_getprop_u32(node, "timebase-frequency", &freq) == 0 && freq)
+		timebase = freq;
+
+	has_sstc = cpu_has_isa_ext("sstc");
+
+	ns_mult = (NSEC_PER_SEC << 32) / timebase;
+	ticks_mult = (timebase << 32) / NSEC_PER_SEC;
+
+	sbi_printf("time: timebase %lu Hz%s\n", timebase,
+		   has_sstc ? ", sstc" : "");
+}
+
+uint64
+timebase_freq(void)
+{
+	return timebase;
+}
+
+uint64
+ticks_to_ns(uint64 ticks)
+{
+	return ((unsigned __int128)ticks * ns_mult) >> 32;
+}
+
+uint64
+ns_to_ticks(uint64 ns)
+{
+	// Round up so that waits never come out short.
+	return (((unsigned __int128)ns * ticks_mult) >> 32) + 1;
+}
+
+// Nanoseconds since the timebase counter started.
+uint64
+ktime_get(void)
+{
+	return ticks_to_ns(rdtime());
+}
+
+// Program this hart's timer for an absolute rdtime() deadline,
+// TIMER_NONE to stop it. The deadline is recorded in struct cpu so
+// that other code can see when this hart will next be woken up.
+void
+timer_set(uint64 deadline)
+{
+	trace(timer_set, deadline, 0, 0);
+	mycpu()->timer_deadline = deadline;
+	if (has_sstc)
+		w_stimecmp(deadline);
+	else
+		sbi_set_timer(deadline);
+}
+
+// The next event this hart's timer is for: the tick or a ktimer.
+static uint64
+next_deadline(struct cpu *c)
+{
+	uint64 deadline = c->tick_period ? c->tick_next : TIMER_NONE;
+
+	if (c->timers && c->timers->deadline < deadline)
+		deadline = c->timers->deadline;
+	return deadline;
+}
+
+// Periodic tick on this hart, every period_ns. Shares the hart's
+// timer with the ktimers, sleep_until()'s included.
+void
+timer_tick_start(uint64 period_ns)
+{
+	struct cpu *c = mycpu();
+
+	push_off();
+	c->tick_period = ns_to_ticks(period_ns);
+	c->tick_next = rdtime() + c->tick_period;
+	timer_set(next_deadline(c));
+	pop_off();
+}
+
+void
+timer_tick_stop(void)
+{
+	push_off();
+	mycpu()->tick_period = 0;
+	timer_set(next_deadline(mycpu()));
+	pop_off();
+}
+
+// Timer interrupt, from kerneltrap() or usertrap(). The only timer
+// events are the periodic tick and ktimers, sleep_until()'s among
+// them (or a stale deadline, which is just cleared).
+// Ticks missed while interrupts were off are skipped, not replayed.
+void
+timer_interrupt(void)
+{
+	struct cpu *c = mycpu();
+	uint64 now = rdtime();
+	struct ktimer *t;
+
+	while ((t = c->timers) && t->deadline <= now) {
+		c->timers = t->next;
+		t->fn(t);
+	}
+	if (c->tick_period)
+		while (c->tick_next <= now)
+			c->tick_next += c->tick_period;
+	timer_set(next_deadline(c));
+}
+
+// Arm t to call fn once rdtime() reaches deadline, on this CPU.
+void
+ktimer_add(struct ktimer *t, uint64 deadline, void (*fn)(struct ktimer *))
+{
+	struct cpu *c;
+	struct ktimer **pp;
+
+	push_off();
+	c = mycpu();
+	t->deadline = deadline;
+	t->fn = fn;
+	for (pp = &c->timers; *pp && (*pp)->deadline <= deadline;
+	     pp = &(*pp)->next)
+		;
+	t->next = *pp;
+	*pp = t;
+	if (c->timers == t)
+		timer_set(next_deadline(c));
+	pop_off();
+}
+
+// Disarm t, on the CPU that armed it. Returns 1 if it had not fired.
+// The hart's timer may still go off for it, and find nothing due.
+int
+ktimer_cancel(struct ktimer *t)
+{
+	struct ktimer **pp;
+	int armed = 0;
+
+	push_off();
+	for (pp = &mycpu()->timers; *pp; pp = &(*pp)->next) {
+		if (*pp == t) {
+			*pp = t->next;
+			armed = 1;
+			break;
+		}
+	}
+	pop_off();
+	return armed;
+}
+
+static void
+spin_until(uint64 deadline)
+{
+	while (rdtime() < deadline)
+		;
+}
+
+struct sleeper {
+	struct ktimer timer;     // must stay first, see sleep_timeout()
+	struct thread *thread;
+};
+
+static void
+sleep_timeout(struct ktimer *t)
+{
+	thread_unpark(((struct sleeper *)t)->thread);
+}
+
+// Park the calling thread until rdtime() reaches deadline, on a
+// ktimer: the CPU runs its other threads, deferred work and async
+// tasks meanwhile, and its idle thread picks the idle state. Waits
+// too short to be worth a switch spin.
+void
+sleep_until(uint64 deadline)
+{
+	struct sleeper s;
+	uint64 now = rdtime();
+
+	if (now >= deadline ||
+	    deadline - now < ns_to_ticks(TIME_SLEEP_MIN_NS)) {
+		spin_until(deadline);
+		return;
+	}
+	s.thread = mythread();
+	ktimer_add(&s.timer, deadline, sleep_timeout);
+	// thread_park() may return for an unrelated thread_unpark().
+	while (rdtime() < deadline)
+		thread_park();
+	ktimer_cancel(&s.timer);
+}
+
+void
+nsleep(uint64 ns)
+{
+	sleep_until(rdtime() + ns_to_ticks(ns));
+}
+
+void
+msleep(uint64 ms)
+{
+	nsleep(ms * NSEC_PER_MSEC);
+}
+
+// Busy-wait delays, for short waits on devices.
+void
+ndelay(uint64 ns)
+{
+	spin_until(rdtime() + ns_to_ticks(ns));
+}
+
+void
+udelay(uint64 us)
+{
+	ndelay(us * NSEC_PER_USEC);
+}
+
+void
+mdelay(uint64 ms)
+{
+	ndelay(ms * NSEC_PER_MSEC);
+}
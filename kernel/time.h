@@ -0,0 +1,75 @@
+#ifndef __TIME_H__
+#define __TIME_H__
+
+#include "types.h"
+
+#define NSEC_PER_USEC 1000UL
+#define NSEC_PER_MSEC 1000000UL
+#define NSEC_PER_SEC  1000000000UL
+
+// Waits at least this long park the thread on a ktimer instead of
+// spinning on rdtime.
+#define TIME_SLEEP_MIN_NS (50 * NSEC_PER_USEC)
+
+#define TIMER_NONE (~0UL) // no timer event programmed
+
+// A one-shot callback at an rdtime() deadline, on the CPU that arms
+// it. fn runs from the timer interrupt, with interrupts off.
+struct ktimer {
+	uint64 deadline;
+	void (*fn)(struct ktimer *t);
+	struct ktimer *next;     // per-CPU list, soonest first
+};
+
+void
+time_init(void);
+
+uint64
+timebase_freq(void);
+
+uint64
+ticks_to_ns(uint64 ticks);
+
+uint64
+ns_to_ticks(uint64 ns);
+
+uint64
+ktime_get(void);
+
+void
+timer_set(uint64 deadline);
+
+void
+timer_tick_start(uint64 period_ns);
+
+void
+timer_tick_stop(void);
+
+void
+timer_interrupt(void);
+
+void
+ktimer_add(struct ktimer *t, uint64 deadline, void (*fn)(struct ktimer *));
+
+int
+ktimer_cancel(struct ktimer *t);
+
+void
+ndelay(uint64 ns);
+
+void
+udelay(uint64 us);
+
+void
+mdelay(uint64 ms);
+
+void
+sleep_until(uint64 deadline);
+
+void
+nsleep(uint64 ns);
+
+void
+msleep(uint64 ms);
+
+#endif /* __TIME_H__ */
@@ -0,0 +1,147 @@
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "cpu.h"
+#include "kalloc.h"
+#include "fmt.h"
+#include "klibc.h"
+#include "time.h"
+#include "trace.h"
+
+extern struct trace_event __trace_events_start[], __trace_events_end[];
+
+static const struct {
+	const char *name;
+	uint32 mask;
+} categories[] = {
+	{ "irq",   TRACE_IRQ },
+	{ "idle",  TRACE_IDLE },
+	{ "timer", TRACE_TIMER },
+	{ "sbi",   TRACE_SBI },
+};
+
+#define NCATEGORIES (sizeof(categories) / sizeof(categories[0]))
+
+static int traced; // any event was ever enabled
+
+void
+trace_record(struct trace_event *ev, uint64 a0, uint64 a1, uint64 a2)
+{
+	struct trace_buf *b = &mycpu()->trace;
+	struct trace_entry *e;
+	uint64 i;
+
+	if (!b->page[0])
+		return; // trace_cpu_init() has not run on this hart yet
+
+	// amoadd, so that a trace point in an interrupt handler gets
+	// its own slot even if it lands in the middle of this one.
+	i = __atomic_fetch_add(&b->head, 1, __ATOMIC_RELAXED) % TRACE_ENTRIES;
+	e = &b->page[i / TRACE_PER_PAGE][i % TRACE_PER_PAGE];
+	e->ts_id = rdtime() << 16 | (ev - __trace_events_start);
+	e->arg[0] = a0;
+	e->arg[1] = a1;
+	e->arg[2] = a2;
+}
+
+// On each hart, once kalloc() works. Records made before are lost.
+void
+trace_cpu_init(void)
+{
+	struct trace_buf *b = &mycpu()->trace;
+	int i;
+
+	for (i = 0; i < TRACE_BUF_PAGES; i++) {
+		b->page[i] = kalloc();
+		if (!b->page[i]) {
+			while (i > 0)
+				kfree(b->page[--i]);
+			b->page[0] = NULL;
+			return;
+		}
+	}
+}
+
+// Enable exactly the events in the categories in mask.
+void
+trace_enable(uint32 mask)
+{
+	struct trace_event *ev;
+
+	if (mask)
+		traced = 1;
+	for (ev = __trace_events_start; ev < __trace_events_end; ev++)
+		__atomic_store_n(&ev->enabled, !!(ev->category & mask),
+				 __ATOMIC_RELAXED);
+}
+
+// Category mask for a comma separated list of category names, or
+// "all".
+uint32
+trace_parse(const char *list)
+{
+	const char *p = list, *end;
+	uint32 mask = 0;
+	int i, n;
+
+	while (*p) {
+		for (end = p; *end && *end != ','; end++)
+			;
+		n = end - p;
+		if (n == 3 && strncmp(p, "all", 3) == 0)
+			mask = ~0U;
+		for (i = 0; i < NCATEGORIES; i++)
+			if (strlen(categories[i].name) == n &&
+			    strncmp(p, categories[i].name, n) == 0)
+				mask |= categories[i].mask;
+		p = *end ? end + 1 : end;
+	}
+	return mask;
+}
+
+// Print the event descriptions and every hart's ring, oldest
+// record first:
+//
+//	trace: begin <timebase Hz>
+//	trace: event <id> <name> <phase> <arg names, - if unused>
+//	trace: <cpu> <ts_id> <arg0> <arg1> <arg2>
+//	trace: end
+//
+// numbers in hex except the header. Disables all events first, so
+// that the dump's own SBI calls are not recorded over the trace.
+void
+trace_dump(void)
+{
+	struct trace_event *ev;
+	struct trace_buf *b;
+	struct trace_entry *e;
+	uint64 i, first;
+	int cpu;
+
+	if (!traced)
+		return;
+	trace_enable(0);
+
+	sbi_printf("trace: begin %lu\n", timebase_freq());
+	for (ev = __trace_events_start; ev < __trace_events_end; ev++)
+		sbi_printf("trace: event %lx %s %c %s %s %s\n",
+			   (uint64)(ev - __trace_events_start), ev->name,
+			   ev->phase, ev->args[0] ? ev->args[0] : "-",
+			   ev->args[1] ? ev->args[1] : "-",
+			   ev->args[2] ? ev->args[2] : "-");
+	for (cpu = 0; cpu < ncpu; cpu++) {
+		b = &cpus[cpu].trace;
+		if (!b->page[0])
+			continue;
+		first = b->head > TRACE_ENTRIES ? b->head - TRACE_ENTRIES : 0;
+		for (i = first; i < b->head; i++) {
+			e = &b->page[(i % TRACE_ENTRIES) / TRACE_PER_PAGE]
+				    [i % TRACE_PER_PAGE];
+			fmt_printf(FMT_L("trace: "), FMT_D(cpu),
+				   FMT_L(" "), FMT_X(e->ts_id),
+				   FMT_L(" "), FMT_X(e->arg[0]),
+				   FMT_L(" "), FMT_X(e->arg[1]),
+				   FMT_L(" "), FMT_X(e->arg[2]), FMT_L("\n"));
+		}
+	}
+	sbi_puts("trace: end\n");
+}
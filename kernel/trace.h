@@ -0,0 +1,88 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "types.h"
+#include "riscv.h"
+
+// Static trace points. An event is defined once, at file scope:
+//
+//	TRACE_EVENT(idle_enter, TRACE_IDLE, 'B', "state", "predicted_ns", NULL);
+//
+// and recorded anywhere with
+//
+//	trace(idle_enter, i, predicted, 0);
+//
+// which, while the event is disabled, costs a load and a branch.
+// Enabled events append (timestamp, event id, three args) to the
+// running hart's ring buffer, unformatted; trace_dump() prints the
+// rings at shutdown for tools/ktrace.py to turn into a Chrome trace
+// (chrome://tracing, ui.perfetto.dev).
+
+// Categories enabled at boot, e.g. "irq,idle"; make TRACE=...
+#ifndef TRACE_DEFAULT
+#define TRACE_DEFAULT ""
+#endif
+
+// Categories, enabled together.
+#define TRACE_IRQ   (1 << 0) // interrupts
+#define TRACE_IDLE  (1 << 1) // idle state entry and exit
+#define TRACE_TIMER (1 << 2) // timer programming
+#define TRACE_SBI   (1 << 3) // SBI calls
+
+struct trace_event {
+	const char *name;
+	const char *args[3]; // argument names, NULL if unused
+	uint16 category;
+	char phase;          // Chrome phase: 'B'egin, 'E'nd, 'i'nstant
+	uint8 enabled;
+} __attribute__((aligned(8)));
+
+// Events live in their own section, see kernel.ld; an event's id is
+// its index there.
+#define TRACE_EVENT(name, cat, ph, a0, a1, a2)                        \
+	struct trace_event trace_event_##name                         \
+	__attribute__((section("trace_events"), used, aligned(8))) = \
+		{ #name, { a0, a1, a2 }, cat, ph, 0 }
+
+#define trace(name, a0, a1, a2)                                        \
+	do {                                                           \
+		extern struct trace_event trace_event_##name;          \
+		if (__builtin_expect(trace_event_##name.enabled, 0))   \
+			trace_record(&trace_event_##name, (uint64)(a0), \
+				     (uint64)(a1), (uint64)(a2));      \
+	} while (0)
+
+// One record; the timestamp (rdtime) takes the top 48 bits of
+// ts_id and the event id the low 16.
+struct trace_entry {
+	uint64 ts_id;
+	uint64 arg[3];
+};
+
+#define TRACE_BUF_PAGES 8 // per hart, a power of two
+#define TRACE_PER_PAGE  (PGSIZE / sizeof(struct trace_entry))
+#define TRACE_ENTRIES   (TRACE_BUF_PAGES * TRACE_PER_PAGE)
+
+// Per-CPU ring, kept in struct cpu. Only the owning hart writes
+// it; once full, new records overwrite the oldest.
+struct trace_buf {
+	struct trace_entry *page[TRACE_BUF_PAGES];
+	uint64 head; // records ever written
+};
+
+void
+trace_record(struct trace_event *ev, uint64 a0, uint64 a1, uint64 a2);
+
+void
+trace_cpu_init(void);
+
+void
+trace_enable(uint32 mask);
+
+uint32
+trace_parse(const char *list);
+
+void
+trace_dump(void);
+
+#endif /* __TRACE_H__ */
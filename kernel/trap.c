@@ -0,0 +1,151 @@
+// Traps taken in supervisor mode. Interrupts go to their handlers;
+// the kernel has no business causing an exception, so any is fatal.
+// Traps from user mode come in through uservec.S: syscalls mostly
+// go straight to syscall_dispatch(), the rest end up in usertrap().
+
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "cpu.h"
+#include "time.h"
+#include "prof.h"
+#include "trace.h"
+#include "plic.h"
+#include "vm.h"
+#include "proc.h"
+#include "thread.h"
+#include "rcu.h"
+#include "workq.h"
+#include "trap.h"
+
+// in kernelvec.S, calls kerneltrap().
+void kernelvec();
+
+TRACE_EVENT(irq_entry, TRACE_IRQ, 'B', "irq", "epc", NULL);
+TRACE_EVENT(irq_exit, TRACE_IRQ, 'E', "irq", NULL, NULL);
+
+// set up to take exceptions and traps on this hart. Interrupts
+// stay globally disabled until the caller turns them on.
+void
+trapinithart(void)
+{
+	w_stvec((uint64)kernelvec);
+	w_sie(r_sie() | SIE_SEIE | SIE_STIE | SIE_SSIE);
+	w_scounteren(SCOUNTEREN_CY | SCOUNTEREN_TM | SCOUNTEREN_IR);
+}
+
+// Interrupt cause (scause without the interrupt bit) taken at epc;
+// tf is NULL for an interrupt of user code. The handlers run with
+// interrupts off; what they deferred then runs with them on.
+static void
+devintr(uint64 cause, struct ktrapframe *tf, uint64 epc)
+{
+	uint64 t0 = rdtime();
+
+	cpu_stat_inc(CPU_STAT_INTR);
+	trace(irq_entry, cause, epc, 0);
+	switch (cause) {
+	case IRQ_S_SOFT:
+		// an IPI; for now only ever a kick out of idle.
+		w_sip(r_sip() & ~SIP_SSIP);
+		cpu_stat_inc(CPU_STAT_IPI);
+		break;
+	case IRQ_S_TIMER:
+		timer_interrupt();
+		prof_tick(tf, epc);
+		break;
+	case IRQ_S_EXT:
+		plic_intr();
+		break;
+	case IRQ_PMU_OVF:
+		prof_overflow(tf, epc);
+		break;
+	default:
+		sbi_panic("devintr: cpu%d unexpected interrupt %lu\n",
+			  cpuid(), cause);
+	}
+	trace(irq_exit, cause, 0, 0);
+	work_irq_exit(t0);
+}
+
+// interrupts and exceptions from kernel code go here via kernelvec,
+// on whatever the current kernel stack is.
+void
+kerneltrap(struct ktrapframe *tf)
+{
+	uint64 sepc = r_sepc();
+	uint64 sstatus = r_sstatus();
+	uint64 scause = r_scause();
+
+	if ((sstatus & SSTATUS_SPP) == 0)
+		sbi_panic("kerneltrap: not from supervisor mode");
+	if (intr_get() != 0)
+		sbi_panic("kerneltrap: interrupts enabled");
+
+	if (!(scause & SCAUSE_INTR))
+		sbi_panic("kerneltrap: cpu%d scause 0x%lx sepc 0x%lx "
+			  "stval 0x%lx\n", cpuid(), scause, sepc, r_stval());
+
+	devintr(scause & ~SCAUSE_INTR, tf, sepc);
+
+	// restore trap registers for use by kernelvec.S's sret, in
+	// case a handler ever takes a trap of its own.
+	w_sepc(sepc);
+	w_sstatus(sstatus);
+}
+
+// Everything from user mode but fast path syscalls, called by uservec.S
+// with interrupts off and all user registers in tf. Returns the
+// trapframe to resume user mode with, with interrupts off. Page
+// faults, which may zero or copy a whole megapage, are handled with
+// interrupts on, as syscalls are.
+struct utrapframe *
+usertrap(struct utrapframe *tf)
+{
+	uint64 scause = r_scause(), stval = r_stval();
+	int access = 0, err;
+
+	if (scause & SCAUSE_INTR) {
+		rcu_quiescent(); // user code holds no RCU references
+		devintr(scause & ~SCAUSE_INTR, NULL, tf->epc);
+		// Preempt user mode at the timer (proc_enter() arms a
+		// slice): tf holds every register, and threads never
+		// migrate, so this is an ordinary yield.
+		if ((scause & ~SCAUSE_INTR) == IRQ_S_TIMER &&
+		    thread_runnable())
+			yield();
+		return tf;
+	}
+	switch (scause) {
+	case EXC_U_ECALL:
+		// one the fast path left to us, see syscall.h.
+		tf->epc += 4;
+		if (tf->x[17] < NSYSCALL)
+			tf->x[10] = syscall_dispatch(tf->x[10], tf->x[11],
+						     tf->x[12], tf->x[13],
+						     tf->x[14], tf->x[15],
+						     tf->x[16], tf->x[17]);
+		else
+			tf->x[10] = -1;
+		return tf;
+	case EXC_INST_PAGE_FAULT:
+		access = PTE_X;
+		break;
+	case EXC_LOAD_PAGE_FAULT:
+		access = PTE_R;
+		break;
+	case EXC_STORE_PAGE_FAULT:
+		access = PTE_W;
+		break;
+	}
+	if (access) {
+		intr_on();
+		err = vm_fault(myproc(), stval, access);
+		intr_off();
+		if (err == 0)
+			return tf;
+	}
+	sbi_printf("usertrap: cpu%d pid %d scause 0x%lx sepc 0x%lx "
+		   "stval 0x%lx\n", cpuid(), myproc()->pid, scause, tf->epc,
+		   stval);
+	user_return(&mythread()->ucall, -1);
+}
@@ -0,0 +1,56 @@
+#ifndef __TRAP_H__
+#define __TRAP_H__
+
+#include "types.h"
+#include "thread.h"
+
+// Registers of the interrupted code, x1..x31 in order, as saved
+// on the kernel stack by kernelvec.S.
+struct ktrapframe {
+	uint64 ra;
+	uint64 sp;
+	uint64 gp;
+	uint64 tp;
+	uint64 t0;
+	uint64 t1;
+	uint64 t2;
+	uint64 s0;
+	uint64 s1;
+	uint64 a[8];
+	uint64 s[10];   // s2..s11
+	uint64 t3;
+	uint64 t4;
+	uint64 t5;
+	uint64 t6;
+	uint64 pad;     // keeps sp 16-byte aligned
+};
+
+// User registers, saved by uservec.S into the running thread's
+// trapframe on a trap from user mode. x[i] is register xi; the
+// simple syscall path leaves the callee-saved s0..s11 unsaved.
+struct utrapframe {
+	uint64 kernel_sp; // kernel stack to handle the trap on
+	uint64 epc;       // user pc
+	uint64 x[32];
+};
+
+void
+trapinithart(void);
+
+void
+kerneltrap(struct ktrapframe *tf);
+
+struct utrapframe *
+usertrap(struct utrapframe *tf);
+
+// in uservec.S
+void
+uservec(void);
+
+long
+user_enter(struct utrapframe *tf, struct context *ret);
+
+void __attribute__((noreturn))
+user_return(struct context *ret, long status);
+
+#endif /* __TRAP_H__ */
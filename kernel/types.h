@@ -1,6 +1,9 @@
 #ifndef __TYPES_H__
 #define __TYPES_H__
 
+typedef unsigned char uint8;
+typedef unsigned short uint16;
+
 typedef unsigned int uint32_t;
 typedef unsigned int uint32;
 typedef unsigned int u32;
@@ -1,4 +1,6 @@
 #include "uart.h"
+#include "fdt.h"
+#include "plic.h"
 #include <stdint.h>
 
 #define UART_BASE 0x10000000UL
@@ -11,6 +13,8 @@
 #define UART_LCR 0x03
 #define UART_LSR 0x05
 
+#define IER_RX_ENABLE  (1 << 0)
+
 #define LSR_RX_READY   (1 << 0)
 #define LSR_TX_IDLE    (1 << 5)
 
@@ -48,6 +52,10 @@ uart_puts(const char *fmt)
 		uart_putc_sync(*fmt++);
 }
 
+/*
+ * Spins until a character arrives; tasks that can wait use
+ * uart_rx_ready and uart_rx_pop() instead.
+ */
 char
 uart_getc(void)
 {
@@ -103,3 +111,59 @@ uart_init(void)
 	/* Enable FIFO, clear RX/TX queues */
 	mmio_write8(UART_BASE + UART_FCR, 0x07);
 }
+
+/*
+ * Interrupt driven receive. The handler moves received characters
+ * into rx_buf and signals uart_rx_ready; a task awaits that, then
+ * drains the buffer with uart_rx_pop(). Characters arriving while
+ * the buffer is full are dropped.
+ */
+#define UART_RX_BUF 64
+
+struct completion uart_rx_ready = COMPLETION_INITIALIZER;
+static char rx_buf[UART_RX_BUF];
+static unsigned int rx_head, rx_tail; /* written by the handler, the task */
+
+static void
+uart_intr(void *arg)
+{
+	int c;
+
+	while ((c = uart_getc_nonblock()) >= 0) {
+		if (rx_head - __atomic_load_n(&rx_tail, __ATOMIC_ACQUIRE) <
+		    UART_RX_BUF) {
+			rx_buf[rx_head % UART_RX_BUF] = c;
+			__atomic_store_n(&rx_head, rx_head + 1,
+					 __ATOMIC_RELEASE);
+		}
+	}
+	complete(&uart_rx_ready);
+}
+
+int
+uart_rx_pop(void)
+{
+	int c;
+
+	if (rx_tail == __atomic_load_n(&rx_head, __ATOMIC_ACQUIRE))
+		return -1;
+	c = rx_buf[rx_tail % UART_RX_BUF];
+	__atomic_store_n(&rx_tail, rx_tail + 1, __ATOMIC_RELEASE);
+	return c;
+}
+
+/* Route the receive interrupt to CPU cpu. */
+int
+uart_rx_async_init(int cpu)
+{
+	uint32 irq;
+	int node;
+
+	node = fdt_next_compatible(fdt_path_offset("/soc"), -1, "ns16550a");
+	if (node < 0 || fdt_getprop_u32(node, "interrupts", &irq) < 0)
+		return -1;
+	if (plic_enable(irq, cpu, uart_intr, 0) < 0)
+		return -1;
+	mmio_write8(UART_BASE + UART_IER, IER_RX_ENABLE);
+	return 0;
+}
@@ -1,6 +1,8 @@
 #ifndef __UART_H__
 #define __UART_H__
 
+#include "async.h"
+
 void
 uart_init(void);
 
@@ -19,4 +21,12 @@ uart_getc(void);
 int
 uart_getc_nonblock(void);
 
+extern struct completion uart_rx_ready;
+
+int
+uart_rx_pop(void);
+
+int
+uart_rx_async_init(int cpu);
+
 #endif /* __UART_H__ */
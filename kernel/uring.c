@@ -0,0 +1,470 @@
+// Disk I/O from user mode: blkread(), one read per syscall, and
+// submission and completion rings (uring.h), which start a batch of
+// reads with one uring_enter() and collect them without any. With
+// URING_SETUP_SQPOLL a kernel thread on a spare CPU takes the sqes
+// as they are added, so that a busy process needs no syscalls at all;
+// after URING_SQPOLL_IDLE_NS without work it sleeps until uring_enter()
+// wakes it.
+//
+// Reads go by DMA straight into user memory. The ring pages and the
+// buffers of reads in flight are pinned (uvm_pin()), so they stay
+// put until the device is done with them whatever the process does.
+// The polling thread has no address space to look buffers up in: it
+// only takes reads into buffers registered with uring_register(),
+// which stay pinned, and NOPs.
+//
+// The disk interrupt's bottom half posts each cqe itself, and wakes a
+// uring_enter() that waits for it. A forked child does not
+// inherit the rings.
+
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "cpu.h"
+#include "kalloc.h"
+#include "klibc.h"
+#include "spinlock.h"
+#include "thread.h"
+#include "time.h"
+#include "virtio_blk.h"
+#include "vm.h"
+#include "proc.h"
+#include "uring.h"
+
+#define URING_INFLIGHT      16 // disk reads per ring at a time
+#define URING_SQPOLL_IDLE_NS (2 * NSEC_PER_MSEC)
+
+struct uring;
+
+struct uring_req {
+	struct blk_req blk;         // must stay first, see end_io()
+	struct uring *ring;
+	uint64 user_data;
+	void *pin;                  // page to put when done, or NULL
+	struct uring_req *next;     // free list
+};
+
+struct uring {
+	spinlock_t lock;
+	struct uring_sq *sq;        // pinned pages, by physical address
+	struct uring_cq *cq;
+	uint64 bufs[URING_NBUFS];   // registered buffers, pinned
+	int nbufs;
+	struct uring_req reqs[URING_INFLIGHT];
+	struct uring_req *free;
+	int inflight;               // reads the disk has
+	uint64 completed;           // cqes posted, ever
+	struct thread *waiter;      // in uring_enter() or uring_free()
+	struct thread *sqpoll;      // the polling thread, or NULL
+	int stop;                   // tells it to exit
+	int stopped;                // and it did
+};
+
+// Post a cqe; called with r locked, after checking for room.
+static void
+post(struct uring *r, uint64 user_data, int res)
+{
+	struct uring_cq *cq = r->cq;
+	struct uring_cqe *cqe = &cq->cqes[cq->tail % URING_CQ_ENTRIES];
+
+	cqe->user_data = user_data;
+	cqe->res = res;
+	cqe->flags = 0;
+	__atomic_store_n(&cq->tail, cq->tail + 1, __ATOMIC_RELEASE);
+	r->completed++;
+}
+
+// Wake uring_enter() or uring_free() to look again; called with r
+// locked.
+static void
+wake(struct uring *r)
+{
+	if (r->waiter) {
+		thread_unpark(r->waiter);
+		r->waiter = NULL;
+	}
+}
+
+// Whether the completion ring has room for another cqe besides one
+// for each read in flight. Called with r locked.
+static int
+cq_room(struct uring *r)
+{
+	uint32 used = r->cq->tail -
+		      __atomic_load_n(&r->cq->head, __ATOMIC_ACQUIRE);
+
+	return used < URING_CQ_ENTRIES &&
+	       URING_CQ_ENTRIES - used > r->inflight;
+}
+
+// Disk interrupt bottom half: the read is done.
+static void
+end_io(struct blk_req *b)
+{
+	struct uring_req *q = (struct uring_req *)b;
+	struct uring *r = q->ring;
+
+	if (q->pin)
+		page_put(q->pin);
+	spin_lock(&r->lock);
+	post(r, q->user_data, b->status == 0 ? b->len : -1);
+	q->next = r->free;
+	r->free = q;
+	r->inflight--;
+	wake(r);
+	spin_unlock(&r->lock);
+}
+
+// The physical address to read e into: a registered buffer, or for
+// a plain read in process context the page at addr, pinned into
+// *pin. 0 if the sqe is bad.
+static uint64
+sqe_buf(struct uring *r, struct uring_sqe *e, void **pin)
+{
+	uint64 pa;
+
+	*pin = NULL;
+	if (e->len == 0 || e->len % BLK_SECTOR_SIZE != 0 ||
+	    e->off % BLK_SECTOR_SIZE != 0)
+		return 0;
+	if (e->opcode == URING_OP_READ_FIXED) {
+		if (e->buf_index >= r->nbufs || e->len > PGSIZE)
+			return 0;
+		return r->bufs[e->buf_index];
+	}
+	if (!myproc() || e->addr % PGSIZE + e->len > PGSIZE)
+		return 0;
+	pa = uvm_pin(myproc(), e->addr);
+	*pin = (void *)PGROUNDDOWN(pa);
+	return pa;
+}
+
+// Start the read e asks for, or fail it with a cqe. Returns 1 if e
+// was taken, 0 if not for now: the completion ring is full, or all
+// of r's requests or the disk's descriptors are in use while reads
+// are in flight whose completion will free them.
+static int
+start(struct uring *r, struct uring_sqe *e)
+{
+	struct uring_req *q;
+	uint64 pa;
+	void *pin;
+
+	spin_lock(&r->lock);
+	if (!cq_room(r) || !r->free) {
+		spin_unlock(&r->lock);
+		return 0;
+	}
+	if (e->opcode != URING_OP_READ && e->opcode != URING_OP_READ_FIXED) {
+		post(r, e->user_data, e->opcode == URING_OP_NOP ? 0 : -1);
+		spin_unlock(&r->lock);
+		return 1;
+	}
+	q = r->free;
+	r->free = q->next;
+	r->inflight++;
+	spin_unlock(&r->lock);
+
+	pa = sqe_buf(r, e, &pin);
+	if (pa) {
+		memset(&q->blk, 0, sizeof(q->blk));
+		q->blk.sector = e->off / BLK_SECTOR_SIZE;
+		q->blk.buf = (void *)pa;
+		q->blk.len = e->len;
+		q->blk.end_io = end_io;
+		q->user_data = e->user_data;
+		q->pin = pin;
+		if (virtio_blk_submit(&q->blk) == 0)
+			return 1;
+		if (pin)
+			page_put(pin);
+	}
+
+	spin_lock(&r->lock);
+	q->next = r->free;
+	r->free = q;
+	r->inflight--;
+	if (pa && r->inflight > 0) {
+		spin_unlock(&r->lock);
+		return 0; // the disk is busy with ours, retry after them
+	}
+	post(r, e->user_data, -1); // bad sqe, or no disk
+	spin_unlock(&r->lock);
+	return 1;
+}
+
+// Take up to n sqes, and return how many were taken. Only one
+// thread submits from a ring: the process, or its polling thread.
+static uint32
+submit(struct uring *r, uint32 n)
+{
+	struct uring_sq *sq = r->sq;
+	uint32 head = sq->head;
+	uint32 tail = __atomic_load_n(&sq->tail, __ATOMIC_ACQUIRE);
+	struct uring_sqe e;
+	uint32 done;
+
+	for (done = 0; done < n && head != tail; done++, head++) {
+		// a copy, which the process cannot change under us
+		e = sq->sqes[head % URING_SQ_ENTRIES];
+		if (!start(r, &e))
+			break;
+	}
+	__atomic_store_n(&sq->head, head, __ATOMIC_RELEASE);
+	return done;
+}
+
+// Park until cond(r) is false.
+static void
+wait_while(struct uring *r, int (*cond)(struct uring *r, uint64 arg),
+	   uint64 arg)
+{
+	spin_lock(&r->lock);
+	while (cond(r, arg)) {
+		r->waiter = mythread();
+		spin_unlock(&r->lock);
+		thread_park();
+		spin_lock(&r->lock);
+	}
+	r->waiter = NULL;
+	spin_unlock(&r->lock);
+}
+
+static int
+no_completion_since(struct uring *r, uint64 completed)
+{
+	return r->completed == completed && r->inflight > 0;
+}
+
+// Fewer than want cqes, and more to come.
+static int
+too_few_cqes(struct uring *r, uint64 want)
+{
+	uint32 ready = r->cq->tail -
+		       __atomic_load_n(&r->cq->head, __ATOMIC_ACQUIRE);
+
+	return ready < want &&
+	       (r->inflight > 0 || (r->sqpoll && r->sq->head !=
+		__atomic_load_n(&r->sq->tail, __ATOMIC_ACQUIRE)));
+}
+
+static int
+in_flight(struct uring *r, uint64 unused)
+{
+	return r->inflight > 0;
+}
+
+static void
+sqpoll_main(void *arg)
+{
+	struct uring *r = arg;
+	struct uring_sq *sq = r->sq;
+	uint64 idle = ns_to_ticks(URING_SQPOLL_IDLE_NS);
+	uint64 last = rdtime();
+
+	while (!__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE)) {
+		if (submit(r, URING_SQ_ENTRIES)) {
+			last = rdtime();
+		} else if (rdtime() - last >= idle) {
+			// The process sets tail, then reads flags: one of
+			// us sees the other.
+			__atomic_store_n(&sq->flags, URING_SQ_NEED_WAKEUP,
+					 __ATOMIC_SEQ_CST);
+			if (sq->head == __atomic_load_n(&sq->tail,
+							__ATOMIC_SEQ_CST) &&
+			    !__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE))
+				thread_park();
+			__atomic_store_n(&sq->flags, 0, __ATOMIC_RELEASE);
+			last = rdtime();
+		}
+		yield();
+	}
+	__atomic_store_n(&r->stopped, 1, __ATOMIC_RELEASE);
+}
+
+// The highest online CPU other than this one, for the polling
+// thread, or -1.
+static int
+spare_cpu(void)
+{
+	int cpu;
+
+	for (cpu = ncpu - 1; cpu >= 0; cpu--)
+		if (cpu != mythread()->cpu &&
+		    __atomic_load_n(&cpus[cpu].online, __ATOMIC_ACQUIRE))
+			return cpu;
+	return -1;
+}
+
+// uring_setup(ring, flags): set up the rings in the URING_SIZE bytes
+// at ring, which must be MAP_SHARED anonymous memory.
+int
+proc_uring_setup(uint64 ring, int flags)
+{
+	struct proc *p = myproc();
+	struct uring *r;
+	uint64 sq, cq;
+	int i, cpu = -1;
+
+	if (p->uring || ring % PGSIZE != 0 || (flags & ~URING_SETUP_SQPOLL))
+		return -1;
+	if ((flags & URING_SETUP_SQPOLL) && (cpu = spare_cpu()) < 0)
+		return -1;
+	r = kalloc();
+	if (!r)
+		return -1;
+	memset(r, 0, sizeof(*r));
+	sq = uvm_pin(p, ring);
+	cq = sq ? uvm_pin(p, ring + URING_CQ_OFF) : 0;
+	if (!cq) {
+		if (sq)
+			page_put((void *)sq);
+		kfree(r);
+		return -1;
+	}
+	r->lock = __SPIN_LOCK_UNLOCKED;
+	r->sq = (struct uring_sq *)sq;
+	r->cq = (struct uring_cq *)cq;
+	memset(r->sq, 0, PGSIZE);
+	memset(r->cq, 0, PGSIZE);
+	for (i = 0; i < URING_INFLIGHT; i++) {
+		r->reqs[i].ring = r;
+		r->reqs[i].next = r->free;
+		r->free = &r->reqs[i];
+	}
+	p->uring = r;
+	if (cpu >= 0 &&
+	    !(r->sqpoll = thread_create("sqpoll", sqpoll_main, r, cpu))) {
+		uring_free(p);
+		return -1;
+	}
+	return 0;
+}
+
+// uring_enter(to_submit, min_complete, flags): take up to to_submit
+// sqes, unless a polling thread does, then wait until at least
+// min_complete cqes are ready or nothing more can complete. A batch
+// larger than the disk takes at once waits for the first reads to
+// finish. Returns how many sqes were taken.
+long
+proc_uring_enter(uint64 to_submit, uint64 min_complete, int flags)
+{
+	struct uring *r = myproc()->uring;
+	uint64 completed;
+	uint32 n, done = 0;
+
+	if (!r)
+		return -1;
+	if (r->sqpoll) {
+		if (flags & URING_ENTER_SQ_WAKEUP)
+			thread_unpark(r->sqpoll);
+	} else {
+		while (done < to_submit) {
+			completed = __atomic_load_n(&r->completed,
+						    __ATOMIC_RELAXED);
+			n = submit(r, to_submit - done);
+			done += n;
+			if (done == to_submit || r->sq->head ==
+			    __atomic_load_n(&r->sq->tail, __ATOMIC_ACQUIRE) ||
+			    !r->inflight)
+				break;
+			wait_while(r, no_completion_since, completed);
+		}
+	}
+	if (min_complete)
+		wait_while(r, too_few_cqes, min_complete);
+	return done;
+}
+
+// uring_register(addr, n): pin the n pages at addr, MAP_SHARED
+// anonymous memory, as buffers 0 to n - 1 for URING_OP_READ_FIXED.
+int
+proc_uring_register(uint64 addr, uint64 n)
+{
+	struct proc *p = myproc();
+	struct uring *r = p->uring;
+	uint64 pa;
+
+	if (!r || r->nbufs || addr % PGSIZE != 0 || n > URING_NBUFS)
+		return -1;
+	for (; r->nbufs < n; r->nbufs++) {
+		pa = uvm_pin(p, addr + r->nbufs * PGSIZE);
+		if (!pa) {
+			while (r->nbufs > 0)
+				page_put((void *)r->bufs[--r->nbufs]);
+			return -1;
+		}
+		r->bufs[r->nbufs] = pa;
+	}
+	return 0;
+}
+
+// Tear down p's rings, once the polling thread has stopped and the
+// disk has finished every read.
+void
+uring_free(struct proc *p)
+{
+	struct uring *r = p->uring;
+
+	if (!r)
+		return;
+	if (r->sqpoll) {
+		__atomic_store_n(&r->stop, 1, __ATOMIC_RELEASE);
+		thread_unpark(r->sqpoll);
+		while (!__atomic_load_n(&r->stopped, __ATOMIC_ACQUIRE))
+			yield();
+	}
+	wait_while(r, in_flight, 0);
+	while (r->nbufs > 0)
+		page_put((void *)r->bufs[--r->nbufs]);
+	page_put(r->sq);
+	page_put(r->cq);
+	kfree(r);
+	p->uring = NULL;
+}
+
+// Wakes a blkread().
+struct blk_wait {
+	struct blk_req req;         // must stay first, see blk_wake()
+	struct thread *thread;
+	int done;
+};
+
+static void
+blk_wake(struct blk_req *b)
+{
+	struct blk_wait *w = (struct blk_wait *)b;
+	struct thread *t = w->thread;
+
+	// w may be gone once the reader sees done
+	__atomic_store_n(&w->done, 1, __ATOMIC_RELEASE);
+	thread_unpark(t);
+}
+
+// blkread(buf, off, len): read len bytes of disk from byte off into
+// buf, all of it in one page; off and len are multiples of 512.
+// Returns len, or -1.
+long
+proc_blkread(uint64 buf, uint64 off, uint64 len)
+{
+	struct blk_wait w;
+	uint64 pa;
+
+	if (len == 0 || len % BLK_SECTOR_SIZE != 0 ||
+	    off % BLK_SECTOR_SIZE != 0 || buf % PGSIZE + len > PGSIZE)
+		return -1;
+	// The process waits here, so it cannot unmap buf meanwhile.
+	pa = uvm_pa(myproc(), buf, PTE_W);
+	if (!pa)
+		return -1;
+	memset(&w, 0, sizeof(w));
+	w.req.sector = off / BLK_SECTOR_SIZE;
+	w.req.buf = (void *)pa;
+	w.req.len = len;
+	w.req.end_io = blk_wake;
+	w.thread = mythread();
+	if (virtio_blk_submit(&w.req) < 0)
+		return -1;
+	while (!__atomic_load_n(&w.done, __ATOMIC_ACQUIRE))
+		thread_park();
+	return w.req.status == 0 ? len : -1;
+}
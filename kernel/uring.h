@@ -0,0 +1,75 @@
+#ifndef __URING_H__
+#define __URING_H__
+
+// Submission and completion rings for disk I/O, after Linux's
+// io_uring. Shared with user programs.
+//
+// The rings live in URING_SIZE bytes of MAP_SHARED anonymous memory
+// that the process hands to uring_setup(): struct uring_sq in the
+// first page, struct uring_cq in the second. The process fills in
+// sqes at sq tail and advances it; the kernel takes them from sq head
+// and posts a cqe for each at cq tail, which the process consumes
+// from cq head. Each index only ever grows and is owned by one side;
+// entries are at index % the ring's size.
+#define URING_SQ_ENTRIES 64  // a power of two
+#define URING_CQ_ENTRIES 128 // a power of two
+#define URING_SIZE       8192
+#define URING_CQ_OFF     4096 // where struct uring_cq starts
+#define URING_NBUFS      64   // registered buffers, see uring_register()
+
+// uring_setup() flags
+#define URING_SETUP_SQPOLL 1 // a kernel thread on a spare CPU takes sqes
+
+// uring_enter() flags
+#define URING_ENTER_SQ_WAKEUP 1 // wake the polling thread
+
+// sq flags, set by the kernel
+#define URING_SQ_NEED_WAKEUP 1 // the polling thread is asleep
+
+// sqe opcodes
+#define URING_OP_NOP        0
+#define URING_OP_READ       1 // len bytes of disk from byte off into addr
+#define URING_OP_READ_FIXED 2 // the same into registered buffer buf_index
+
+#ifndef __ASSEMBLER__
+#include "types.h"
+
+// A disk read: off and len are multiples of 512, and the buffer a
+// single page of MAP_SHARED anonymous memory holds all of it.
+struct uring_sqe {
+	uint8 opcode;
+	uint8 flags;
+	uint16 buf_index;
+	uint32 len;
+	uint64 off;
+	uint64 addr;
+	uint64 user_data;      // comes back in the cqe
+};
+
+struct uring_cqe {
+	uint64 user_data;
+	int res;               // bytes read, or -1
+	uint32 flags;
+};
+
+// The indices are on cache lines of their own, so that the two
+// sides do not share one they both write.
+struct uring_sq {
+	uint32 head;           // next sqe the kernel takes
+	uint32 flags;          // URING_SQ_*
+	uint32 pad0[14];
+	uint32 tail;           // where the process adds the next sqe
+	uint32 pad1[15];
+	struct uring_sqe sqes[URING_SQ_ENTRIES];
+};
+
+struct uring_cq {
+	uint32 head;           // next cqe the process takes
+	uint32 pad0[15];
+	uint32 tail;           // where the kernel posts the next cqe
+	uint32 pad1[15];
+	struct uring_cqe cqes[URING_CQ_ENTRIES];
+};
+#endif
+
+#endif /* __URING_H__ */
@@ -0,0 +1,87 @@
+#ifndef __VIRTIO_H__
+#define __VIRTIO_H__
+
+#include "types.h"
+
+// virtio over MMIO, version 2 ("modern") register layout.
+// Virtual I/O Device (VIRTIO) Version 1.1, section 4.2.2.
+#define VIRTIO_MMIO_MAGIC_VALUE        0x000 // 0x74726976
+#define VIRTIO_MMIO_VERSION            0x004 // 2
+#define VIRTIO_MMIO_DEVICE_ID          0x008 // 1 net, 2 disk
+#define VIRTIO_MMIO_VENDOR_ID          0x00c
+#define VIRTIO_MMIO_DEVICE_FEATURES    0x010
+#define VIRTIO_MMIO_DRIVER_FEATURES    0x020
+#define VIRTIO_MMIO_QUEUE_SEL          0x030
+#define VIRTIO_MMIO_QUEUE_NUM_MAX      0x034
+#define VIRTIO_MMIO_QUEUE_NUM          0x038
+#define VIRTIO_MMIO_QUEUE_READY        0x044
+#define VIRTIO_MMIO_QUEUE_NOTIFY       0x050
+#define VIRTIO_MMIO_INTERRUPT_STATUS   0x060
+#define VIRTIO_MMIO_INTERRUPT_ACK      0x064
+#define VIRTIO_MMIO_STATUS             0x070
+#define VIRTIO_MMIO_QUEUE_DESC_LOW     0x080
+#define VIRTIO_MMIO_QUEUE_DESC_HIGH    0x084
+#define VIRTIO_MMIO_DRIVER_DESC_LOW    0x090 // available ring
+#define VIRTIO_MMIO_DRIVER_DESC_HIGH   0x094
+#define VIRTIO_MMIO_DEVICE_DESC_LOW    0x0a0 // used ring
+#define VIRTIO_MMIO_DEVICE_DESC_HIGH   0x0a4
+
+#define VIRTIO_MAGIC 0x74726976
+
+// status register bits
+#define VIRTIO_CONFIG_S_ACKNOWLEDGE 1
+#define VIRTIO_CONFIG_S_DRIVER      2
+#define VIRTIO_CONFIG_S_DRIVER_OK   4
+#define VIRTIO_CONFIG_S_FEATURES_OK 8
+
+// device feature bits
+#define VIRTIO_BLK_F_RO             5  // disk is read-only
+#define VIRTIO_BLK_F_SCSI           7  // supports scsi command passthru
+#define VIRTIO_BLK_F_CONFIG_WCE     11 // writeback mode available in config
+#define VIRTIO_BLK_F_MQ             12 // support more than one vq
+#define VIRTIO_F_ANY_LAYOUT         27
+#define VIRTIO_RING_F_INDIRECT_DESC 28
+#define VIRTIO_RING_F_EVENT_IDX     29
+
+// descriptors per virtqueue, a power of two; a disk request takes
+// three, so 21 can be in flight
+#define VIRTIO_NUM 64
+
+struct virtq_desc {
+	uint64 addr;
+	uint32 len;
+	uint16 flags;
+	uint16 next;
+};
+#define VRING_DESC_F_NEXT  1 // chained with another descriptor
+#define VRING_DESC_F_WRITE 2 // device writes (vs read)
+
+struct virtq_avail {
+	uint16 flags;
+	uint16 idx;              // driver will write ring[idx] next
+	uint16 ring[VIRTIO_NUM]; // descriptor numbers of chain heads
+	uint16 unused;
+};
+
+struct virtq_used_elem {
+	uint32 id;  // index of start of completed descriptor chain
+	uint32 len;
+};
+
+struct virtq_used {
+	uint16 flags;
+	uint16 idx; // device increments when it adds a ring[] entry
+	struct virtq_used_elem ring[VIRTIO_NUM];
+};
+
+// The first descriptor of a disk request points at this header.
+#define VIRTIO_BLK_T_IN  0 // read the disk
+#define VIRTIO_BLK_T_OUT 1 // write the disk
+
+struct virtio_blk_req {
+	uint32 type;
+	uint32 reserved;
+	uint64 sector;
+};
+
+#endif /* __VIRTIO_H__ */
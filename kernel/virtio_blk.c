@@ -0,0 +1,266 @@
+// Driver for the virtio-mmio block device of the QEMU virt machine
+// (-device virtio-blk-device), after xv6's virtio_disk.c. Requests
+// complete asynchronously: the interrupt handler only acknowledges
+// the interrupt, and its bottom half (see workq.h) signals each
+// finished request's completion, which an async task awaits, or
+// calls its end_io.
+
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "cpu.h"
+#include "fdt.h"
+#include "kalloc.h"
+#include "klibc.h"
+#include "plic.h"
+#include "spinlock.h"
+#include "workq.h"
+#include "virtio_blk.h"
+
+#define R(r) ((volatile uint32 *)(disk.base + (r)))
+
+static struct {
+	uint64 base;
+	struct virtq_desc *desc;   // one page each, DMA-visible
+	struct virtq_avail *avail;
+	struct virtq_used *used;
+	char free[VIRTIO_NUM];     // is a descriptor free?
+	uint16 used_idx;           // how far the used ring has been read
+	struct blk_req *info[VIRTIO_NUM]; // request of each chain head
+	struct work work;          // the interrupt's bottom half
+	int defer;                 // finish requests there, not in the handler
+	spinlock_t lock;
+} disk = { .lock = SPIN_LOCK_INITIALIZER, .defer = 1 };
+
+static int
+alloc_desc(void)
+{
+	int i;
+
+	for (i = 0; i < VIRTIO_NUM; i++) {
+		if (disk.free[i]) {
+			disk.free[i] = 0;
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void
+free_chain(int i)
+{
+	int flags, next;
+
+	do {
+		flags = disk.desc[i].flags;
+		next = disk.desc[i].next;
+		memset(&disk.desc[i], 0, sizeof(disk.desc[i]));
+		disk.free[i] = 1;
+		i = next;
+	} while (flags & VRING_DESC_F_NEXT);
+}
+
+// Finish every request the device has used. Their end_io()s and
+// completions run with the disk unlocked, so that they may submit.
+static void
+finish_used(void)
+{
+	struct blk_req *r, *done = NULL, **tail = &done;
+	int id;
+
+	spin_lock(&disk.lock);
+	while (disk.used_idx != disk.used->idx) {
+		__sync_synchronize();
+		id = disk.used->ring[disk.used_idx % VIRTIO_NUM].id;
+		r = disk.info[id];
+		disk.info[id] = NULL;
+		free_chain(id);
+		disk.used_idx++;
+		if (r) {
+			r->next = NULL;
+			*tail = r;
+			tail = &r->next;
+		}
+	}
+	spin_unlock(&disk.lock);
+	while ((r = done)) {
+		done = r->next;
+		if (r->end_io)
+			r->end_io(r);
+		else
+			complete(&r->done);
+	}
+}
+
+static void
+virtio_blk_work(struct work **batch, int n)
+{
+	finish_used();
+}
+
+// Interrupts that come before the bottom half runs add nothing to
+// do: it finishes whatever is done by then.
+static void
+virtio_blk_intr(void *arg)
+{
+	*R(VIRTIO_MMIO_INTERRUPT_ACK) =
+		*R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+	__sync_synchronize();
+	if (__atomic_load_n(&disk.defer, __ATOMIC_RELAXED))
+		work_queue(&disk.work, WORK_CPU_ANY);
+	else
+		finish_used();
+}
+
+// Finish requests in the interrupt handler itself (0), or in its
+// bottom half (1, the default), for comparing the two.
+void
+virtio_blk_defer(int on)
+{
+	__atomic_store_n(&disk.defer, on, __ATOMIC_RELAXED);
+}
+
+// The virtio-mmio node of the block device, or -1.
+static int
+find_disk(int soc, int *irq)
+{
+	uint64 base;
+	uint32 v;
+	int node = -1;
+
+	while ((node = fdt_next_compatible(soc, node, "virtio,mmio")) >= 0) {
+		if (fdt_reg(soc, node, &base, NULL) < 0)
+			continue;
+		if (*(volatile uint32 *)(base + VIRTIO_MMIO_MAGIC_VALUE) !=
+		    VIRTIO_MAGIC ||
+		    *(volatile uint32 *)(base + VIRTIO_MMIO_DEVICE_ID) != 2)
+			continue;
+		if (fdt_getprop_u32(node, "interrupts", &v) < 0)
+			continue;
+		*irq = v;
+		disk.base = base;
+		return node;
+	}
+	return -1;
+}
+
+// Set up the disk, with its interrupt routed to CPU cpu.
+int
+virtio_blk_init(int cpu)
+{
+	uint64 features;
+	uint32 status = 0;
+	int i, irq;
+
+	if (find_disk(fdt_path_offset("/soc"), &irq) < 0)
+		return -1;
+	if (*R(VIRTIO_MMIO_VERSION) != 2) {
+		sbi_printf("virtio-blk: legacy device, boot QEMU with "
+			   "-global virtio-mmio.force-legacy=false\n");
+		return -1;
+	}
+
+	*R(VIRTIO_MMIO_STATUS) = status; // reset
+	status |= VIRTIO_CONFIG_S_ACKNOWLEDGE;
+	*R(VIRTIO_MMIO_STATUS) = status;
+	status |= VIRTIO_CONFIG_S_DRIVER;
+	*R(VIRTIO_MMIO_STATUS) = status;
+
+	features = *R(VIRTIO_MMIO_DEVICE_FEATURES);
+	features &= ~(1 << VIRTIO_BLK_F_RO);
+	features &= ~(1 << VIRTIO_BLK_F_SCSI);
+	features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
+	features &= ~(1 << VIRTIO_BLK_F_MQ);
+	features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
+	features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
+	features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
+	*R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
+	status |= VIRTIO_CONFIG_S_FEATURES_OK;
+	*R(VIRTIO_MMIO_STATUS) = status;
+	if (!(*R(VIRTIO_MMIO_STATUS) & VIRTIO_CONFIG_S_FEATURES_OK))
+		return -1;
+
+	*R(VIRTIO_MMIO_QUEUE_SEL) = 0;
+	if (*R(VIRTIO_MMIO_QUEUE_READY) ||
+	    *R(VIRTIO_MMIO_QUEUE_NUM_MAX) < VIRTIO_NUM)
+		return -1;
+	disk.desc = kalloc();
+	disk.avail = kalloc();
+	disk.used = kalloc();
+	if (!disk.desc || !disk.avail || !disk.used)
+		return -1;
+	memset(disk.desc, 0, PGSIZE);
+	memset(disk.avail, 0, PGSIZE);
+	memset(disk.used, 0, PGSIZE);
+	*R(VIRTIO_MMIO_QUEUE_NUM) = VIRTIO_NUM;
+	*R(VIRTIO_MMIO_QUEUE_DESC_LOW) = (uint64)disk.desc;
+	*R(VIRTIO_MMIO_QUEUE_DESC_HIGH) = (uint64)disk.desc >> 32;
+	*R(VIRTIO_MMIO_DRIVER_DESC_LOW) = (uint64)disk.avail;
+	*R(VIRTIO_MMIO_DRIVER_DESC_HIGH) = (uint64)disk.avail >> 32;
+	*R(VIRTIO_MMIO_DEVICE_DESC_LOW) = (uint64)disk.used;
+	*R(VIRTIO_MMIO_DEVICE_DESC_HIGH) = (uint64)disk.used >> 32;
+	*R(VIRTIO_MMIO_QUEUE_READY) = 1;
+	for (i = 0; i < VIRTIO_NUM; i++)
+		disk.free[i] = 1;
+	work_init(&disk.work, virtio_blk_work);
+
+	status |= VIRTIO_CONFIG_S_DRIVER_OK;
+	*R(VIRTIO_MMIO_STATUS) = status;
+
+	if (plic_enable(irq, cpu, virtio_blk_intr, NULL) < 0)
+		return -1;
+	sbi_printf("virtio-blk: at 0x%lx, irq %d on cpu%d\n", disk.base, irq,
+		   cpu);
+	return 0;
+}
+
+// Queue r; its done completes when the device has finished it.
+// Returns -1 without a disk or while all descriptors are in use.
+int
+virtio_blk_submit(struct blk_req *r)
+{
+	int idx[3], i;
+
+	if (!disk.desc)
+		return -1;
+	completion_init(&r->done);
+	spin_lock(&disk.lock);
+	for (i = 0; i < 3; i++) {
+		idx[i] = alloc_desc();
+		if (idx[i] < 0) {
+			while (i > 0)
+				disk.free[idx[--i]] = 1;
+			spin_unlock(&disk.lock);
+			return -1;
+		}
+	}
+
+	r->hdr.type = r->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+	r->hdr.reserved = 0;
+	r->hdr.sector = r->sector;
+	r->status = 0xff; // the device writes 0 on success
+
+	disk.desc[idx[0]].addr = (uint64)&r->hdr;
+	disk.desc[idx[0]].len = sizeof(r->hdr);
+	disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
+	disk.desc[idx[0]].next = idx[1];
+
+	disk.desc[idx[1]].addr = (uint64)r->buf;
+	disk.desc[idx[1]].len = r->len;
+	disk.desc[idx[1]].flags = VRING_DESC_F_NEXT |
+				  (r->write ? 0 : VRING_DESC_F_WRITE);
+	disk.desc[idx[1]].next = idx[2];
+
+	disk.desc[idx[2]].addr = (uint64)&r->status;
+	disk.desc[idx[2]].len = 1;
+	disk.desc[idx[2]].flags = VRING_DESC_F_WRITE;
+	disk.desc[idx[2]].next = 0;
+
+	disk.info[idx[0]] = r;
+	disk.avail->ring[disk.avail->idx % VIRTIO_NUM] = idx[0];
+	__sync_synchronize();
+	disk.avail->idx += 1;
+	__sync_synchronize();
+	*R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0;
+	spin_unlock(&disk.lock);
+	return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef __VIRTIO_BLK_H__
+#define __VIRTIO_BLK_H__
+
+#include "types.h"
+#include "async.h"
+#include "virtio.h"
+
+#define BLK_SECTOR_SIZE 512
+
+// One disk request. The caller fills in sector, buf, len and write,
+// submits it and awaits done; status is then 0 on success. With
+// end_io set, the interrupt's bottom half calls that instead of
+// completing done. It may submit, but not yield or park.
+struct blk_req {
+	uint64 sector;
+	void *buf;               // physical address, len bytes
+	uint32 len;              // a multiple of BLK_SECTOR_SIZE
+	int write;
+	volatile uint8 status;   // written by the device
+	struct completion done;
+	void (*end_io)(struct blk_req *r);
+	struct virtio_blk_req hdr; // driver private
+	struct blk_req *next;
+};
+
+int
+virtio_blk_init(int cpu);
+
+int
+virtio_blk_submit(struct blk_req *r);
+
+void
+virtio_blk_defer(int on);
+
+#endif /* __VIRTIO_BLK_H__ */
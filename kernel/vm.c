@@ -0,0 +1,951 @@
+// Sv39 page tables. Every table maps the low 4 GiB one-to-one with
+// kernel-only 1 GiB megapages, so the kernel runs the same whichever
+// table is loaded and traps need no satp switch. They are split
+// down to 4 KiB pages only around the kernel stacks' guard pages,
+// which stay unmapped. User memory lies above that and is filled in
+// lazily by vm_fault().
+//
+// User pages that are not the page cache's are reference counted
+// (kalloc.h): fork shares them copy-on-write, and anonymous memory
+// that has only been read maps the one zero page.
+//
+// Anonymous memory is backed by 2 MiB megapages, level-1 leaf PTEs,
+// wherever a vma covers a whole aligned 2 MiB that has no 4 KiB page
+// mapped yet and kalloc_huge() finds a free chunk; elsewhere by 4 KiB
+// pages. A change to part of a megapage (munmap, mprotect, a
+// copy-on-write store without a free chunk) splits it into pages
+// first.
+
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "memlayout.h"
+#include "kalloc.h"
+#include "klibc.h"
+#include "file.h"
+#include "proc.h"
+#include "kstack.h"
+#include "vm.h"
+
+#define KERNEL_GIGAPAGES (KERNEL_MAP_END >> PXSHIFT(2))
+#define RA_PAGES 32 // fault-around window of a sequential mapping
+
+pagetable_t kernel_pagetable;
+static char *zero_page;
+
+static struct {
+	uint64 huge;     // megapages mapped by vm_fault()
+	uint64 fallback; // faults that wanted one, but no chunk was free
+	uint64 split;    // megapages split into pages
+} thp_stat;
+
+// Build the kernel page table, on the boot hart once kalloc() works.
+void
+kvminit(void)
+{
+	uint64 i;
+
+	kernel_pagetable = kalloc();
+	if (!kernel_pagetable)
+		sbi_panic("kvminit: out of memory");
+	memset(kernel_pagetable, 0, PGSIZE);
+	// A and D preset: the hardware need not update them, nor
+	// fault to have them updated.
+	for (i = 0; i < KERNEL_GIGAPAGES; i++)
+		kernel_pagetable[i] = PA2PTE(i << PXSHIFT(2)) | PTE_V |
+				      PTE_R | PTE_W | PTE_X | PTE_G |
+				      PTE_A | PTE_D;
+
+	kstack_unmap_guards();
+
+	zero_page = kalloc();
+	if (!zero_page)
+		sbi_panic("kvminit: out of memory");
+	memset(zero_page, 0, PGSIZE);
+}
+
+// Unmap the kernel page at va, splitting the megapages that map it
+// down to 4 KiB pages. Every page table shares the tables below the
+// root, so this holds in all of them; for kvminit(), before any hart
+// has the kernel table loaded.
+void
+kvm_unmap(uint64 va)
+{
+	pte_t *pte = &kernel_pagetable[PX(2, va)];
+	pagetable_t pagetable;
+	uint64 pa, flags, size, i;
+	int level;
+
+	for (level = 2; level > 0; level--) {
+		if (PTE_LEAF(*pte)) {
+			pagetable = kalloc();
+			if (!pagetable)
+				sbi_panic("kvm_unmap: out of memory");
+			pa = PTE2PA(*pte);
+			flags = PTE_FLAGS(*pte);
+			size = 1L << PXSHIFT(level - 1);
+			for (i = 0; i < 512; i++)
+				pagetable[i] = PA2PTE(pa + i * size) | flags;
+			*pte = PA2PTE(pagetable) | PTE_V;
+		}
+		pte = &((pagetable_t)PTE2PA(*pte))[PX(level - 1, va)];
+	}
+	*pte = 0;
+}
+
+// Drop a mapping's reference to the user page at pa. The zero page
+// is never freed.
+static void
+vm_page_put(uint64 pa)
+{
+	if (pa != (uint64)zero_page)
+		page_put((void *)pa);
+}
+
+// Turn on paging, on each hart.
+void
+kvminithart(void)
+{
+	sfence_vma();
+	w_satp(MAKE_SATP(kernel_pagetable));
+	sfence_vma();
+}
+
+// Load pagetable, or the kernel's for NULL.
+void
+vm_switch(pagetable_t pagetable)
+{
+	w_satp(MAKE_SATP(pagetable ? pagetable : kernel_pagetable));
+	sfence_vma();
+}
+
+// A new user page table: the kernel mapping and nothing else.
+pagetable_t
+uvm_create(void)
+{
+	pagetable_t pagetable = kalloc();
+
+	if (!pagetable)
+		return NULL;
+	memset(pagetable, 0, PGSIZE);
+	memmove(pagetable, kernel_pagetable,
+		KERNEL_GIGAPAGES * sizeof(pte_t));
+	return pagetable;
+}
+
+// Free a page table page and everything below it, but pages that
+// belong to the page cache.
+static void
+freewalk(pagetable_t pagetable, int level)
+{
+	pte_t pte;
+	int i;
+
+	for (i = 0; i < 512; i++) {
+		pte = pagetable[i];
+		if (!(pte & PTE_V))
+			continue;
+		if (level > 0 && !PTE_LEAF(pte))
+			freewalk((pagetable_t)PTE2PA(pte), level - 1);
+		else if (level > 0)
+			page_put_huge((void *)PTE2PA(pte));
+		else if (!(pte & PTE_CACHE))
+			vm_page_put(PTE2PA(pte));
+	}
+	kfree(pagetable);
+}
+
+// Free a user page table and all of its user memory. Not the one
+// loaded on this hart.
+void
+uvm_free(pagetable_t pagetable)
+{
+	uint64 i;
+
+	for (i = KERNEL_GIGAPAGES; i < 512; i++) {
+		if (pagetable[i] & PTE_V)
+			freewalk((pagetable_t)PTE2PA(pagetable[i]), 1);
+	}
+	kfree(pagetable);
+}
+
+// The PTE at level of the table *pte points at, for va, creating
+// the table if alloc != 0.
+static pte_t *
+walk_next(pte_t *pte, int level, uint64 va, int alloc)
+{
+	pagetable_t pagetable;
+
+	if (*pte & PTE_V) {
+		pagetable = (pagetable_t)PTE2PA(*pte);
+	} else {
+		if (!alloc || (pagetable = kalloc()) == 0)
+			return NULL;
+		memset(pagetable, 0, PGSIZE);
+		*pte = PA2PTE(pagetable) | PTE_V;
+	}
+	return &pagetable[PX(level, va)];
+}
+
+// The level-1 PTE for user virtual address va: a megapage if it is
+// a leaf, else the level-0 table.
+static pte_t *
+walk_l1(pagetable_t pagetable, uint64 va, int alloc)
+{
+	if (va < USER_BASE || va >= MAXVA)
+		return NULL;
+	return walk_next(&pagetable[PX(2, va)], 1, va, alloc);
+}
+
+// Return the address of the PTE in page table pagetable that
+// corresponds to user virtual address va. If alloc != 0, create any
+// required page-table pages. NULL where a megapage maps va.
+pte_t *
+walk(pagetable_t pagetable, uint64 va, int alloc)
+{
+	pte_t *pte = walk_l1(pagetable, va, alloc);
+
+	if (!pte || PTE_LEAF(*pte))
+		return NULL;
+	return walk_next(pte, 0, va, alloc);
+}
+
+// The PTE that maps va, a megapage's or a page's; *size gets which.
+static pte_t *
+uvm_pte(pagetable_t pagetable, uint64 va, uint64 *size)
+{
+	pte_t *pte = walk_l1(pagetable, va, 0);
+
+	*size = HPGSIZE;
+	if (pte && (*pte & PTE_V) && !PTE_LEAF(*pte)) {
+		*size = PGSIZE;
+		pte = walk(pagetable, va, 0);
+	}
+	return pte;
+}
+
+// Replace the megapage mapping *pte of the 2 MiB at hva with 512
+// PTEs for its pages, to change part of it. A huge page that only
+// this mapping holds is split in place; a shared one is copied.
+static int
+huge_split(pte_t *pte, uint64 hva)
+{
+	uint64 pa = PTE2PA(*pte), flags = PTE_FLAGS(*pte), i;
+	pagetable_t l0 = kalloc();
+	char *page;
+
+	if (!l0)
+		return -1;
+	if (page_refs((void *)pa) == 1) {
+		kalloc_split_huge((void *)pa);
+		for (i = 0; i < 512; i++)
+			l0[i] = PA2PTE(pa + i * PGSIZE) | flags;
+	} else {
+		for (i = 0; i < 512; i++) {
+			page = kalloc();
+			if (!page) {
+				while (i-- > 0)
+					kfree((void *)PTE2PA(l0[i]));
+				kfree(l0);
+				return -1;
+			}
+			memmove(page, (char *)pa + i * PGSIZE, PGSIZE);
+			l0[i] = PA2PTE(page) | flags;
+		}
+		page_put_huge((void *)pa);
+	}
+	*pte = PA2PTE(l0) | PTE_V;
+	sfence_vma();
+	__atomic_fetch_add(&thp_stat.split, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+// uvm_copy() of the megapage that *pte maps at va.
+static int
+uvm_copy_huge(pte_t *pte, struct proc *new, uint64 va, int copy)
+{
+	uint64 pa = PTE2PA(*pte), flags = PTE_FLAGS(*pte), i;
+	pte_t *npte = walk_l1(new->pagetable, va, 1), *pte0;
+	char *page;
+
+	if (!npte)
+		return -1;
+	if (copy) {
+		page = kalloc_huge();
+		if (!page) {
+			// no chunk free: copy it as pages
+			for (i = 0; i < 512; i++) {
+				pte0 = walk(new->pagetable, va + i * PGSIZE,
+					    1);
+				if (!pte0 || !(page = kalloc()))
+					return -1;
+				memmove(page, (char *)pa + i * PGSIZE,
+					PGSIZE);
+				*pte0 = PA2PTE(page) | flags;
+				new->rss++;
+			}
+			return 0;
+		}
+		memmove(page, (void *)pa, HPGSIZE);
+		pa = (uint64)page;
+	} else {
+		if (flags & PTE_W)
+			flags = (flags & ~PTE_W) | PTE_COW;
+		*pte = PA2PTE(pa) | flags;
+		page_get((void *)pa);
+	}
+	*npte = PA2PTE(pa) | flags;
+	new->rss += HPGSIZE / PGSIZE;
+	return 0;
+}
+
+// Map every page of old's shared anonymous vmas that is not mapped
+// yet, so that fork() has a page to share: one the parent and the
+// child each faulted in later would be two.
+static int
+shared_populate(struct proc *old)
+{
+	struct vma *v;
+	uint64 va, size;
+	pte_t *pte;
+	int i;
+
+	for (i = 0; i < old->nvma; i++) {
+		v = &old->vma[i];
+		if (v->file || !(v->flags & VMA_SHARED))
+			continue;
+		for (va = v->start; va < v->end; va += PGSIZE) {
+			pte = uvm_pte(old->pagetable, va, &size);
+			if ((!pte || !(*pte & PTE_V)) &&
+			    vm_fault(old, va, 0) < 0)
+				return -1;
+		}
+	}
+	return 0;
+}
+
+// Copy old's user memory into new, for fork(). Page cache pages
+// and read-only pages are shared. Writable ones are shared too,
+// read-only and copy-on-write in both, unless copy asks for them
+// to be copied now as xv6 does. Shared anonymous memory is mapped
+// in old first and then stays shared.
+int
+uvm_copy(struct proc *old, struct proc *new, int copy)
+{
+	pagetable_t l1, l0;
+	uint64 i, j, k, va, pa, flags;
+	pte_t *pte;
+	char *page;
+
+	if (shared_populate(old) < 0)
+		return -1;
+	for (i = KERNEL_GIGAPAGES; i < 512; i++) {
+		if (!(old->pagetable[i] & PTE_V))
+			continue;
+		l1 = (pagetable_t)PTE2PA(old->pagetable[i]);
+		for (j = 0; j < 512; j++) {
+			if (!(l1[j] & PTE_V))
+				continue;
+			if (PTE_LEAF(l1[j])) {
+				va = i << PXSHIFT(2) | j << PXSHIFT(1);
+				if (uvm_copy_huge(&l1[j], new, va, copy) < 0)
+					return -1;
+				continue;
+			}
+			l0 = (pagetable_t)PTE2PA(l1[j]);
+			for (k = 0; k < 512; k++) {
+				if (!(l0[k] & PTE_V))
+					continue;
+				va = i << PXSHIFT(2) | j << PXSHIFT(1) |
+				     k << PXSHIFT(0);
+				pa = PTE2PA(l0[k]);
+				flags = PTE_FLAGS(l0[k]);
+				pte = walk(new->pagetable, va, 1);
+				if (!pte)
+					return -1;
+				if (flags & PTE_CACHE) {
+					// owned by the cache
+				} else if (vma_find(old, va)->flags &
+					   VMA_SHARED) {
+					page_get((void *)pa);
+				} else if (copy && pa != (uint64)zero_page) {
+					page = kalloc();
+					if (!page)
+						return -1;
+					memmove(page, (void *)pa, PGSIZE);
+					pa = (uint64)page;
+				} else {
+					if (flags & PTE_W)
+						flags = (flags & ~PTE_W) |
+							PTE_COW;
+					l0[k] = PA2PTE(pa) | flags;
+					if (pa != (uint64)zero_page)
+						page_get((void *)pa);
+				}
+				*pte = PA2PTE(pa) | flags;
+				new->rss++;
+			}
+		}
+	}
+	// old is the address space loaded on this hart.
+	sfence_vma();
+	return 0;
+}
+
+// The level-0 PTE for va below a level-1 PTE: NULL for none, a
+// megapage split first when [start, end) covers only part of it, and
+// *next past it instead when the range covers all of it.
+static pte_t *
+range_pte(pte_t *l1, uint64 va, uint64 start, uint64 end, uint64 *next,
+	  int *err)
+{
+	uint64 hva = va & ~(HPGSIZE - 1);
+
+	*next = hva + HPGSIZE;
+	if (!l1 || !(*l1 & PTE_V))
+		return NULL;
+	if (PTE_LEAF(*l1)) {
+		if (hva >= start && hva + HPGSIZE <= end)
+			return NULL;
+		if (huge_split(l1, hva) < 0) {
+			*err = -1;
+			return NULL;
+		}
+	}
+	*next = va + PGSIZE;
+	return &((pagetable_t)PTE2PA(*l1))[PX(0, va)];
+}
+
+// Unmap the user pages of [start, end), page aligned. Fails without
+// the memory to split a megapage that straddles an end.
+int
+uvm_unmap(struct proc *p, uint64 start, uint64 end)
+{
+	uint64 va, next;
+	pte_t *l1, *pte;
+	int err = 0;
+
+	for (va = start; va < end; va = next) {
+		l1 = walk_l1(p->pagetable, va, 0);
+		pte = range_pte(l1, va, start, end, &next, &err);
+		if (err)
+			break;
+		if (l1 && PTE_LEAF(*l1)) {
+			page_put_huge((void *)PTE2PA(*l1));
+			*l1 = 0;
+			p->rss -= HPGSIZE / PGSIZE;
+			continue;
+		}
+		if (!pte || !(*pte & PTE_V))
+			continue;
+		if (!(*pte & PTE_CACHE))
+			vm_page_put(PTE2PA(*pte));
+		*pte = 0;
+		p->rss--;
+	}
+	sfence_vma();
+	return err;
+}
+
+// A PTE with its permissions changed to prot. A page that becomes
+// writable is made copy on write unless it was writable already or
+// belongs to a shared mapping: cow_break() knows whether a private
+// one is shared. PROT_NONE keeps the PTE a leaf, out of user reach.
+static pte_t
+pte_protect(pte_t pte, int prot, int shared)
+{
+	uint64 w = (pte & PTE_W) || shared;
+
+	pte &= ~(PTE_R | PTE_W | PTE_X | PTE_U | PTE_COW);
+	if (!prot)
+		return pte | PTE_R;
+	pte |= (prot & (PTE_R | PTE_X)) | PTE_U;
+	if (prot & PTE_W)
+		pte |= w ? PTE_W : PTE_COW;
+	return pte;
+}
+
+// Change the permissions of the pages mapped in [start, end) to
+// prot, like uvm_unmap(). shared: the range is MAP_SHARED memory,
+// whose pages are writable in place.
+int
+uvm_protect(struct proc *p, uint64 start, uint64 end, int prot,
+	    int shared)
+{
+	uint64 va, next;
+	pte_t *l1, *pte;
+	int err = 0;
+
+	for (va = start; va < end; va = next) {
+		l1 = walk_l1(p->pagetable, va, 0);
+		pte = range_pte(l1, va, start, end, &next, &err);
+		if (err)
+			break;
+		if (l1 && PTE_LEAF(*l1))
+			*l1 = pte_protect(*l1, prot, shared);
+		else if (pte && (*pte & PTE_V))
+			*pte = pte_protect(*pte, prot, shared);
+	}
+	sfence_vma();
+	return err;
+}
+
+// Map [start, end) of p, page aligned, as described in struct vma.
+// It may be empty, like the heap before the first sbrk().
+int
+vma_add(struct proc *p, uint64 start, uint64 end, int prot, int flags,
+	struct file *file, uint64 off, uint64 file_end)
+{
+	struct vma *v;
+	int i;
+
+	if (p->nvma == NVMA || start > end || start < USER_BASE ||
+	    end > MAXVA || (start | end | off) % PGSIZE != 0)
+		return -1;
+	for (i = 0; i < p->nvma; i++)
+		if (start < p->vma[i].end && p->vma[i].start < end)
+			return -1;
+	v = &p->vma[p->nvma++];
+	v->start = start;
+	v->end = end;
+	v->prot = prot;
+	v->flags = flags;
+	v->file = file;
+	v->off = off;
+	v->file_end = file ? file_end : start;
+	return 0;
+}
+
+struct vma *
+vma_find(struct proc *p, uint64 va)
+{
+	int i;
+
+	for (i = 0; i < p->nvma; i++)
+		if (va >= p->vma[i].start && va < p->vma[i].end)
+			return &p->vma[i];
+	return NULL;
+}
+
+// Split the vma that contains addr, if any, in two at addr.
+int
+vma_split(struct proc *p, uint64 addr)
+{
+	struct vma *v = vma_find(p, addr), *n;
+
+	if (!v || v->start == addr)
+		return 0;
+	if (p->nvma == NVMA)
+		return -1;
+	n = &p->vma[p->nvma++];
+	*n = *v;
+	v->end = addr;
+	n->start = addr;
+	if (n->file)
+		n->off += addr - v->start;
+	return 0;
+}
+
+// Drop the vmas that lie inside [start, end); their pages must be
+// unmapped already.
+void
+vma_remove(struct proc *p, uint64 start, uint64 end)
+{
+	int i, j;
+
+	for (i = j = 0; i < p->nvma; i++)
+		if (p->vma[i].start < start || p->vma[i].end > end)
+			p->vma[j++] = p->vma[i];
+	p->nvma = j;
+}
+
+// Store to a copy-on-write page: take it over if nobody else maps
+// it any more, else copy it. A page cache page, made writable by
+// mprotect(), is always copied.
+static int
+cow_break(pte_t *pte, uint64 va)
+{
+	uint64 pa = PTE2PA(*pte), cache = *pte & PTE_CACHE;
+	uint64 flags = (PTE_FLAGS(*pte) & ~(PTE_COW | PTE_CACHE)) | PTE_W;
+	char *page;
+
+	if (!cache && pa != (uint64)zero_page &&
+	    page_refs((void *)pa) == 1) {
+		*pte = PA2PTE(pa) | flags;
+	} else {
+		page = kalloc();
+		if (!page)
+			return -1;
+		memmove(page, (void *)pa, PGSIZE);
+		*pte = PA2PTE(page) | flags;
+		if (!cache)
+			vm_page_put(pa);
+	}
+	sfence_vma_page(va);
+	return 0;
+}
+
+// cow_break() for a megapage, into a new huge page. Fails if no
+// chunk is free; the caller then splits it and breaks the one page.
+static int
+huge_cow(pte_t *pte, uint64 va)
+{
+	uint64 pa = PTE2PA(*pte);
+	uint64 flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+	char *page;
+
+	if (page_refs((void *)pa) == 1) {
+		*pte = PA2PTE(pa) | flags;
+	} else {
+		page = kalloc_huge();
+		if (!page)
+			return -1;
+		memmove(page, (void *)pa, HPGSIZE);
+		*pte = PA2PTE(page) | flags;
+		page_put_huge((void *)pa);
+	}
+	sfence_vma_page(va);
+	return 0;
+}
+
+// Map a zeroed megapage at the 2 MiB around va for a fault in
+// anonymous memory, if v covers all of it and huge pages are not
+// turned off for it. *l1 is its empty level-1 PTE.
+static int
+huge_fault(struct proc *p, struct vma *v, uint64 va, pte_t *l1)
+{
+	uint64 hva = va & ~(HPGSIZE - 1);
+	char *page;
+
+	if (v->file || (v->flags & (VMA_NOHUGE | VMA_SHARED)) ||
+	    hva < v->start ||
+	    hva + HPGSIZE > v->end)
+		return -1;
+	page = kalloc_huge();
+	if (!page) {
+		__atomic_fetch_add(&thp_stat.fallback, 1, __ATOMIC_RELAXED);
+		return -1;
+	}
+	memset(page, 0, HPGSIZE);
+	*l1 = PA2PTE(page) | v->prot | PTE_U | PTE_V | PTE_A | PTE_D;
+	sfence_vma_page(hva);
+	p->rss += HPGSIZE / PGSIZE;
+	__atomic_fetch_add(&thp_stat.huge, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+// Whether a fault at va of v for access maps the cached page itself:
+// always in a shared mapping, and in a private one for a page wholly
+// inside the file's data that is not being written to.
+static int
+maps_cache(struct vma *v, uint64 va, int access)
+{
+	if (!v->file || (v->flags & VMA_COPY) || va >= v->file_end)
+		return 0;
+	if (v->flags & VMA_SHARED)
+		return 1;
+	return access != PTE_W && va + PGSIZE <= v->file_end;
+}
+
+// The PTE mapping cached page for v: copy on write if the mapping is
+// private and writable.
+static pte_t
+cache_pte(struct vma *v, char *page)
+{
+	uint64 perm = v->prot | PTE_U | PTE_V | PTE_A | PTE_D | PTE_CACHE;
+
+	if (!(v->flags & VMA_SHARED) && (perm & PTE_W))
+		perm = (perm & ~PTE_W) | PTE_COW;
+	return PA2PTE(page) | perm;
+}
+
+// Fault-around for a vma read sequentially (MADV_SEQUENTIAL): map
+// up to RA_PAGES cached pages after va as well, reading them into
+// the cache as needed, so that a scan faults once per window.
+static void
+fault_around(struct proc *p, struct vma *v, uint64 va)
+{
+	uint64 end = va + RA_PAGES * PGSIZE;
+	pte_t *pte;
+	char *page;
+
+	if (end > v->end)
+		end = v->end;
+	for (va += PGSIZE; va < end && maps_cache(v, va, PTE_R);
+	     va += PGSIZE) {
+		pte = walk(p->pagetable, va, 1);
+		if (!pte || (*pte & PTE_V))
+			break;
+		page = pcache_get(v->file, (v->off + (va - v->start)) /
+					   PGSIZE);
+		if (!page)
+			break;
+		*pte = cache_pte(v, page);
+		p->rss++;
+	}
+	sfence_vma();
+}
+
+// Map the page at va on a fault for access (PTE_R, PTE_W or PTE_X;
+// 0 to populate without a fault). A page of a shared file mapping,
+// and one wholly inside the file that is not written to, is the
+// cached page itself, shared by every process mapping it (copy on
+// write if the mapping is private); a page past the file's data
+// that is only read is the zero page; any other page is a private
+// zeroed page with its part of the file copied in; anonymous memory
+// gets a megapage where it can. A store to a copy-on-write page
+// copies it. Returns -1 for a bad address or access, past the end
+// of a shared file mapping's file, or without memory.
+int
+vm_fault(struct proc *p, uint64 va, int access)
+{
+	struct vma *v = vma_find(p, va);
+	uint64 pgoff, n, perm;
+	pte_t *l1, *pte;
+	char *page, *src;
+
+	va = PGROUNDDOWN(va);
+	if (!v || (access & ~v->prot))
+		return -1;
+	l1 = walk_l1(p->pagetable, va, 1);
+	if (!l1)
+		return -1;
+	if (PTE_LEAF(*l1)) {
+		if (!(access & PTE_W) || !(*l1 & PTE_COW))
+			return -1;
+		if (huge_cow(l1, va) == 0)
+			return 0;
+		if (huge_split(l1, va & ~(HPGSIZE - 1)) < 0)
+			return -1;
+	} else if (!(*l1 & PTE_V) && huge_fault(p, v, va, l1) == 0) {
+		return 0;
+	}
+	pte = walk(p->pagetable, va, 1);
+	if (!pte)
+		return -1;
+	if (*pte & PTE_V) {
+		if ((access & PTE_W) && (*pte & PTE_COW))
+			return cow_break(pte, va);
+		return -1; // a protection fault on a mapped page
+	}
+	perm = v->prot | PTE_U | PTE_V | PTE_A | PTE_D;
+
+	pgoff = (v->off + (va - v->start)) / PGSIZE;
+	if (maps_cache(v, va, access)) {
+		page = pcache_get(v->file, pgoff);
+		if (!page)
+			return -1;
+		*pte = cache_pte(v, page);
+		sfence_vma_page(va);
+		p->rss++;
+		if (v->flags & VMA_SEQ)
+			fault_around(p, v, va);
+		return 0;
+	} else if (v->file && (v->flags & VMA_SHARED)) {
+		return -1;
+	} else if (access != PTE_W &&
+		   !(v->flags & (VMA_COPY | VMA_SHARED)) &&
+		   va >= v->file_end) {
+		page = zero_page;
+		if (perm & PTE_W)
+			perm = (perm & ~PTE_W) | PTE_COW;
+	} else {
+		page = kalloc();
+		if (!page)
+			return -1;
+		memset(page, 0, PGSIZE);
+		if (va < v->file_end) {
+			src = pcache_get(v->file, pgoff);
+			if (!src) {
+				kfree(page);
+				return -1;
+			}
+			n = v->file_end - va < PGSIZE ? v->file_end - va :
+							PGSIZE;
+			memmove(page, src, n);
+		}
+	}
+	*pte = PA2PTE(page) | perm;
+	sfence_vma_page(va);
+	p->rss++;
+	return 0;
+}
+
+// Physical address of the user page at va, made present (and
+// private, for a store) for access first, or 0.
+static uint64
+uvm_page(struct proc *p, uint64 va, int access)
+{
+	uint64 size;
+	pte_t *pte = uvm_pte(p->pagetable, va, &size);
+
+	if (!pte || !(*pte & PTE_V) ||
+	    ((access & PTE_W) && (*pte & PTE_COW))) {
+		if (vm_fault(p, va, access) < 0)
+			return 0;
+		pte = uvm_pte(p->pagetable, va, &size);
+	}
+	if ((*pte & (access | PTE_U)) != (access | PTE_U))
+		return 0;
+	return PTE2PA(*pte) + (va & (size - 1));
+}
+
+// Physical address of user address va, made present for access
+// like copyin() and copyout() do, or 0.
+uint64
+uvm_pa(struct proc *p, uint64 va, int access)
+{
+	uint64 pa = uvm_page(p, PGROUNDDOWN(va), access);
+
+	return pa ? pa + va % PGSIZE : 0;
+}
+
+// Pin the user page at va for DMA: the physical address of va, made
+// present and writable, with a reference on the page that keeps it
+// after p unmaps it, until page_put(). Only MAP_SHARED anonymous
+// pages qualify, which are never megapages and never copy on write,
+// so the device and p always see the same page. 0 if not.
+uint64
+uvm_pin(struct proc *p, uint64 va)
+{
+	struct vma *v = vma_find(p, va);
+	uint64 pa;
+
+	if (!v || v->file || !(v->flags & VMA_SHARED))
+		return 0;
+	pa = uvm_pa(p, va, PTE_W);
+	if (pa)
+		page_get((void *)PGROUNDDOWN(pa));
+	return pa;
+}
+
+// Lend the user page at va to a pipe: its physical address, with a
+// new reference for the caller, and p's PTE made copy on write, so
+// that p's next store to it gets a copy instead of changing what the
+// pipe holds. Only a whole private 4 KiB page of p's own qualifies;
+// 0 otherwise, and the caller copies the data instead.
+uint64
+uvm_loan(struct proc *p, uint64 va)
+{
+	struct vma *v = vma_find(p, va);
+	pte_t *pte;
+	uint64 pa;
+
+	if (!v || (v->flags & VMA_SHARED) || !uvm_page(p, va, PTE_R))
+		return 0;
+	pte = walk(p->pagetable, va, 0);
+	if (!pte || (*pte & PTE_CACHE))
+		return 0; // a megapage, or the cache's
+	pa = PTE2PA(*pte);
+	if (pa == (uint64)zero_page)
+		return 0;
+	if (*pte & PTE_W) {
+		*pte = (*pte & ~PTE_W) | PTE_COW;
+		sfence_vma_page(va);
+	}
+	page_get((void *)pa);
+	return pa;
+}
+
+// Map the page pa at va in place of whatever p has there, handing
+// over the caller's reference to it: read-only and copy on write,
+// since a writer that lent it may map it still. va must be in
+// writable private anonymous memory not mapped by a megapage; -1
+// otherwise, and the caller keeps pa.
+int
+uvm_remap(struct proc *p, uint64 va, uint64 pa)
+{
+	struct vma *v = vma_find(p, va);
+	pte_t *l1, *pte;
+
+	if (!v || v->file || (v->flags & VMA_SHARED) || !(v->prot & PTE_W))
+		return -1;
+	l1 = walk_l1(p->pagetable, va, 1);
+	if (!l1 || PTE_LEAF(*l1) || !(pte = walk(p->pagetable, va, 1)))
+		return -1;
+	if (*pte & PTE_V)
+		vm_page_put(PTE2PA(*pte));
+	else
+		p->rss++;
+	*pte = PA2PTE(pa) | (v->prot & ~PTE_W) | PTE_COW | PTE_U | PTE_V |
+	       PTE_A | PTE_D;
+	sfence_vma_page(va);
+	return 0;
+}
+
+// Copy from kernel to user, like xv6's copyout(): through the
+// kernel's mapping of each physical page, so p need not be the
+// address space loaded.
+int
+copyout(struct proc *p, uint64 dstva, const void *src, uint64 n)
+{
+	uint64 n0, va0, pa0;
+
+	while (n > 0) {
+		va0 = PGROUNDDOWN(dstva);
+		pa0 = uvm_page(p, va0, PTE_W);
+		if (pa0 == 0)
+			return -1;
+		n0 = PGSIZE - (dstva - va0);
+		if (n0 > n)
+			n0 = n;
+		memmove((void *)(pa0 + (dstva - va0)), src, n0);
+		n -= n0;
+		src = (const char *)src + n0;
+		dstva = va0 + PGSIZE;
+	}
+	return 0;
+}
+
+// Copy a NUL-terminated string from user to kernel, at most max
+// bytes including the NUL.
+int
+copyinstr(struct proc *p, char *dst, uint64 srcva, uint64 max)
+{
+	uint64 n0, va0, pa0;
+	char *s;
+
+	while (max > 0) {
+		va0 = PGROUNDDOWN(srcva);
+		pa0 = uvm_page(p, va0, PTE_R);
+		if (pa0 == 0)
+			return -1;
+		n0 = PGSIZE - (srcva - va0);
+		if (n0 > max)
+			n0 = max;
+		for (s = (char *)(pa0 + (srcva - va0)); n0 > 0; n0--, max--)
+			if ((*dst++ = *s++) == '\0')
+				return 0;
+		srcva = va0 + PGSIZE;
+	}
+	return -1;
+}
+
+// Copy from user to kernel.
+int
+copyin(struct proc *p, void *dst, uint64 srcva, uint64 n)
+{
+	uint64 n0, va0, pa0;
+
+	while (n > 0) {
+		va0 = PGROUNDDOWN(srcva);
+		pa0 = uvm_page(p, va0, PTE_R);
+		if (pa0 == 0)
+			return -1;
+		n0 = PGSIZE - (srcva - va0);
+		if (n0 > n)
+			n0 = n;
+		memmove(dst, (void *)(pa0 + (srcva - va0)), n0);
+		n -= n0;
+		dst = (char *)dst + n0;
+		srcva = va0 + PGSIZE;
+	}
+	return 0;
+}
+
+void
+vm_report(void)
+{
+	sbi_printf("vm: %lu megapages mapped, %lu fell back to pages, "
+		   "%lu split\n", thp_stat.huge, thp_stat.fallback,
+		   thp_stat.split);
+}
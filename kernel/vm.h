@@ -0,0 +1,108 @@
+#ifndef __VM_H__
+#define __VM_H__
+
+#include "types.h"
+#include "riscv.h"
+
+// Set on user PTEs that map a page cache page: the page belongs to
+// the cache, so unmapping it must not free it.
+#define PTE_CACHE PTE_RSW0
+// Set on user PTEs of writable memory mapped read-only because the
+// page is shared (after fork, or the zero page): copy on write.
+#define PTE_COW PTE_RSW1
+
+struct file;
+struct proc;
+
+// A mapped range of a user address space. Pages are filled in by
+// vm_fault() on first touch: from file up to file_end, zero after.
+struct vma {
+	uint64 start;       // page aligned
+	uint64 end;         // page aligned
+	int prot;           // PTE_R, PTE_W, PTE_X
+	int flags;          // VMA_*
+	struct file *file;  // NULL: anonymous, all zero
+	uint64 off;         // page aligned offset of start in file
+	uint64 file_end;    // address where file data ends
+};
+
+#define VMA_COPY   1  // copy file pages even where the cached page could be mapped
+#define VMA_HEAP   2  // the heap, grown and shrunk by sbrk()
+#define VMA_NOHUGE 4  // anonymous memory in 4 KiB pages only, see madvise()
+#define VMA_SHARED 8  // MAP_SHARED: the file's cached pages, or anonymous pages fork shares
+#define VMA_SEQ    16 // MADV_SEQUENTIAL: fault around, see vm_fault()
+
+extern pagetable_t kernel_pagetable;
+
+void
+kvminit(void);
+
+void
+kvminithart(void);
+
+void
+kvm_unmap(uint64 va);
+
+void
+vm_switch(pagetable_t pagetable);
+
+pagetable_t
+uvm_create(void);
+
+void
+uvm_free(pagetable_t pagetable);
+
+pte_t *
+walk(pagetable_t pagetable, uint64 va, int alloc);
+
+int
+vma_add(struct proc *p, uint64 start, uint64 end, int prot, int flags,
+	struct file *file, uint64 off, uint64 file_end);
+
+int
+uvm_copy(struct proc *old, struct proc *new, int copy);
+
+int
+uvm_unmap(struct proc *p, uint64 start, uint64 end);
+
+int
+uvm_protect(struct proc *p, uint64 start, uint64 end, int prot,
+	    int shared);
+
+struct vma *
+vma_find(struct proc *p, uint64 va);
+
+int
+vma_split(struct proc *p, uint64 addr);
+
+void
+vma_remove(struct proc *p, uint64 start, uint64 end);
+
+int
+vm_fault(struct proc *p, uint64 va, int access);
+
+int
+copyin(struct proc *p, void *dst, uint64 srcva, uint64 n);
+
+uint64
+uvm_pa(struct proc *p, uint64 va, int access);
+
+uint64
+uvm_pin(struct proc *p, uint64 va);
+
+uint64
+uvm_loan(struct proc *p, uint64 va);
+
+int
+uvm_remap(struct proc *p, uint64 va, uint64 pa);
+
+int
+copyinstr(struct proc *p, char *dst, uint64 srcva, uint64 max);
+
+int
+copyout(struct proc *p, uint64 dstva, const void *src, uint64 n);
+
+void
+vm_report(void);
+
+#endif /* __VM_H__ */
@@ -0,0 +1,208 @@
+// Per-CPU work queues, see workq.h.
+//
+// devintr() ends every interrupt in work_irq_exit(), which turns
+// interrupts back on to run the queue, Linux softirq style. The
+// queue runs on the CPU's work stack (kstack.h), not on whatever
+// stack the interrupt came in on, and q->running is set before
+// interrupts go back on. An interrupt taken meanwhile, or while the
+// idle loop runs the queue, only runs its top half: each CPU runs
+// its own queue one item at a time, never nested. Whatever gets
+// queued while the queue runs is run before it returns.
+
+#include "sbi/sbi.h"
+#include "riscv.h"
+#include "cpu.h"
+#include "kstack.h"
+#include "spinlock.h"
+#include "time.h"
+#include "workq.h"
+
+void
+work_init(struct work *w, void (*fn)(struct work **batch, int n))
+{
+	w->fn = fn;
+	w->next = NULL;
+	w->queued = 0;
+}
+
+// For WORK_CPU_ANY: this CPU, unless it is running a thread and
+// another CPU sits idle with nothing queued.
+static int
+pick_cpu(void)
+{
+	struct cpu *me = mycpu(), *c;
+	int cpu;
+
+	if (me->thread == me->idle_thread)
+		return me->id;
+	for (cpu = 0; cpu < ncpu; cpu++) {
+		c = &cpus[cpu];
+		if (c != me &&
+		    __atomic_load_n(&c->online, __ATOMIC_ACQUIRE) &&
+		    __atomic_load_n(&c->thread, __ATOMIC_RELAXED) ==
+		    c->idle_thread &&
+		    __atomic_load_n(&c->workq.len, __ATOMIC_RELAXED) == 0)
+			return cpu;
+	}
+	return me->id;
+}
+
+// Queue w on CPU cpu (or WORK_CPU_ANY), from any context. Returns 0
+// if it was queued already, where it stays. An idle remote CPU gets
+// an IPI to notice.
+int
+work_queue(struct work *w, int cpu)
+{
+	struct workq *q;
+	struct cpu *c;
+	int kick;
+
+	// whoever sets queued owns the link until the item is taken
+	if (__atomic_exchange_n(&w->queued, 1, __ATOMIC_ACQUIRE))
+		return 0;
+	push_off();
+	if (cpu == WORK_CPU_ANY)
+		cpu = pick_cpu();
+	c = &cpus[cpu];
+	q = &c->workq;
+	spin_lock(&q->lock);
+	w->next = NULL;
+	if (q->tail)
+		q->tail->next = w;
+	else
+		q->head = w;
+	q->tail = w;
+	q->len++;
+	if (c != mycpu())
+		q->routed++;
+	kick = c != mycpu() && c->thread == c->idle_thread;
+	spin_unlock(&q->lock);
+	if (kick)
+		sbi_send_ipi(1, c->hartid);
+	pop_off();
+	return 1;
+}
+
+int
+work_pending(void)
+{
+	return __atomic_load_n(&mycpu()->workq.head, __ATOMIC_RELAXED) !=
+	       NULL;
+}
+
+// Take the first item off q, which is locked, along with up to
+// WORK_BATCH - 1 more with the same fn. Returns how many.
+static int
+take_batch(struct workq *q, struct work **batch)
+{
+	struct work **pp, *w;
+	int n = 0;
+
+	for (pp = &q->head; (w = *pp) && n < WORK_BATCH;) {
+		if (n > 0 && w->fn != batch[0]->fn) {
+			pp = &w->next;
+			continue;
+		}
+		*pp = w->next;
+		batch[n++] = w;
+		__atomic_store_n(&w->queued, 0, __ATOMIC_RELEASE);
+	}
+	q->len -= n;
+	q->tail = NULL;
+	for (w = q->head; w; w = w->next)
+		q->tail = w;
+	return n;
+}
+
+// Run this CPU's queue until it is empty, on its work stack, with
+// interrupts on. The caller has set q->running.
+static void
+run_queue(void)
+{
+	struct workq *q = &mycpu()->workq;
+	struct work *batch[WORK_BATCH];
+	uint64 t0 = rdtime();
+	int n;
+
+	for (;;) {
+		spin_lock(&q->lock);
+		n = take_batch(q, batch);
+		spin_unlock(&q->lock);
+		if (n == 0)
+			break;
+		q->items += n;
+		q->batches++;
+		batch[0]->fn(batch, n);
+	}
+	q->work_ticks += rdtime() - t0;
+}
+
+static void
+run_on_work_stack(struct cpu *c)
+{
+	call_on_stack(run_queue,
+		      (uint64)(c->kstack->work_stack + KSTACK_SIZE));
+}
+
+// Run this CPU's queue, from the idle loop with interrupts on,
+// unless an interrupt on this CPU is running it already.
+void
+work_run(void)
+{
+	struct cpu *c;
+	struct workq *q;
+
+	intr_off();
+	c = mycpu();
+	q = &c->workq;
+	if (q->running) {
+		intr_on();
+		return;
+	}
+	q->running = 1;
+	intr_on();
+	run_on_work_stack(c);
+	q->running = 0;
+}
+
+// The top half of an interrupt that came in at rdtime() t0 is done:
+// account for it, then run the queue with interrupts on. Called
+// with interrupts off, and returns with them off.
+void
+work_irq_exit(uint64 t0)
+{
+	struct cpu *c = mycpu();
+	struct workq *q = &c->workq;
+	uint64 t = rdtime() - t0;
+
+	q->irq_ticks += t;
+	if (t > q->irq_max)
+		q->irq_max = t;
+	if (q->running || !q->head)
+		return;
+	q->running = 1;
+	intr_on();
+	run_on_work_stack(c);
+	intr_off();
+	q->running = 0;
+}
+
+void
+work_report(void)
+{
+	struct workq *q;
+	int cpu;
+
+	for (cpu = 0; cpu < ncpu; cpu++) {
+		q = &cpus[cpu].workq;
+		if (!q->irq_ticks && !q->items)
+			continue;
+		sbi_printf("cpu%d: interrupts off %lu us in handlers, longest "
+			   "%lu ns; work: %lu items in %lu batches, %lu "
+			   "routed here, %lu us\n", cpu,
+			   ticks_to_ns(q->irq_ticks) / NSEC_PER_USEC,
+			   ticks_to_ns(q->irq_max), q->items, q->batches,
+			   q->routed, ticks_to_ns(q->work_ticks) /
+			   NSEC_PER_USEC);
+	}
+}
@@ -0,0 +1,74 @@
+#ifndef __WORKQ_H__
+#define __WORKQ_H__
+
+#include "types.h"
+#include "spinlock.h"
+
+// Deferred work: the bottom halves of interrupt handlers. A handler
+// (the top half) does only what must happen with interrupts off,
+// typically acknowledging the device, and queues a work item for the
+// rest. Each CPU runs its queue as the interrupt returns, with
+// interrupts back on, and from the idle loop:
+//
+//	static struct work rx_work;
+//
+//	static void
+//	rx_fn(struct work **batch, int n)
+//	{
+//		...
+//	}
+//
+//	work_init(&rx_work, rx_fn);
+//	...
+//	work_queue(&rx_work, WORK_CPU_ANY); // in the interrupt handler
+//
+// An item queued again before it ran runs once. fn gets up to
+// WORK_BATCH items with the same fn that were queued on the CPU at
+// once. Each one can be queued again as soon as fn is called, and may
+// then run again, on another CPU too, before fn returns. Work runs on
+// the CPU's work stack, but in the interrupted thread's context, so
+// it must not yield or park.
+
+#define WORK_CPU_ANY -1 // this CPU, or an idle one if this one is busy
+#define WORK_BATCH   16 // items passed to fn at most
+
+struct work {
+	void (*fn)(struct work **batch, int n);
+	struct work *next;     // queue link
+	int queued;
+};
+
+// Per-CPU queue, kept in struct cpu, and interrupt time accounting.
+struct workq {
+	spinlock_t lock;
+	struct work *head;
+	struct work *tail;
+	int len;
+	int running;           // this CPU is running the queue
+	uint64 items;          // run
+	uint64 batches;        // calls of an fn
+	uint64 routed;         // queued here from other CPUs
+	uint64 irq_ticks;      // in interrupt handlers, interrupts off
+	uint64 irq_max;        // the longest handler
+	uint64 work_ticks;     // running work
+};
+
+void
+work_init(struct work *w, void (*fn)(struct work **batch, int n));
+
+int
+work_queue(struct work *w, int cpu);
+
+int
+work_pending(void);
+
+void
+work_run(void);
+
+void
+work_irq_exit(uint64 t0);
+
+void
+work_report(void);
+
+#endif /* __WORKQ_H__ */
@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""Compare two `make bench` runs and flag regressions.
+
+    make bench && cp bench.out old.out
+    ... change things ...
+    make bench
+    tools/benchcmp.py old.out bench.out
+
+Compares medians per operation, in instructions retired, cycles or
+timebase ticks, whichever both runs have first. The boot path cost
+line (boot: ...) is compared as one more benchmark, named boot; see
+make boot-icount. Exits with status 1 if anything got slower by more
+than the threshold.
+"""
+
+import argparse
+import re
+import sys
+
+LINE = re.compile(r'^bench: name=(\S+)((?: \w+=\d+)+)\s*$')
+BOOT = re.compile(r'^boot:((?: \w+=\d+)+)\s*$')
+UNITS = ('instret', 'cycles', 'ticks')
+
+
+def load(path):
+    results = {}
+    with open(path) as f:
+        for line in f:
+            line = line.rstrip('\r\n')
+            m = LINE.match(line)
+            if m:
+                name, fields = m.group(1), m.group(2)
+            else:
+                m = BOOT.match(line)
+                if not m:
+                    continue
+                # one sample of one boot: its value is the median
+                name = 'boot'
+                fields = ' iters=1' + re.sub(r' (\w+)=', r' median_\1=',
+                                             m.group(1))
+            fields = dict(kv.split('=') for kv in fields.split())
+            results[name] = {k: int(v) for k, v in fields.items()}
+    if not results:
+        sys.exit('benchcmp: no results in %s' % path)
+    return results
+
+
+def per_op(r, key):
+    return r[key] / r['iters']
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument('old')
+    ap.add_argument('new')
+    ap.add_argument('-t', '--threshold', type=float, default=10.0,
+                    help='regression threshold in percent '
+                         '(default %(default)s)')
+    args = ap.parse_args()
+
+    old, new = load(args.old), load(args.new)
+    regressed = False
+    print('%-12s %6s %12s %12s %8s' % ('name', 'unit', 'old', 'new',
+                                       'delta'))
+    for name in sorted(set(old) | set(new)):
+        if name not in old or name not in new:
+            print('%-12s only in %s' % (name,
+                                        'old' if name in old else 'new'))
+            continue
+        o, n = old[name], new[name]
+        for unit in UNITS:
+            key = 'median_' + unit
+            if o.get(key) and n.get(key):
+                break
+        a, b = per_op(o, key), per_op(n, key)
+        delta = (b - a) * 100.0 / a if a else 0.0
+        flag = ''
+        if delta > args.threshold:
+            flag = '  REGRESSION'
+            regressed = True
+        print('%-12s %6s %12.1f %12.1f %+7.1f%%%s' % (
+            name, key.split('_')[1], a, b, delta, flag))
+    sys.exit(1 if regressed else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+"""Turn the samples a PROF=timer or PROF=pmu kernel prints at shutdown
+into a profile.
+
+    make run PROF=timer | tee boot.log
+    tools/kprof.py boot.log              # flat profile
+    tools/kprof.py --folded boot.log > out.folded
+    flamegraph.pl out.folded > out.svg
+
+Addresses are resolved against kernel/kleinix.sym, so use the one
+from the same build that produced the log.
+"""
+
+import argparse
+import bisect
+import collections
+import re
+import sys
+
+SAMPLE = re.compile(r'^prof: (\d+) ([0-9a-f]+)((?: [0-9a-f]+)*)\s*$')
+
+
+class Symbols:
+    def __init__(self, path):
+        syms = {}
+        with open(path) as f:
+            for line in f:
+                fields = line.split()
+                if len(fields) != 2:
+                    continue
+                addr, name = int(fields[0], 16), fields[1]
+                # section names share their address with the first
+                # symbol in the section; prefer the symbol.
+                if name.startswith('.') and addr in syms:
+                    continue
+                if addr == 0:
+                    continue
+                syms[addr] = name
+        self.addrs = sorted(syms)
+        self.names = [syms[a] for a in self.addrs]
+
+    def lookup(self, addr):
+        i = bisect.bisect_right(self.addrs, addr) - 1
+        if i < 0:
+            return '0x%x' % addr
+        return self.names[i]
+
+
+def samples(lines, cpu):
+    for line in lines:
+        m = SAMPLE.match(line.rstrip('\r\n'))
+        if not m:
+            continue
+        if cpu is not None and int(m.group(1)) != cpu:
+            continue
+        pc = int(m.group(2), 16)
+        # a return address points past its call; look up the call.
+        callers = [int(a, 16) - 1 for a in m.group(3).split()]
+        yield [pc] + callers
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument('log', nargs='?', help='console log (default stdin)')
+    ap.add_argument('-s', '--symbols', default='kernel/kleinix.sym',
+                    help='symbol table (default %(default)s)')
+    ap.add_argument('-c', '--cpu', type=int,
+                    help='only samples taken on this CPU')
+    ap.add_argument('-f', '--folded', action='store_true',
+                    help='print folded stacks, for flamegraph.pl')
+    ap.add_argument('-n', '--top', type=int, default=30,
+                    help='functions in the flat profile (default 30)')
+    args = ap.parse_args()
+
+    syms = Symbols(args.symbols)
+    log = open(args.log) if args.log else sys.stdin
+
+    self_count = collections.Counter()
+    total_count = collections.Counter()
+    stacks = collections.Counter()
+    n = 0
+    for stack in samples(log, args.cpu):
+        names = [syms.lookup(a) for a in stack]
+        n += 1
+        self_count[names[0]] += 1
+        for name in set(names):
+            total_count[name] += 1
+        stacks[';'.join(reversed(names))] += 1
+
+    if n == 0:
+        sys.exit('kprof: no samples found; was the kernel built with PROF=?')
+
+    if args.folded:
+        for stack, count in sorted(stacks.items()):
+            print(stack, count)
+        return
+
+    print('%d samples' % n)
+    print('%7s %7s %7s  %s' % ('self%', 'self', 'total', 'function'))
+    for name, count in self_count.most_common(args.top):
+        print('%6.2f%% %7d %7d  %s' % (100.0 * count / n, count,
+                                        total_count[name], name))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""Turn the trace a TRACE=... kernel prints at shutdown into Chrome
+trace event JSON, for chrome://tracing or https://ui.perfetto.dev.
+
+    make run TRACE=irq,idle | tee boot.log
+    tools/ktrace.py boot.log > boot.json
+
+Each CPU shows up as a thread of one process.
+"""
+
+import argparse
+import json
+import re
+import sys
+
+BEGIN = re.compile(r'^trace: begin (\d+)')
+EVENT = re.compile(r'^trace: event ([0-9a-f]+) (\S+) (\S) (\S+) (\S+) (\S+)')
+RECORD = re.compile(r'^trace: (\d+) ([0-9a-f]+) ([0-9a-f]+) ([0-9a-f]+) '
+                    r'([0-9a-f]+)\s*$')
+
+
+def decode(lines):
+    timebase = None
+    events = {}
+    records = []
+    for line in lines:
+        line = line.rstrip('\r\n')
+        m = BEGIN.match(line)
+        if m:
+            timebase = int(m.group(1))
+            continue
+        m = EVENT.match(line)
+        if m:
+            args = [a if a != '-' else None for a in m.group(4, 5, 6)]
+            events[int(m.group(1), 16)] = (m.group(2), m.group(3), args)
+            continue
+        m = RECORD.match(line)
+        if m:
+            ts_id = int(m.group(2), 16)
+            records.append((int(m.group(1)), ts_id >> 16, ts_id & 0xffff,
+                            [int(a, 16) for a in m.group(3, 4, 5)]))
+    if timebase is None:
+        sys.exit('ktrace: no trace found; was the kernel built with TRACE=?')
+    return timebase, events, records
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument('log', nargs='?', help='console log (default stdin)')
+    args = ap.parse_args()
+
+    log = open(args.log) if args.log else sys.stdin
+    timebase, events, records = decode(log)
+
+    out = []
+    for cpu in sorted({r[0] for r in records}):
+        out.append({'name': 'thread_name', 'ph': 'M', 'pid': 0, 'tid': cpu,
+                    'args': {'name': 'cpu%d' % cpu}})
+    for cpu, ticks, eid, values in sorted(records, key=lambda r: r[1]):
+        name, phase, names = events.get(eid, ('event%d' % eid, 'i',
+                                              [None] * 3))
+        ev = {
+            'name': name,
+            'ph': phase,
+            'ts': ticks * 1e6 / timebase,  # microseconds
+            'pid': 0,
+            'tid': cpu,
+            'args': {n: v for n, v in zip(names, values) if n},
+        }
+        if phase == 'i':
+            ev['s'] = 't'
+        out.append(ev)
+
+    json.dump({'traceEvents': out, 'displayTimeUnit': 'ns'}, sys.stdout)
+    print()
+
+
+if __name__ == '__main__':
+    main()
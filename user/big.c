@@ -0,0 +1,20 @@
+// A large program for the exec comparison in kernel/exec.c: 1 MiB
+// of read-only data, of which it reads one byte in every 64 KiB.
+
+#include "user.h"
+
+#define BIG_SIZE   (1024 * 1024)
+#define BIG_STRIDE (64 * 1024)
+
+static const char blob[BIG_SIZE] = { 1 };
+
+int
+main(int argc, char **argv)
+{
+	const volatile char *b = blob;
+	int i, sum = 0;
+
+	for (i = 0; i < BIG_SIZE; i += BIG_STRIDE)
+		sum += b[i];
+	return sum == 1 ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+// fork() of a process with a 64 MiB heap, every page of it written:
+// time to fork, let the child exit and collect it, and the memory
+// the fork takes, copy-on-write against copying up front. Also
+// checks that a MAP_SHARED page the parent never touched is still
+// shared when the child writes it first.
+
+#include "user.h"
+
+#define HEAP_SIZE (64L * 1024 * 1024)
+#define PAGE      4096
+#define ROUNDS    2
+
+static uint64
+rdcycle(void)
+{
+	uint64 x;
+
+	asm volatile("rdcycle %0" : "=r" (x));
+	return x;
+}
+
+static int
+run(const char *name, int flags)
+{
+	uint64 t0, cycles = 0, free0, used = 0;
+	int i, pid;
+
+	for (i = 0; i < ROUNDS; i++) {
+		free0 = freemem();
+		t0 = rdcycle();
+		pid = fork(flags);
+		if (pid == 0)
+			exit(0);
+		if (pid < 0)
+			return -1;
+		// the child runs on this CPU, so not before wait()
+		used += free0 - freemem();
+		if (wait(0) != pid)
+			return -1;
+		cycles += rdcycle() - t0;
+	}
+	print("forkbench: ");
+	print(name);
+	print(": fork+exit+wait ");
+	printnum(cycles / ROUNDS);
+	print(" cycles, fork takes ");
+	printnum(used / ROUNDS / 1024);
+	print(" KiB\n");
+	return 0;
+}
+
+static int
+shared_check(void)
+{
+	volatile int *s;
+	int pid;
+
+	s = mmap(0, PAGE, PROT_READ | PROT_WRITE,
+		 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (s == MAP_FAILED)
+		return -1;
+	pid = fork(0);
+	if (pid == 0) {
+		*s = 42;
+		exit(0);
+	}
+	if (pid < 0 || wait(0) != pid || *s != 42)
+		return -1;
+	print("forkbench: shared: the child's first write is seen\n");
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	char *heap = sbrk(HEAP_SIZE);
+	long i;
+
+	if (heap == (char *)-1) {
+		print("forkbench: sbrk failed\n");
+		return 1;
+	}
+	for (i = 0; i < HEAP_SIZE; i += PAGE)
+		heap[i] = 1;
+	if (run("cow", 0) < 0 || run("copy", FORK_COPY) < 0) {
+		print("forkbench: fork failed\n");
+		return 1;
+	}
+	if (shared_check() < 0) {
+		print("forkbench: shared: the child's write is lost\n");
+		return 1;
+	}
+	return 0;
+}
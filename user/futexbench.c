@@ -0,0 +1,135 @@
+// User mutex throughput, with the futex mutex of Drepper's "Futexes
+// Are Tricky" (0 free, 1 locked, 2 locked with waiters): lock and
+// unlock pairs in one process, which never enter the kernel, then
+// processes on up to NWORKERS harts taking turns to increment a
+// counter in a MAP_SHARED page under the mutex.
+
+#include "user.h"
+
+#define NWORKERS    4
+#define UNCONTENDED 100000
+#define CONTENDED   20000 // pairs per worker
+
+struct shared {
+	uint32 mutex;
+	uint32 go;          // workers wait for it before starting
+	uint64 counter;
+	uint64 waits;       // FUTEX_WAIT calls, over all workers
+};
+
+static uint64 waits;
+
+static uint64
+rdcycle(void)
+{
+	uint64 x;
+
+	asm volatile("rdcycle %0" : "=r" (x));
+	return x;
+}
+
+static uint64
+rdtime(void)
+{
+	uint64 x;
+
+	asm volatile("rdtime %0" : "=r" (x));
+	return x;
+}
+
+static void
+mutex_lock(volatile uint32 *m)
+{
+	uint32 c = 0;
+
+	if (__atomic_compare_exchange_n(m, &c, 1, 0, __ATOMIC_ACQUIRE,
+					__ATOMIC_RELAXED))
+		return;
+	if (c != 2)
+		c = __atomic_exchange_n(m, 2, __ATOMIC_ACQUIRE);
+	while (c != 0) {
+		waits++;
+		futex(m, FUTEX_WAIT, 2, 0, 0);
+		c = __atomic_exchange_n(m, 2, __ATOMIC_ACQUIRE);
+	}
+}
+
+static void
+mutex_unlock(volatile uint32 *m)
+{
+	if (__atomic_fetch_sub(m, 1, __ATOMIC_RELEASE) != 1) {
+		__atomic_store_n(m, 0, __ATOMIC_RELEASE);
+		futex(m, FUTEX_WAKE, 1, 0, 0);
+	}
+}
+
+static void
+work(struct shared *s)
+{
+	int i;
+
+	while (!__atomic_load_n(&s->go, __ATOMIC_ACQUIRE))
+		;
+	for (i = 0; i < CONTENDED; i++) {
+		mutex_lock(&s->mutex);
+		s->counter++;
+		mutex_unlock(&s->mutex);
+	}
+	__atomic_fetch_add(&s->waits, waits, __ATOMIC_RELAXED);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct shared *s;
+	uint64 t0, t;
+	int i, n, pid;
+
+	s = mmap(0, sizeof(*s), PROT_READ | PROT_WRITE,
+		 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (s == MAP_FAILED) {
+		print("futexbench: mmap failed\n");
+		return 1;
+	}
+
+	t0 = rdcycle();
+	for (i = 0; i < UNCONTENDED; i++) {
+		mutex_lock(&s->mutex);
+		mutex_unlock(&s->mutex);
+	}
+	t = rdcycle() - t0;
+	print("futexbench: uncontended: ");
+	printnum(t / UNCONTENDED);
+	print(" cycles per lock/unlock\n");
+
+	// one worker per hart; there may be fewer harts
+	for (n = 1; n < NWORKERS; n++) {
+		pid = fork(FORK_CPU(n));
+		if (pid < 0)
+			break;
+		if (pid == 0) {
+			work(s);
+			exit(0);
+		}
+	}
+	t0 = rdtime();
+	__atomic_store_n(&s->go, 1, __ATOMIC_RELEASE);
+	work(s);
+	for (i = 1; i < n; i++)
+		wait(0);
+	t = rdtime() - t0;
+	if (s->counter != (uint64)n * CONTENDED) {
+		print("futexbench: lost updates\n");
+		return 1;
+	}
+	print("futexbench: ");
+	printnum(n);
+	print(" harts: ");
+	printnum(s->counter);
+	print(" lock/unlock in ");
+	printnum(t);
+	print(" timer ticks, ");
+	printnum(s->waits);
+	print(" futex waits\n");
+	return 0;
+}
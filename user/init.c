@@ -0,0 +1,12 @@
+// First user program: says hello and exits.
+
+#include "user.h"
+
+int
+main(int argc, char **argv)
+{
+	print("init: pid ");
+	printnum(getpid());
+	print(" running in user mode\n");
+	return 0;
+}
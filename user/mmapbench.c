@@ -0,0 +1,116 @@
+// Sequential scan of user/_big (1 MiB of data) by read() into a
+// buffer, and through mmap() without and with MADV_SEQUENTIAL:
+// cycles per pass. read() copies every byte out of the page cache;
+// mmap() maps the cached pages themselves, one fault per page, or
+// one per read-ahead window with the hint.
+
+#include "user.h"
+
+#define FILE_NAME "big"
+#define BUF_SIZE  4096
+#define ROUNDS    4
+
+static uint64
+rdcycle(void)
+{
+	uint64 x;
+
+	asm volatile("rdcycle %0" : "=r" (x));
+	return x;
+}
+
+static uint64
+sum(const unsigned char *p, unsigned long n)
+{
+	uint64 s = 0;
+
+	while (n--)
+		s += *p++;
+	return s;
+}
+
+static char buf[BUF_SIZE];
+
+// One pass with read(); the file's size goes in *size.
+static long
+scan_read(unsigned long *size, uint64 *s)
+{
+	int fd = open(FILE_NAME, O_RDONLY);
+	long n;
+
+	if (fd < 0)
+		return -1;
+	*size = *s = 0;
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		*s += sum((unsigned char *)buf, n);
+		*size += n;
+	}
+	close(fd);
+	return n;
+}
+
+static long
+scan_mmap(unsigned long size, int advice, uint64 *s)
+{
+	int fd = open(FILE_NAME, O_RDONLY);
+	void *p;
+
+	if (fd < 0)
+		return -1;
+	p = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED || madvise(p, size, advice) < 0)
+		return -1;
+	*s = sum(p, size);
+	return munmap(p, size);
+}
+
+static void
+report(const char *name, uint64 cycles)
+{
+	print("mmapbench: ");
+	print(name);
+	print(": ");
+	printnum(cycles / ROUNDS);
+	print(" cycles per pass\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	static const struct {
+		const char *name;
+		int advice;
+	} maps[] = {
+		{ "mmap", MADV_NORMAL },
+		{ "mmap sequential", MADV_SEQUENTIAL },
+	};
+	unsigned long size;
+	uint64 t0, cycles = 0, want, s;
+	int i, m;
+
+	for (i = 0; i < ROUNDS; i++) {
+		t0 = rdcycle();
+		if (scan_read(&size, &want) < 0)
+			goto bad;
+		cycles += rdcycle() - t0;
+	}
+	report("read", cycles);
+
+	for (m = 0; m < sizeof(maps) / sizeof(maps[0]); m++) {
+		cycles = 0;
+		for (i = 0; i < ROUNDS; i++) {
+			t0 = rdcycle();
+			if (scan_mmap(size, maps[m].advice, &s) < 0 ||
+			    s != want)
+				goto bad;
+			cycles += rdcycle() - t0;
+		}
+		report(maps[m].name, cycles);
+	}
+	return 0;
+
+bad:
+	print("mmapbench: scan failed\n");
+	return 1;
+}
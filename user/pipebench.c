@@ -0,0 +1,152 @@
+// Pipe throughput to a reader on another hart: TOTAL bytes written
+// 64 B, 4 KiB and 1 MiB at a time, and user/_big moved in with
+// splice(), in timer ticks per MiB. Whole-page writes lend their
+// pages to the pipe and whole-page reads map them, so the bigger
+// writes need not copy; the pipe: line at shutdown counts how often
+// that happened.
+
+#include "user.h"
+
+#define TOTAL     (4 << 20)
+#define WBUF_SIZE (1 << 20)
+#define RBUF_SIZE (1 << 20)
+#define SAMPLE    64 // the reader checks one byte in SAMPLE
+
+static char *wbuf, *rbuf;
+
+static uint64
+rdtime(void)
+{
+	uint64 x;
+
+	asm volatile("rdtime %0" : "=r" (x));
+	return x;
+}
+
+// Read fd to its end, sampling bytes: exit status 0 if there were
+// size of them and the samples add up to want.
+static int
+reader(int fd, unsigned long size, uint64 want)
+{
+	unsigned long pos = 0, i;
+	uint64 s = 0;
+	long n;
+
+	while ((n = read(fd, rbuf, RBUF_SIZE)) > 0) {
+		for (i = (SAMPLE - pos % SAMPLE) % SAMPLE; i < n; i += SAMPLE)
+			s += (unsigned char)rbuf[i];
+		pos += n;
+	}
+	return n < 0 || pos != size || s != want;
+}
+
+// Start a reader of a new pipe on another hart, if there is one.
+// Returns its pid, with the write end in *wfd.
+static int
+start_reader(int *wfd, unsigned long size, uint64 want)
+{
+	int fds[2], pid;
+
+	if (pipe(fds) < 0)
+		return -1;
+	pid = fork(FORK_CPU(1));
+	if (pid < 0)
+		pid = fork(0);
+	if (pid == 0) {
+		close(fds[1]);
+		exit(reader(fds[0], size, want));
+	}
+	close(fds[0]);
+	*wfd = fds[1];
+	return pid;
+}
+
+static int
+finish(const char *name, int pid, int wfd, unsigned long size, uint64 t0)
+{
+	int status;
+
+	close(wfd);
+	if (pid < 0 || wait(&status) != pid || status) {
+		print("pipebench: ");
+		print(name);
+		print(" failed\n");
+		return -1;
+	}
+	print("pipebench: ");
+	print(name);
+	print(": ");
+	printnum((rdtime() - t0) * (1 << 20) / size);
+	print(" timer ticks per MiB\n");
+	return 0;
+}
+
+static int
+run_writes(const char *name, unsigned long wsize)
+{
+	unsigned long pos;
+	uint64 want = 0, t0;
+	int pid, wfd;
+
+	for (pos = 0; pos < TOTAL; pos += SAMPLE)
+		want += (unsigned char)wbuf[pos % wsize];
+	pid = start_reader(&wfd, TOTAL, want);
+	t0 = rdtime();
+	for (pos = 0; pid > 0 && pos < TOTAL; pos += wsize)
+		if (write(wfd, wbuf, wsize) != wsize)
+			break;
+	return finish(name, pid, wfd, TOTAL, t0);
+}
+
+static int
+run_splice(void)
+{
+	unsigned long size = 0, i;
+	uint64 want = 0, t0;
+	int fd, pid, wfd;
+	long n;
+
+	// the samples, by read()
+	fd = open("big", O_RDONLY);
+	if (fd < 0)
+		return -1;
+	while ((n = read(fd, rbuf, RBUF_SIZE)) > 0) {
+		for (i = (SAMPLE - size % SAMPLE) % SAMPLE; i < n;
+		     i += SAMPLE)
+			want += (unsigned char)rbuf[i];
+		size += n;
+	}
+	close(fd);
+
+	fd = open("big", O_RDONLY);
+	if (fd < 0)
+		return -1;
+	pid = start_reader(&wfd, size, want);
+	t0 = rdtime();
+	while (pid > 0 && splice(fd, wfd, RBUF_SIZE) > 0)
+		;
+	close(fd);
+	return finish("splice big", pid, wfd, size, t0);
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned long i;
+
+	wbuf = mmap(0, WBUF_SIZE, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	rbuf = mmap(0, RBUF_SIZE, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (wbuf == MAP_FAILED || rbuf == MAP_FAILED)
+		return 1;
+	for (i = 0; i < WBUF_SIZE; i++)
+		wbuf[i] = i / SAMPLE + i % 7;
+
+	if (run_writes("64 B writes", 64) < 0 ||
+	    run_writes("4 KiB writes", 4096) < 0 ||
+	    run_writes("1 MiB writes", 1 << 20) < 0 ||
+	    run_splice() < 0)
+		return 1;
+	return 0;
+}
@@ -0,0 +1,67 @@
+// Random reads over a 128 MiB anonymous mapping, backed by 2 MiB
+// megapages and then, after madvise(MADV_NOHUGEPAGE), by 4 KiB
+// pages: cycles to fault it all in, and per read. Which pages the
+// kernel actually used shows in its vm: line at shutdown.
+
+#include "user.h"
+
+#define ARRAY_SIZE (128L * 1024 * 1024)
+#define PAGE       4096
+#define READS      (1L << 20)
+
+static uint64
+rdcycle(void)
+{
+	uint64 x;
+
+	asm volatile("rdcycle %0" : "=r" (x));
+	return x;
+}
+
+static int
+run(const char *name, int advice)
+{
+	volatile uint64 *a;
+	uint64 t0, fault, read, x = 1, sum = 0;
+	long i;
+
+	a = mmap(0, ARRAY_SIZE, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (a == MAP_FAILED || madvise((void *)a, ARRAY_SIZE, advice) < 0)
+		return -1;
+
+	t0 = rdcycle();
+	for (i = 0; i < ARRAY_SIZE / 8; i += PAGE / 8)
+		a[i] = i;
+	fault = rdcycle() - t0;
+
+	t0 = rdcycle();
+	for (i = 0; i < READS; i++) {
+		// 64-bit LCG, Knuth's MMIX constants
+		x = x * 6364136223846793005UL + 1442695040888963407UL;
+		sum += a[(x >> 16) % (ARRAY_SIZE / 8)];
+	}
+	read = rdcycle() - t0;
+
+	if (munmap((void *)a, ARRAY_SIZE) < 0)
+		return -1;
+	print("thpbench: ");
+	print(name);
+	print(": fault-in ");
+	printnum(fault);
+	print(" cycles, ");
+	printnum(read / READS);
+	print(" cycles per random read\n");
+	return sum == 0x5eed; // keep the reads
+}
+
+int
+main(int argc, char **argv)
+{
+	if (run("2 MiB pages", MADV_HUGEPAGE) < 0 ||
+	    run("4 KiB pages", MADV_NOHUGEPAGE) < 0) {
+		print("thpbench: mmap failed\n");
+		return 1;
+	}
+	return 0;
+}
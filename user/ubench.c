@@ -0,0 +1,14 @@
+// User half of the syscall_null benchmark in kernel/syscall.c:
+// ubench n makes n getpid() calls.
+
+#include "user.h"
+
+int
+main(int argc, char **argv)
+{
+	int n = argc > 1 ? atoi(argv[1]) : 0;
+
+	while (n--)
+		getpid();
+	return 0;
+}
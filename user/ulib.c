@@ -0,0 +1,51 @@
+#include "user.h"
+
+int
+main(int argc, char **argv);
+
+// Entry point of every program: the kernel starts it with argc and
+// argv in a0 and a1, and sp just below argv.
+void
+_start(int argc, char **argv)
+{
+	exit(main(argc, argv));
+}
+
+unsigned long
+strlen(const char *s)
+{
+	unsigned long n;
+
+	for (n = 0; s[n]; n++)
+		;
+	return n;
+}
+
+int
+atoi(const char *s)
+{
+	int n = 0;
+
+	while ('0' <= *s && *s <= '9')
+		n = n * 10 + *s++ - '0';
+	return n;
+}
+
+void
+print(const char *s)
+{
+	write(1, s, strlen(s));
+}
+
+void
+printnum(unsigned long n)
+{
+	char buf[24], *p = buf + sizeof(buf);
+
+	*--p = '\0';
+	do {
+		*--p = '0' + n % 10;
+		n /= 10;
+	} while (n);
+	print(p);
+}
@@ -0,0 +1,234 @@
+// 4 KiB random reads of the virtio disk three ways: blkread(), one
+// syscall per read; the rings, QD reads per uring_enter(); and the
+// rings with a kernel polling thread, which the process only enters
+// to wake it. Timer ticks per read and syscalls in all; the three
+// must read the same data.
+
+#include "user.h"
+
+#define BLOCK  4096
+#define SPAN   (16 << 20) // bytes at the start of the disk read from
+#define NREADS 1024
+#define QD     16         // reads in flight on the rings
+
+static volatile struct uring_sq *sq;
+static volatile struct uring_cq *cq;
+static char *bufs;        // QD blocks of MAP_SHARED memory
+static uint64 seed;
+static uint64 syscalls;
+
+static uint64
+rdtime(void)
+{
+	uint64 x;
+
+	asm volatile("rdtime %0" : "=r" (x));
+	return x;
+}
+
+// The same random offsets on every run.
+static uint64
+next_off(void)
+{
+	seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+	return (seed >> 33) % (SPAN / BLOCK) * BLOCK;
+}
+
+static uint64
+sum(const uint64 *p)
+{
+	uint64 s = 0;
+	int i;
+
+	for (i = 0; i < BLOCK / sizeof(*p); i++)
+		s += p[i];
+	return s;
+}
+
+static void *
+map_shared(unsigned long len)
+{
+	return mmap(0, len, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+}
+
+static int
+run_blkread(uint64 *s)
+{
+	char *b;
+	int i;
+
+	for (i = 0; i < NREADS; i++) {
+		b = bufs + i % QD * BLOCK;
+		syscalls++;
+		if (blkread(b, next_off(), BLOCK) != BLOCK)
+			return -1;
+		*s += sum((uint64 *)b);
+	}
+	return 0;
+}
+
+static int
+setup(int flags)
+{
+	void *ring = map_shared(URING_SIZE);
+
+	if (ring == MAP_FAILED || uring_setup(ring, flags) < 0)
+		return -1;
+	sq = ring;
+	cq = (void *)((char *)ring + URING_CQ_OFF);
+	return 0;
+}
+
+// Add a read into buffer i, with i as its user_data.
+static void
+queue_read(int i, int opcode)
+{
+	volatile struct uring_sqe *e = &sq->sqes[sq->tail % URING_SQ_ENTRIES];
+
+	e->opcode = opcode;
+	e->flags = 0;
+	e->buf_index = i;
+	e->len = BLOCK;
+	e->off = next_off();
+	e->addr = (uint64)(bufs + i * BLOCK);
+	e->user_data = i;
+	__atomic_store_n(&sq->tail, sq->tail + 1, __ATOMIC_RELEASE);
+}
+
+// Consume the cqes there are, adding their buffers to *s and to
+// free[]. Returns how many, or -1 after a failed read.
+static int
+reap(uint64 *s, int *free, int *nfree)
+{
+	uint32 head = cq->head;
+	uint32 tail = __atomic_load_n(&cq->tail, __ATOMIC_ACQUIRE);
+	volatile struct uring_cqe *c;
+	int n;
+
+	for (n = 0; head != tail; head++, n++) {
+		c = &cq->cqes[head % URING_CQ_ENTRIES];
+		if (c->res != BLOCK)
+			return -1;
+		*s += sum((uint64 *)(bufs + c->user_data * BLOCK));
+		free[(*nfree)++] = c->user_data;
+	}
+	__atomic_store_n(&cq->head, head, __ATOMIC_RELEASE);
+	return n;
+}
+
+// QD reads per uring_enter(), which waits for all of them.
+static int
+run_ring(uint64 *s)
+{
+	int free[QD], nfree = 0;
+	int i, n;
+
+	if (setup(0) < 0)
+		return -1;
+	for (n = 0; n < NREADS; n += QD) {
+		for (i = 0; i < QD; i++)
+			queue_read(i, URING_OP_READ);
+		syscalls++;
+		if (uring_enter(QD, QD, 0) != QD ||
+		    reap(s, free, &nfree) != QD)
+			return -1;
+		nfree = 0;
+	}
+	return 0;
+}
+
+// Keep QD reads in flight and poll for their cqes; the polling
+// thread takes the sqes, into registered buffers.
+static int
+run_sqpoll(uint64 *s)
+{
+	int free[QD], nfree, issued = 0, done = 0, n;
+
+	if (setup(URING_SETUP_SQPOLL) < 0 || uring_register(bufs, QD) < 0)
+		return -1;
+	for (nfree = 0; nfree < QD; nfree++)
+		free[nfree] = nfree;
+	while (done < NREADS) {
+		n = 0;
+		while (nfree > 0 && issued < NREADS) {
+			queue_read(free[--nfree], URING_OP_READ_FIXED);
+			issued++;
+			n++;
+		}
+		// the tail is stored before the flag is read, see
+		// sqpoll_main()
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (n && (sq->flags & URING_SQ_NEED_WAKEUP)) {
+			syscalls++;
+			uring_enter(0, 0, URING_ENTER_SQ_WAKEUP);
+		}
+		if ((n = reap(s, free, &nfree)) < 0)
+			return -1;
+		done += n;
+	}
+	return 0;
+}
+
+static int
+run(const char *name, int (*fn)(uint64 *), uint64 *s)
+{
+	uint64 t0, t;
+
+	seed = 1;
+	syscalls = 0;
+	*s = 0;
+	t0 = rdtime();
+	if (fn(s) < 0) {
+		print("uringbench: ");
+		print(name);
+		print(" failed\n");
+		return -1;
+	}
+	t = rdtime() - t0;
+	print("uringbench: ");
+	print(name);
+	print(": ");
+	printnum(t / NREADS);
+	print(" timer ticks per read, ");
+	printnum(syscalls);
+	print(" syscalls\n");
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	uint64 want, s;
+	int pid, status;
+
+	bufs = map_shared(QD * BLOCK);
+	if (bufs == MAP_FAILED)
+		return 1;
+	if (blkread(bufs, 0, BLOCK) != BLOCK) {
+		print("uringbench: no disk\n");
+		return 0;
+	}
+	if (run("blkread", run_blkread, &want) < 0 ||
+	    run("ring", run_ring, &s) < 0)
+		return 1;
+	if (s != want)
+		goto bad;
+
+	// A process has one set of rings: the polling one in a child.
+	pid = fork(0);
+	if (pid == 0) {
+		if (run("ring sqpoll", run_sqpoll, &s) < 0)
+			exit(1);
+		exit(s != want);
+	}
+	if (pid < 0 || wait(&status) != pid)
+		return 1;
+	if (status)
+		goto bad;
+	return 0;
+
+bad:
+	print("uringbench: the reads differ\n");
+	return 1;
+}
@@ -0,0 +1,94 @@
+#ifndef __USER_H__
+#define __USER_H__
+
+#include "../kernel/types.h"
+#include "../kernel/syscall.h"
+#include "../kernel/mman.h"
+#include "../kernel/fcntl.h"
+#include "../kernel/futex.h"
+#include "../kernel/uring.h"
+
+// system calls, in usys.S
+void __attribute__((noreturn))
+exit(int status);
+
+int
+getpid(void);
+
+long
+write(int fd, const void *buf, unsigned long n);
+
+int
+yield(void);
+
+char *
+sbrk(long n);
+
+unsigned long
+freemem(void);
+
+void *
+mmap(void *addr, unsigned long len, int prot, int flags, int fd,
+     long off);
+
+int
+munmap(void *addr, unsigned long len);
+
+int
+mprotect(void *addr, unsigned long len, int prot);
+
+int
+madvise(void *addr, unsigned long len, int advice);
+
+int
+open(const char *path, int flags);
+
+long
+read(int fd, void *buf, unsigned long n);
+
+int
+close(int fd);
+
+long
+futex(volatile uint32 *uaddr, int op, uint32 val, uint64 val2,
+      volatile uint32 *uaddr2);
+
+long
+blkread(void *buf, unsigned long off, unsigned long len);
+
+int
+uring_setup(void *ring, int flags);
+
+long
+uring_enter(unsigned long to_submit, unsigned long min_complete,
+	    int flags);
+
+int
+uring_register(void *addr, unsigned long n);
+
+int
+pipe(int fds[2]);
+
+long
+splice(int fd_in, int fd_out, unsigned long n);
+
+int
+fork(int flags);
+
+int
+wait(int *status);
+
+// ulib.c
+unsigned long
+strlen(const char *s);
+
+int
+atoi(const char *s);
+
+void
+print(const char *s);
+
+void
+printnum(unsigned long n);
+
+#endif /* __USER_H__ */